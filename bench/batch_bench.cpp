@@ -0,0 +1,65 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <numeric>
+#include <random>
+#include <vector>
+#include "bst.hpp"
+
+// Compares find() one key at a time with find_batch() on trees from cache-resident to much
+// larger than the last level cache: every row is the mean time per lookup, in nanoseconds.
+
+using clock_type = std::chrono::steady_clock;
+
+template <typename F>
+double per_op(std::size_t n, F f) {
+    auto start = clock_type::now();
+    f();
+    std::chrono::duration<double, std::nano> elapsed {clock_type::now() - start};
+    return elapsed.count() / n;
+}
+
+template <typename tree>
+void run(const char* name, std::size_t n, const std::vector<int>& probes) {
+    // a shuffled insertion order spreads the nodes over the heap, as in a long-lived tree
+    std::vector<int> keys(n);
+    std::iota(keys.begin(), keys.end(), 0);
+    std::shuffle(keys.begin(), keys.end(), std::mt19937{7});
+    tree t;
+    for(auto k : keys)
+        t.insert({2 * k, k});
+
+    long checksum {0};
+    auto single = per_op(probes.size(), [&] {
+        for(auto k : probes) {
+            auto it = t.find(k);
+            if(it != t.end())
+                checksum += it->second;
+        }
+    });
+    std::vector<decltype(t.end())> found(probes.size(), t.end());
+    auto batch = per_op(probes.size(), [&] {
+        t.find_batch(probes.begin(), probes.end(), found.begin());
+    });
+    for(auto it : found)
+        if(it != t.end())
+            checksum -= it->second;
+    std::printf("%-16s %10zu %10.1f %10.1f %8.2fx   (%ld)\n", name, n, single, batch, single / batch, checksum);
+}
+
+int main() {
+    using P = std::pair<const int, int>;
+    using avl = bst<int, int, std::less<int>, no_instrumentation, avl_balancing>;
+    using flat = bst<int, int, std::less<int>, no_instrumentation, avl_balancing, std::allocator<P>, flat_storage>;
+
+    std::printf("%-16s %10s %10s %10s %9s\n", "tree", "size", "find", "find_batch", "speedup");
+    for(std::size_t n : {std::size_t{1} << 12, std::size_t{1} << 16, std::size_t{1} << 20, std::size_t{1} << 22}) {
+        std::mt19937 gen {42};
+        std::vector<int> probes(1000000);
+        for(auto& p : probes)
+            p = static_cast<int>(gen() % (2 * n));
+        run<avl>("avl", n, probes);
+        run<flat>("avl flat", n, probes);
+    }
+    return 0;
+}
@@ -0,0 +1,79 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <numeric>
+#include <random>
+#include <vector>
+#include "bst.hpp"
+#include "btree.hpp"
+
+// Compares btree with bst on the same workloads: every row is the mean time per operation.
+
+using clock_type = std::chrono::steady_clock;
+
+template <typename F>
+double per_op(std::size_t n, F f) {
+    auto start = clock_type::now();
+    f();
+    std::chrono::duration<double, std::nano> elapsed {clock_type::now() - start};
+    return elapsed.count() / n;
+}
+
+template <typename tree>
+void run(const char* name, const std::vector<int>& keys, const std::vector<int>& probes) {
+    const auto n = keys.size();
+    long checksum {0};
+    tree t;
+
+    auto insert = per_op(n, [&] {
+        for(auto k : keys)
+            t.insert({k, k});
+    });
+    auto find = per_op(probes.size(), [&] {
+        for(auto k : probes) {
+            auto it = t.find(k);
+            if(it != t.end())
+                checksum += it->second;
+        }
+    });
+    long sum {0};
+    auto scan = per_op(n, [&] {
+        for(const auto& x : t)
+            sum += x.second;
+    });
+    auto erase = per_op(n, [&] {
+        for(auto k : keys)
+            t.erase(k);
+    });
+    std::printf("%-24s %10.1f %10.1f %10.1f %10.1f   (%ld)\n", name, insert, find, scan, erase, checksum + sum);
+}
+
+int main() {
+    const std::size_t n {1000000};
+    std::mt19937 gen {42};
+
+    std::vector<int> sorted(n);
+    std::iota(sorted.begin(), sorted.end(), 0);
+    std::vector<int> shuffled {sorted};
+    std::shuffle(shuffled.begin(), shuffled.end(), gen);
+    std::vector<int> probes(n);
+    for(auto& p : probes)
+        p = static_cast<int>(gen() % (2 * n));
+
+    using avl_tree = bst<int, int, std::less<int>, no_instrumentation, avl_balancing>;
+    using flat_avl_tree = bst<int, int, std::less<int>, no_instrumentation, avl_balancing,
+                              std::allocator<std::pair<const int, int>>, flat_storage>;
+
+    std::printf("ns per operation, %zu keys\n", n);
+    std::printf("%-24s %10s %10s %10s %10s\n", "", "insert", "find", "scan", "erase");
+    std::printf("random keys\n");
+    run<bst<int, int>>("bst", shuffled, probes);
+    run<avl_tree>("bst avl", shuffled, probes);
+    run<flat_avl_tree>("bst avl flat", shuffled, probes);
+    run<btree<int, int>>("btree", shuffled, probes);
+    std::printf("sorted keys\n");
+    run<avl_tree>("bst avl", sorted, probes);
+    run<flat_avl_tree>("bst avl flat", sorted, probes);
+    run<btree<int, int>>("btree", sorted, probes);
+    return 0;
+}
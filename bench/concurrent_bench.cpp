@@ -0,0 +1,112 @@
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <mutex>
+#include <random>
+#include <thread>
+#include <vector>
+#include "bst.hpp"
+#include "fine_grained_bst.hpp"
+
+// Compares the throughput of fine_grained_bst from 1 to N threads with a bst behind a mutex, on a
+// mix of 50% find, 25% insert and 25% erase of random keys. test/fine_grained_test.cpp checks it
+// under contention and for linearizability.
+
+using clock_type = std::chrono::steady_clock;
+
+/** \brief an avl bst serialized by one mutex, the usual way to share a bst */
+class locked_bst {
+    bst<int, int, std::less<int>, no_instrumentation, avl_balancing> t;
+    std::mutex m;
+
+    public:
+
+    bool contains(int k) {
+        std::lock_guard<std::mutex> lock {m};
+        return t.find(k) != t.end();
+    }
+
+    bool insert(int k, int v) {
+        std::lock_guard<std::mutex> lock {m};
+        return t.insert({k, v}).second;
+    }
+
+    bool erase(int k) {
+        std::lock_guard<std::mutex> lock {m};
+        return t.erase(k) == 1;
+    }
+};
+
+/** \brief the same calls on fine_grained_bst */
+class fine_grained {
+    fine_grained_bst<int, int> t;
+
+    public:
+
+    bool contains(int k) {
+        return t.contains(k);
+    }
+
+    bool insert(int k, int v) {
+        return t.insert({k, v});
+    }
+
+    bool erase(int k) {
+        return t.erase(k);
+    }
+};
+
+/** \brief sink for the results, so that the compiler keeps the work */
+volatile long sink;
+
+template <typename tree>
+double throughput(unsigned threads, int ops, int range) {
+    tree t;
+    std::mt19937 gen {1};
+    for(int i = 0; i < range / 2; ++i)
+        t.insert(static_cast<int>(gen() % range), i);
+
+    std::atomic<unsigned> ready {0};
+    std::atomic<bool> go {false};
+    std::vector<std::thread> workers;
+    for(unsigned id = 0; id < threads; ++id)
+        workers.emplace_back([&, id] {
+            std::mt19937 g {id + 100};
+            ++ready;
+            while(!go.load())
+                std::this_thread::yield();
+            long hits {0};
+            for(int i = 0; i < ops; ++i) {
+                const int k {static_cast<int>(g() % range)};
+                const auto op = g() % 4;
+                if(op < 2)
+                    hits += t.contains(k);
+                else if(op == 2)
+                    hits += t.insert(k, i);
+                else
+                    hits += t.erase(k);
+            }
+            sink = hits;
+        });
+    while(ready.load() != threads)
+        std::this_thread::yield();
+    auto start = clock_type::now();
+    go = true;
+    for(auto& w : workers)
+        w.join();
+    std::chrono::duration<double> elapsed {clock_type::now() - start};
+    return threads * static_cast<double>(ops) / elapsed.count() / 1e6;
+}
+
+int main() {
+    const unsigned max_threads {std::max(16u, std::thread::hardware_concurrency())};
+    const int ops {200000}, range {1 << 20};
+
+    std::printf("Mops per second, %d random keys, %u cores\n", range, std::thread::hardware_concurrency());
+    std::printf("%-8s %14s %18s\n", "threads", "bst + mutex", "fine_grained_bst");
+    for(unsigned n = 1; n <= max_threads; n *= 2)
+        std::printf("%-8u %14.2f %18.2f\n", n, throughput<locked_bst>(n, ops, range),
+                    throughput<fine_grained>(n, ops, range));
+    return 0;
+}
@@ -0,0 +1,107 @@
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <numeric>
+#include <random>
+#include <vector>
+#include "bst.hpp"
+
+// Compares splay_balancing with the static trees (a bst balanced once with balance(), and an
+// AVL tree) on lookup traces over 2^20 keys: Zipfian ones, and one where 90% of the lookups go
+// to 1% of the keys. In the drifting traces the hot keys change every 100000 lookups.
+// Every row is the mean time per find(), in nanoseconds.
+
+using clock_type = std::chrono::steady_clock;
+
+/** \brief ranks in [0, n) with probability proportional to 1 / (rank + 1)^s, by inversion of the cumulative */
+std::vector<std::size_t> zipf_ranks(std::size_t n, double s, std::size_t count, std::mt19937_64& gen) {
+    std::vector<double> cumulative(n);
+    double sum {0};
+    for(std::size_t i = 0; i < n; ++i)
+        cumulative[i] = sum += 1 / std::pow(static_cast<double>(i + 1), s);
+    std::uniform_real_distribution<double> u {0, sum};
+    std::vector<std::size_t> ranks(count);
+    for(auto& r : ranks) {
+        const auto at = std::lower_bound(cumulative.begin(), cumulative.end(), u(gen)) - cumulative.begin();
+        r = std::min(static_cast<std::size_t>(at), n - 1);
+    }
+    return ranks;
+}
+
+/** \brief ranks in [0, n) , a fraction \p hit of them uniform among the first n / 100 , the others among all */
+std::vector<std::size_t> hot_ranks(std::size_t n, double hit, std::size_t count, std::mt19937_64& gen) {
+    std::bernoulli_distribution hot {hit};
+    std::vector<std::size_t> ranks(count);
+    for(auto& r : ranks)
+        r = gen() % (hot(gen) ? n / 100 : n);
+    return ranks;
+}
+
+/** \brief lookups of the keys of \p order ranked by a Zipf distribution of exponent \p s ,
+ * or by hot_ranks() with 90% of hits if \p s is 0
+ *
+ * With \p drift the ranks are given to other keys every phase lookups. */
+std::vector<int> trace(const std::vector<int>& order, double s, bool drift, std::size_t count) {
+    const std::size_t phase {100000};
+    std::mt19937_64 gen {42};
+    auto ranks = s ? zipf_ranks(order.size(), s, count, gen) : hot_ranks(order.size(), 0.9, count, gen);
+    std::vector<int> probes(count);
+    std::size_t shift {0};
+    for(std::size_t i = 0; i < count; ++i) {
+        if(drift && i % phase == 0)
+            shift = gen() % order.size();
+        probes[i] = order[(ranks[i] + shift) % order.size()];
+    }
+    return probes;
+}
+
+template <typename tree>
+void run(const char* name, const std::vector<int>& keys, const std::vector<int>& probes, bool balanced) {
+    tree t;
+    for(auto k : keys)
+        t.insert({k, k});
+    if(balanced)
+        t.balance();
+
+    long checksum {0};
+    auto start = clock_type::now();
+    for(auto k : probes) {
+        auto it = t.find(k);
+        if(it != t.end())
+            checksum += it->second;
+    }
+    std::chrono::duration<double, std::nano> elapsed {clock_type::now() - start};
+    std::printf("  %-22s %10.1f   (%ld)\n", name, elapsed.count() / static_cast<double>(probes.size()), checksum);
+}
+
+int main() {
+    using plain = bst<int, int>;
+    using avl = bst<int, int, std::less<int>, no_instrumentation, avl_balancing>;
+    using splay = bst<int, int, std::less<int>, no_instrumentation, splay_balancing<>>;
+    using splay_deep = bst<int, int, std::less<int>, no_instrumentation, splay_balancing<1, 8>>;
+    using splay_every4 = bst<int, int, std::less<int>, no_instrumentation, splay_balancing<4>>;
+
+    const std::size_t n {std::size_t{1} << 20};
+    const std::size_t count {2000000};
+    // a shuffled insertion order spreads the nodes over the heap, and the hot keys over the tree
+    std::vector<int> keys(n);
+    std::iota(keys.begin(), keys.end(), 0);
+    std::shuffle(keys.begin(), keys.end(), std::mt19937{7});
+
+    for(double s : {0.8, 0.99, 1.2, 0.0}) {
+        for(bool drift : {false, true}) {
+            const auto probes = trace(keys, s, drift, count);
+            if(s)
+                std::printf("zipf s = %.2f%s, %zu keys, ns per find\n", s, drift ? " drifting" : "", n);
+            else
+                std::printf("90%% on 1%% of the keys%s, %zu keys, ns per find\n", drift ? " drifting" : "", n);
+            run<plain>("static (balance())", keys, probes, true);
+            run<avl>("avl", keys, probes, false);
+            run<splay>("splay", keys, probes, false);
+            run<splay_deep>("splay depth > 8", keys, probes, false);
+            run<splay_every4>("splay every 4th", keys, probes, false);
+        }
+    }
+    return 0;
+}
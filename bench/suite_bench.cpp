@@ -0,0 +1,315 @@
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <map>
+#include <numeric>
+#include <random>
+#include <string>
+#include <type_traits>
+#include <unordered_map>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+#include "bst.hpp"
+
+// Benchmark suite: every operation of bst and of the standard maps, on several key streams
+// and sizes, printed as CSV on stdout (lines starting with # are comments).
+//
+//   ./bench/suite_bench.x [max_size [min_size]]
+//
+// Sizes go by powers of ten from min_size (default 1000) to max_size (default 100000, up to 1e8).
+// Every row gives the operations timed, the throughput in millions of operations per second and
+// the 50th and 99th percentile of the latency of a single operation, in nanoseconds.
+// Throughput and latency come from two separate runs on identical containers, so that reading
+// the clock around every operation does not slow down the throughput run.
+// balance, copy and iteration work on the whole container: they are repeated a few times,
+// throughput counts elements and the percentiles are those of a whole pass.
+// All the streams come from fixed seeds, so every run sees the same keys. They are made one
+// workload at a time, at most three streams of 8-byte keys, under 2.5 GB at 1e8.
+
+using clock_type = std::chrono::steady_clock;
+using key = std::uint64_t;
+using value = std::uint64_t;
+
+/** \brief key streams: the keys inserted, in order, the keys then looked up, and the keys erased */
+struct workload {
+    const char* name;
+    std::vector<key> keys;
+    /** \brief keys looked up, the inserted ones if empty */
+    std::vector<key> probes;
+    /** \brief keys without repetitions, in order of first insertion, the inserted ones if empty */
+    std::vector<key> distinct;
+
+    const std::vector<key>& lookups() const {
+        return probes.empty() ? keys : probes;
+    }
+
+    const std::vector<key>& erased() const {
+        return distinct.empty() ? keys : distinct;
+    }
+};
+
+/** \brief scatter the integer \p x over the 64-bit keys, keeping distinct values distinct */
+key scatter(key x) {
+    x += 0x9e3779b97f4a7c15ull;
+    x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ull;
+    x = (x ^ (x >> 27)) * 0x94d049bb133111ebull;
+    return x ^ (x >> 31);
+}
+
+/** \brief ranks in [0, n) with probability proportional to 1 / (rank + 1)^s
+ *
+ * Rejection-inversion sampling (Hormann and Derflinger): the ranks are drawn by inversion of
+ * the integral of the density, which is known in closed form, and the few that fall outside
+ * the histogram of the exact distribution are drawn again. Constant memory, whatever n is. */
+class zipf_distribution {
+    std::size_t n;
+    double s;
+    double h_integral_first, h_integral_last, threshold;
+
+    /** \brief log(1 + x) / x , accurate near 0 */
+    static double log1p_over(double x) {
+        return std::abs(x) > 1e-8 ? std::log1p(x) / x : 1 - x * (0.5 - x * (1.0 / 3 - 0.25 * x));
+    }
+
+    /** \brief (exp(x) - 1) / x , accurate near 0 */
+    static double expm1_over(double x) {
+        return std::abs(x) > 1e-8 ? std::expm1(x) / x : 1 + x * 0.5 * (1 + x / 3 * (1 + 0.25 * x));
+    }
+
+    /** \brief the density, x^-s */
+    double h(double x) const {
+        return std::exp(-s * std::log(x));
+    }
+
+    /** \brief its integral, (x^(1-s) - 1) / (1 - s) , and log(x) for s = 1 */
+    double h_integral(double x) const {
+        const double log_x {std::log(x)};
+        return expm1_over((1 - s) * log_x) * log_x;
+    }
+
+    double h_integral_inverse(double x) const {
+        return std::exp(log1p_over(std::max(x * (1 - s), -1.0)) * x);
+    }
+
+    public:
+
+    zipf_distribution(std::size_t size, double exponent): n{size}, s{exponent} {
+        h_integral_first = h_integral(1.5) - 1;
+        h_integral_last = h_integral(static_cast<double>(n) + 0.5);
+        threshold = 2 - h_integral_inverse(h_integral(2.5) - h(2));
+    }
+
+    template <typename generator>
+    std::size_t operator()(generator& gen) {
+        std::uniform_real_distribution<double> uniform {0, 1};
+        while(true) {
+            const double u {h_integral_last + uniform(gen) * (h_integral_first - h_integral_last)};
+            const double x {h_integral_inverse(u)};
+            const double k {std::clamp(std::floor(x + 0.5), 1.0, static_cast<double>(n))};
+            if(k - x <= threshold || u >= h_integral(k + 0.5) - h(k))
+                return static_cast<std::size_t>(k) - 1;
+        }
+    }
+};
+
+/** \brief names of the workloads, each made by make_workload() */
+const char* const workload_names[] {"sorted", "reverse", "uniform", "zipf", "clustered"};
+
+/** \brief the workload \p name of size \p n
+ *
+ * Only one is built at a time: at the largest sizes the streams take gigabytes. */
+workload make_workload(const std::string& name, std::size_t n) {
+    std::mt19937_64 gen {42};
+    workload w {nullptr, std::vector<key>(n), {}, {}};
+
+    if(name == "sorted") {
+        w.name = "sorted";
+        std::iota(w.keys.begin(), w.keys.end(), key{0});
+    }
+    else if(name == "reverse") {
+        w.name = "reverse";
+        for(std::size_t i = 0; i < n; ++i)
+            w.keys[i] = n - 1 - i;
+    }
+    else if(name == "uniform") {
+        w.name = "uniform";
+        for(std::size_t i = 0; i < n; ++i)
+            w.keys[i] = scatter(i);
+        w.probes.resize(n);
+        for(auto& p : w.probes)
+            p = w.keys[gen() % n];
+    }
+    else if(name == "zipf") {
+        // skewed: a few keys take most of the insertions (most of which find the key present) and of the lookups
+        w.name = "zipf";
+        zipf_distribution zipf {n, 0.99};
+        std::vector<bool> seen(n);
+        for(auto& k : w.keys) {
+            const auto rank = zipf(gen);
+            k = scatter(rank);
+            if(!seen[rank]) {
+                seen[rank] = true;
+                w.distinct.push_back(k);
+            }
+        }
+        w.probes.resize(n);
+        for(auto& p : w.probes)
+            p = scatter(zipf(gen));
+    }
+    else {
+        // runs of 64 consecutive keys starting at random points, the runs in random order;
+        // a start already taken is drawn again, so that the keys are distinct
+        w.name = "clustered";
+        const std::size_t run {64};
+        std::unordered_set<key> starts;
+        key r {0};
+        for(std::size_t i = 0; i < n; i += run) {
+            key base;
+            do
+                base = scatter(r++) & ~key{0xffff};
+            while(!starts.insert(base).second);
+            for(std::size_t j = 0; j < run && i + j < n; ++j)
+                w.keys[i + j] = base + j;
+        }
+        w.probes.resize(n);
+        for(auto& p : w.probes)
+            p = w.keys[gen() % n];
+    }
+    return w;
+}
+
+/** \brief check if the container has balance() */
+template <typename C, typename = void>
+struct has_balance : std::false_type {};
+
+template <typename C>
+struct has_balance<C, std::void_t<decltype(std::declval<C&>().balance())>> : std::true_type {};
+
+/** \brief sink for the results, so that the compiler keeps the work */
+volatile value sink;
+
+/** \brief a row of the CSV */
+void report(const char* container, const char* workload, std::size_t n, const char* op, std::size_t ops,
+            double seconds, std::vector<std::uint64_t>& latency) {
+    auto percentile = [&](double p) -> std::uint64_t {
+        if(latency.empty())
+            return 0;
+        const auto at = static_cast<std::size_t>(p * static_cast<double>(latency.size() - 1));
+        std::nth_element(latency.begin(), latency.begin() + static_cast<std::ptrdiff_t>(at), latency.end());
+        return latency[at];
+    };
+    const auto p50 = percentile(0.50);
+    const auto p99 = percentile(0.99);
+    std::printf("%s,%s,%zu,%s,%zu,%.3f,%llu,%llu\n", container, workload, n, op, ops,
+                static_cast<double>(ops) / seconds / 1e6, static_cast<unsigned long long>(p50),
+                static_cast<unsigned long long>(p99));
+    std::fflush(stdout);
+}
+
+/** \brief time \p f on every key of \p keys , once for the throughput and once per key for the latency
+ *
+ * \p setup builds the container used by each of the two runs. */
+template <typename C, typename S, typename F>
+void per_key(const char* name, const workload& w, const char* op, const std::vector<key>& keys, S setup, F f) {
+    std::chrono::duration<double> elapsed;
+    {
+        // freed before the second run, so that only one container is alive at a time
+        C a;
+        setup(a);
+        auto start = clock_type::now();
+        for(auto k : keys)
+            f(a, k);
+        elapsed = clock_type::now() - start;
+    }
+
+    C b;
+    setup(b);
+    std::vector<std::uint64_t> latency(keys.size());
+    for(std::size_t i = 0; i < keys.size(); ++i) {
+        auto t0 = clock_type::now();
+        f(b, keys[i]);
+        latency[i] = static_cast<std::uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(clock_type::now() - t0).count());
+    }
+    report(name, w.name, w.keys.size(), op, keys.size(), elapsed.count(), latency);
+}
+
+/** \brief time \p f on the whole container, a few times */
+template <typename C, typename F>
+void whole(const char* name, const workload& w, const char* op, C& c, F f) {
+    const int repeats {5};
+    std::vector<std::uint64_t> latency;
+    double total {0};
+    for(int r = 0; r < repeats; ++r) {
+        auto t0 = clock_type::now();
+        f(c);
+        std::chrono::duration<double> elapsed {clock_type::now() - t0};
+        total += elapsed.count();
+        latency.push_back(static_cast<std::uint64_t>(elapsed.count() * 1e9));
+    }
+    report(name, w.name, w.keys.size(), op, repeats * c.size(), total, latency);
+}
+
+template <typename C>
+void run(const char* name, const workload& w) {
+    auto empty = [](C&) {};
+    auto filled = [&w](C& c) {
+        for(auto k : w.keys)
+            c.insert({k, k});
+    };
+
+    per_key<C>(name, w, "insert", w.keys, empty, [](C& c, key k) { c.insert({k, k}); });
+    per_key<C>(name, w, "find", w.lookups(), filled, [](C& c, key k) {
+        auto it = c.find(k);
+        if(it != c.end())
+            sink = it->second;
+    });
+    per_key<C>(name, w, "operator[]", w.lookups(), filled, [](C& c, key k) { sink = ++c[k]; });
+
+    C c;
+    filled(c);
+    whole(name, w, "iteration", c, [](C& x) {
+        value sum {0};
+        for(const auto& e : x)
+            sum += e.second;
+        sink = sum;
+    });
+    whole(name, w, "copy", c, [](C& x) {
+        C copy {x};
+        sink = copy.size();
+    });
+    if constexpr (has_balance<C>::value)
+        whole(name, w, "balance", c, [](C& x) { x.balance(); });
+
+    per_key<C>(name, w, "erase", w.erased(), filled, [](C& c, key k) { sink = c.erase(k); });
+}
+
+int main(int argc, char** argv) {
+    const std::size_t max_size {argc > 1 ? std::strtoull(argv[1], nullptr, 10) : 100000};
+    const std::size_t min_size {argc > 2 ? std::strtoull(argv[2], nullptr, 10) : 1000};
+    // above this size the bst without balancing is skipped on sorted and reverse keys, where it is a list
+    const std::size_t list_limit {10000};
+
+    using plain_tree = bst<key, value>;
+    using avl_tree = bst<key, value, std::less<key>, no_instrumentation, avl_balancing>;
+
+    std::printf("# suite_bench: sizes %zu to %zu, fixed seeds\n", min_size, max_size);
+    std::printf("container,workload,size,operation,ops,mops_per_s,p50_ns,p99_ns\n");
+    for(std::size_t n = min_size; n && n <= max_size; n *= 10) {
+        for(const char* kind : workload_names) {
+            const auto w = make_workload(kind, n);
+            const bool list {w.name == std::string{"sorted"} || w.name == std::string{"reverse"}};
+            if(!list || n <= list_limit)
+                run<plain_tree>("bst", w);
+            else
+                std::printf("# bst skipped on %s keys of size %zu: O(n^2) without balancing\n", w.name, n);
+            run<avl_tree>("bst_avl", w);
+            run<std::map<key, value>>("std_map", w);
+            run<std::unordered_map<key, value>>("std_unordered_map", w);
+        }
+    }
+    return 0;
+}
@@ -7,11 +7,12 @@
 #include "include/node.hpp"
 #include "include/iterator.hpp"
 #include "include/bst.hpp"
+#include "include/instrumentation.hpp"
 
 int main() {
 
     try {
-        bst<int,int,std::less<int>> tree {};
+        bst<int,int,std::less<int>,stats_instrumentation> tree {};
 
         // creating pairs and inserting them in a tree
         auto a = std::make_pair(8,0);
@@ -37,13 +38,30 @@ int main() {
 
         // test find function for existing key value and not
         std::cout << "Testing find() function" << std::endl;    
-        tree.find(2);
-        tree.find(14);
+        for(auto key : {2, 14}) {
+            auto it = tree.find(key);
+            if(it != tree.end())
+                std::cout << "Found node with key = " << key << " . The value is: " << it->second << std::endl;
+            else
+                std::cout << "Node with key = " << key << " is not present" << std::endl;
+        }
 
         // test erase function for existing key value and not
         std::cout << "Testing erase() function" << std::endl;
-        tree.erase(8);
-        tree.erase(-2);
+        for(auto key : {8, -2}) {
+            std::cout << "Erased " << tree.erase(key) << " node with key = " << key << std::endl;
+        }
+
+        // test freeze function: the snapshot answers like the tree
+        std::cout << "Testing freeze() function" << std::endl;
+        auto frozen = tree.freeze();
+        for(auto key : {6, 8}) {
+            auto it = frozen.find(key);
+            if(it != frozen.end())
+                std::cout << "Found frozen node with key = " << key << " . The value is: " << it->second << std::endl;
+            else
+                std::cout << "Frozen node with key = " << key << " is not present" << std::endl;
+        }
 
         // test balance function
         std::cout << "Testing balance() function" << std::endl;
@@ -72,7 +90,7 @@ int main() {
 
         // test deep copy assignment
         std::cout << "Testing copy assignment" << std::endl;
-        bst<int,int,std::less<int>> tree3 {};
+        bst<int,int,std::less<int>,stats_instrumentation> tree3 {};
         tree3 = tree2;
         tree3.erase(10);
         std::cout << "Printing tree2" << std::endl;
@@ -91,12 +109,16 @@ int main() {
 
         // test move assignment
         std::cout << "Testing move assignment" << std::endl;
-        bst<int,int,std::less<int>> tree5 {};
+        bst<int,int,std::less<int>,stats_instrumentation> tree5 {};
         tree5 = std::move(tree4);
         std::cout << "Printing tree5, created moving tree4" << std::endl;
         tree5.print2D();
         
 
+        // statistics collected by the instrumentation policy
+        std::cout << "Statistics of the original tree" << std::endl;
+        std::cout << tree.get_instrumentation();
+
         // test clear function
         std::cout << "Testing clear() function" << std::endl;
         tree.clear();
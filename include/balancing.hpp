@@ -0,0 +1,501 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath> // std::log2
+#include <cstddef>
+#include <ratio>
+#include <type_traits>
+#include <utility> // std::declval
+#include "node.hpp"
+
+
+/** \brief replace a child
+ *
+ * Makes \p y take the place of \p x among the children of \p parent ,
+ * or the place of the root \p head if \p parent is nullptr. The parent of \p y is not changed.
+ */
+template <typename node_type>
+void replace_child(node_type*& head, node_type* parent, const node_type* x, node_type* y) noexcept {
+    if(!parent)
+        head = y;
+    else if(parent->get_left() == x)
+        parent->set_left(y);
+    else
+        parent->set_right(y);
+}
+
+/** \brief left rotation
+ *
+ * Rotates left the subtree rooted in \p x , whose right child takes its place.
+ * The augmentations of the two nodes are updated.
+ * \returns the new root of the subtree
+ */
+template <typename node_type>
+node_type* rotate_left(node_type*& head, node_type* x) noexcept {
+    auto parent {x->get_parent()};
+    auto y {x->get_right()};
+    auto inner {y->get_left()};
+
+    x->set_right(inner);
+    if(inner)
+        inner->set_parent(x);
+
+    replace_child(head, parent, x, y);
+    y->set_parent(parent);
+    y->set_left(x);
+    x->set_parent(y);
+
+    x->update();
+    y->update();
+    return y;
+}
+
+/** \brief right rotation
+ *
+ * Rotates right the subtree rooted in \p x , whose left child takes its place.
+ * The augmentations of the two nodes are updated.
+ * \returns the new root of the subtree
+ */
+template <typename node_type>
+node_type* rotate_right(node_type*& head, node_type* x) noexcept {
+    auto parent {x->get_parent()};
+    auto y {x->get_left()};
+    auto inner {y->get_right()};
+
+    x->set_left(inner);
+    if(inner)
+        inner->set_parent(x);
+
+    replace_child(head, parent, x, y);
+    y->set_parent(parent);
+    y->set_right(x);
+    x->set_parent(y);
+
+    x->update();
+    y->update();
+    return y;
+}
+
+
+/** \class no_balancing
+ *
+ * Default balancing policy of the bst: no rotation is performed,
+ * the tree is balanced only when bst::balance() is called.
+ */
+struct no_balancing {
+    /** using declaration for the node augmentation. Nothing is stored in the nodes. */
+    using augment = no_augment;
+
+    /** \brief node inserted
+     *
+     * Called after \p n has been linked to the tree as a leaf. */
+    template <typename node_type>
+    void inserted(node_type*&, node_type*) noexcept {}
+
+    /** \brief node erased
+     *
+     * Called after a node has been unlinked from the tree,
+     * \p from is the deepest node whose subtree changed (nullptr if none). */
+    template <typename node_type>
+    void erased(node_type*&, node_type*) noexcept {}
+
+    /** \brief node accessed
+     *
+     * Called after a lookup that can change the tree has found \p n . */
+    template <typename node_type>
+    void accessed(node_type*&, node_type*) noexcept {}
+};
+
+
+/** \class avl_augment
+ *
+ * Augmentation of the nodes of an AVL tree: the height of the subtree rooted in the node.
+ */
+struct avl_augment {
+    /** \brief height of the subtree, 1 for a leaf */
+    unsigned char height {1};
+
+    /** \brief update the height from the children \p l and \p r */
+    template <typename node_type>
+    void update(const node_type* l, const node_type* r) noexcept {
+        height = static_cast<unsigned char>(1 + std::max(height_of(l), height_of(r)));
+    }
+
+    /** \brief height of the subtree rooted in \p n , 0 for an empty one */
+    template <typename node_type>
+    static int height_of(const node_type* n) noexcept {
+        return n ? n->height : 0;
+    }
+};
+
+
+/** \class avl_balancing
+ *
+ * Self-balancing policy: after every insertion and erase the path up to the root is retraced
+ * and rotated, so that the heights of the two subtrees of every node differ at most by one.
+ * The height of the tree is therefore always O(log n), without calling bst::balance().
+ */
+struct avl_balancing {
+    /** using declaration for the node augmentation. Every node stores the height of its subtree. */
+    using augment = avl_augment;
+
+    /** \brief node inserted
+     *
+     * Retraces the tree from the parent of the new leaf \p n . */
+    template <typename node_type>
+    void inserted(node_type*& head, node_type* n) noexcept {
+        retrace(head, n->get_parent());
+    }
+
+    /** \brief node erased
+     *
+     * Retraces the tree from \p from , the deepest node whose subtree changed. */
+    template <typename node_type>
+    void erased(node_type*& head, node_type* from) noexcept {
+        retrace(head, from);
+    }
+
+    /** \brief node accessed
+     *
+     * Nothing to do: lookups do not change the heights. */
+    template <typename node_type>
+    void accessed(node_type*&, node_type*) noexcept {}
+
+    /** \brief join two trees
+     *
+     * Links the detached trees \p l and \p r and the detached node \p k , whose key is greater than
+     * the keys of \p l and less than those of \p r , into one AVL tree. The shorter tree goes with
+     * \p k under the node of the spine of the taller one that has about its height, then the path
+     * is retraced, so it takes O(1 + difference of the heights).
+     * \returns the root of the joined tree */
+    template <typename node_type>
+    static node_type* join(node_type* l, node_type* k, node_type* r) noexcept {
+        const int hl {avl_augment::height_of(l)}, hr {avl_augment::height_of(r)};
+        node_type* head {nullptr};
+        node_type* parent {nullptr};
+        if(hl > hr + 1) {
+            // down the right spine of l
+            head = l;
+            for(; avl_augment::height_of(l) > hr + 1; l = l->get_right())
+                parent = l;
+        }
+        else if(hr > hl + 1) {
+            // down the left spine of r
+            head = r;
+            for(; avl_augment::height_of(r) > hl + 1; r = r->get_left())
+                parent = r;
+        }
+        k->set_left(l);
+        k->set_right(r);
+        if(l)
+            l->set_parent(k);
+        if(r)
+            r->set_parent(k);
+        k->set_parent(parent);
+        k->update();
+        if(!parent)
+            return k;
+        if(hl > hr)
+            parent->set_right(k);
+        else
+            parent->set_left(k);
+        retrace(head, parent);
+        return head;
+    }
+
+    private:
+
+    /** \brief balance factor, height of the left subtree minus height of the right one */
+    template <typename node_type>
+    static int balance_factor(const node_type* n) noexcept {
+        return avl_augment::height_of(n->get_left()) - avl_augment::height_of(n->get_right());
+    }
+
+    /** \brief restore the AVL property
+     *
+     * Walks from \p n up to the root updating the heights and rotating the unbalanced nodes.
+     * Stops as soon as the height of a subtree is unchanged, since nothing above it can change. */
+    template <typename node_type>
+    static void retrace(node_type*& head, node_type* n) noexcept {
+        while(n) {
+            const int old_height {n->height};
+            n->update();
+            const int factor {balance_factor(n)};
+            if(factor > 1) {
+                if(balance_factor(n->get_left()) < 0)
+                    rotate_left(head, n->get_left());
+                n = rotate_right(head, n);
+            }
+            else if(factor < -1) {
+                if(balance_factor(n->get_right()) > 0)
+                    rotate_right(head, n->get_right());
+                n = rotate_left(head, n);
+            }
+            if(n->height == old_height)
+                break;
+            n = n->get_parent();
+        }
+    }
+};
+
+
+/** \class splay_balancing
+ *
+ * Self-adjusting policy: the node inserted, the node found by a lookup and, after an erase, the
+ * deepest node whose subtree changed are splayed, i.e. rotated up to the root in pairs (zig-zig
+ * and zig-zag steps), which also roughly halves the depth of the nodes on their path. Every
+ * operation takes O(log n) amortized time and the recently used keys stay near the root, so a
+ * skewed workload is served in nearly constant time. Nodes store nothing. Only the lookups of a non-const tree (find(),
+ * operator[], try_emplace(), insert() of a present key) splay: const lookups never change it.
+ * To restructure less often, a node is splayed only on every \p period -th notification,
+ * and only if it is deeper than \p min_depth .
+ */
+template <std::size_t period = 1, std::size_t min_depth = 0>
+struct splay_balancing {
+    static_assert(period > 0, "a node is splayed every period notifications, at least 1");
+
+    /** using declaration for the node augmentation. Nothing is stored in the nodes. */
+    using augment = no_augment;
+
+    /** \brief node inserted, the new leaf \p n is splayed */
+    template <typename node_type>
+    void inserted(node_type*& head, node_type* n) noexcept {
+        if(wanted(n))
+            splay(head, n);
+    }
+
+    /** \brief node erased
+     *
+     * \p from , the deepest node whose subtree changed, is splayed: the parent of the node unlinked
+     * if it had at most one child, otherwise the old parent of its successor, which took its place
+     * (the successor itself if it was the right child). */
+    template <typename node_type>
+    void erased(node_type*& head, node_type* from) noexcept {
+        if(from && wanted(from))
+            splay(head, from);
+    }
+
+    /** \brief node accessed, \p n is splayed */
+    template <typename node_type>
+    void accessed(node_type*& head, node_type* n) noexcept {
+        if(wanted(n))
+            splay(head, n);
+    }
+
+    /** \brief splay
+     *
+     * Rotates \p x up to the root of the tree \p head . When \p x and its parent are children on
+     * the same side the grandparent is rotated first (zig-zig), otherwise \p x is rotated twice
+     * (zig-zag), then once more if only the root is left (zig). */
+    template <typename node_type>
+    static void splay(node_type*& head, node_type* x) noexcept {
+        while(auto parent = x->get_parent()) {
+            auto grand = parent->get_parent();
+            if(grand && (grand->get_left() == parent) == (parent->get_left() == x))
+                rotate_up(head, parent);
+            else if(grand)
+                rotate_up(head, x);
+            rotate_up(head, x);
+        }
+    }
+
+    private:
+
+    /** \brief notifications since the last splay, as \private skipped */
+    std::size_t skipped {0};
+
+    /** \brief check if the notification of \p n has to splay it
+     *
+     * Counts the notifications, then checks the depth walking at most min_depth + 1 parents. */
+    template <typename node_type>
+    bool wanted(const node_type* n) noexcept {
+        if constexpr (period > 1) {
+            if(++skipped < period)
+                return false;
+            skipped = 0;
+        }
+        std::size_t depth {0};
+        for(; depth <= min_depth && n->get_parent(); n = n->get_parent())
+            ++depth;
+        return depth > min_depth;
+    }
+
+    /** \brief rotate \p x above its parent */
+    template <typename node_type>
+    static void rotate_up(node_type*& head, node_type* x) noexcept {
+        auto parent {x->get_parent()};
+        if(parent->get_left() == x)
+            rotate_right(head, parent);
+        else
+            rotate_left(head, parent);
+    }
+};
+
+
+/** \class scapegoat_balancing
+ *
+ * Rebalancing policy after scapegoat trees, with no data in the nodes and no rotation at every update.
+ * When an insertion lands deeper than \p alpha · log2(n), n the size of the tree, the bst rebuilds
+ * perfectly balanced the smallest subtree around the new node that is deeper than \p alpha · log2
+ * of its own size; when erases have halved the tree since it was largest, it rebuilds the whole tree.
+ * Operations on many elements at once (e.g. clear(), merge(), load()) reset the largest size,
+ * and split() and join() rebuild their results, whose shape comes from trees of other sizes.
+ * The height stays below \p alpha · log2(n) + O(1) and updates take O(log n) amortized time.
+ * The rebuilding is done by the bst, which knows the sizes: the policy only decides when.
+ * \p alpha is a std::ratio greater than 1, the smaller the more often subtrees are rebuilt.
+ */
+template <typename alpha = std::ratio<3, 2>>
+struct scapegoat_balancing {
+    static_assert(alpha::num > alpha::den, "alpha must be greater than 1: no tree is less than log2(n) deep");
+
+    /** using declaration for the node augmentation. Nothing is stored in the nodes. */
+    using augment = no_augment;
+
+    /** \brief node inserted, nothing to do: the bst checks the depth */
+    template <typename node_type>
+    void inserted(node_type*&, node_type*) noexcept {}
+
+    /** \brief node erased, nothing to do: the bst checks the size */
+    template <typename node_type>
+    void erased(node_type*&, node_type*) noexcept {}
+
+    /** \brief node accessed, nothing to do */
+    template <typename node_type>
+    void accessed(node_type*&, node_type*) noexcept {}
+
+    /** \brief check if a node \p depth levels below the root of a subtree of \p size nodes is too deep */
+    static bool too_deep(std::size_t depth, std::size_t size) noexcept {
+        return static_cast<double>(depth) * alpha::den > alpha::num * std::log2(static_cast<double>(size));
+    }
+
+    /** \brief record the size of the tree, \p size , after an insertion */
+    void grown(std::size_t size) noexcept {
+        largest = std::max(largest, size);
+    }
+
+    /** \brief check if the tree, of \p size nodes after an erase, has to be rebuilt whole
+     *
+     * True when it has lost half of the largest size it reached, which is then reset to \p size . */
+    bool shrunk(std::size_t size) noexcept {
+        if(2 * size >= largest)
+            return false;
+        largest = size;
+        return true;
+    }
+
+    /** \brief record the size of the tree, \p size , after a change of many elements at once
+     *
+     * Called when the tree is cleared, assigned, loaded, split, joined, merged or moved: the
+     * largest size reached before is no longer a measure of the current tree. */
+    void reset(std::size_t size) noexcept {
+        largest = size;
+    }
+
+    private:
+
+    /** \brief largest size since the last rebuild of the whole tree or reset(), as \private largest */
+    std::size_t largest {0};
+};
+
+
+/** \brief check if a balancing policy bounds the depth by having the bst rebuild subtrees, see scapegoat_balancing */
+template <typename balancing, typename = void>
+struct has_depth_bound : std::false_type {};
+
+template <typename balancing>
+struct has_depth_bound<balancing, std::void_t<decltype(balancing::too_deep(std::size_t{}, std::size_t{}))>> : std::true_type {};
+
+
+/** \class order_statistics_augment
+ *
+ * Augmentation that adds the size of the subtree rooted in the node to the augmentation \p inner .
+ */
+template <typename inner>
+struct order_statistics_augment : inner {
+    /** \brief number of nodes of the subtree, 1 for a leaf */
+    std::size_t subtree_size {1};
+
+    /** \brief update the size and the inner augmentation from the children \p l and \p r */
+    template <typename node_type>
+    void update(const node_type* l, const node_type* r) noexcept {
+        inner::update(l, r);
+        subtree_size = 1 + size_of(l) + size_of(r);
+    }
+
+    /** \brief size of the subtree rooted in \p n , 0 for an empty one */
+    template <typename node_type>
+    static std::size_t size_of(const node_type* n) noexcept {
+        return n ? n->subtree_size : 0;
+    }
+};
+
+
+/** \brief check if an augmentation stores the size of the subtree */
+template <typename augment, typename = void>
+struct has_subtree_size : std::false_type {};
+
+template <typename augment>
+struct has_subtree_size<augment, std::void_t<decltype(std::declval<augment&>().subtree_size)>> : std::true_type {};
+
+
+/** \class order_statistics
+ *
+ * Policy adaptor that adds order statistics to the balancing policy \p balancing :
+ * every node stores the size of its subtree, which allows bst::select(), bst::rank() and
+ * bst::count_range() in O(h). The sizes along the changed path are fixed before the
+ * inner policy is notified, then rotations keep them correct.
+ */
+template <typename balancing = no_balancing>
+struct order_statistics : balancing {
+    /** using declaration for the node augmentation. The inner one plus the size of the subtree. */
+    using augment = order_statistics_augment<typename balancing::augment>;
+
+    /** \brief node inserted
+     *
+     * Increments the sizes of the ancestors of the new leaf \p n , then notifies the inner policy. */
+    template <typename node_type>
+    void inserted(node_type*& head, node_type* n) noexcept {
+        resize(n->get_parent());
+        balancing::inserted(head, n);
+    }
+
+    /** \brief node erased
+     *
+     * Recomputes the sizes from \p from up to the root, then notifies the inner policy. */
+    template <typename node_type>
+    void erased(node_type*& head, node_type* from) noexcept {
+        resize(from);
+        balancing::erased(head, from);
+    }
+
+    /** \brief join two trees
+     *
+     * Available if the inner policy can join: joins \p l , \p k and \p r with it,
+     * then fixes the sizes from \p k up to the root, that the retracing may have skipped. */
+    template <typename node_type, typename inner = balancing>
+    static auto join(node_type* l, node_type* k, node_type* r) noexcept -> decltype(inner::join(l, k, r)) {
+        auto head = inner::join(l, k, r);
+        resize(k);
+        return head;
+    }
+
+    protected:
+
+    /** \brief recompute the sizes
+     *
+     * Walks from \p n up to the root recomputing only the sizes of the subtrees,
+     * so that the inner augmentation is left to the inner policy. */
+    template <typename node_type>
+    static void resize(node_type* n) noexcept {
+        for(; n; n = n->get_parent())
+            n->subtree_size = 1 + augment::size_of(n->get_left()) + augment::size_of(n->get_right());
+    }
+};
+
+
+/** \brief check if a balancing policy can join two trees with a middle node, see avl_balancing::join */
+template <typename balancing, typename node_type, typename = void>
+struct has_join : std::false_type {};
+
+template <typename balancing, typename node_type>
+struct has_join<balancing, node_type, std::void_t<decltype(balancing::join(std::declval<node_type*>(), std::declval<node_type*>(), std::declval<node_type*>()))>> : std::true_type {};
@@ -1,14 +1,28 @@
 #pragma once
 
 #include <iostream>
+#include <limits>
+#include <cstdint>
 #include <algorithm>
+#include <iterator>
 #include <vector>
 #include <memory>
 #include <utility>
+#include <tuple>
+#include <type_traits>
 #include <exception>
-#include <chrono>
+#include <stdexcept>
 #include "node.hpp"
 #include "iterator.hpp"
+#include "instrumentation.hpp"
+#include "balancing.hpp"
+#include "node_pool.hpp"
+#include "storage.hpp"
+#include "sorted_unique.hpp"
+#include "parallel.hpp"
+#include "frozen_bst.hpp"
+#include "snapshot.hpp"
+#include "node_handle.hpp"
 
 #define COUNT 10  
 
@@ -16,84 +30,535 @@
  *  
  * Custom Binary Search Tree Template class.
  * Every instance of the bst class is a hierarchical (ordered) data structure.
+ * The instrumentation policy is notified of insert, find, erase and balance: 
+ * the default one, no_instrumentation, does nothing and costs nothing, 
+ * while stats_instrumentation collects counters and latency histograms.
+ * The balancing policy is notified of every insertion and erase, and of the lookups of a non-const tree, 
+ * and can rotate the tree: with the default one, no_balancing, the tree is balanced only by balance(), 
+ * avl_balancing keeps the height O(log n) at all times, scapegoat_balancing has the subtrees that grow too deep 
+ * rebuilt and splay_balancing moves the nodes used to the root.
+ * Nodes are created and destroyed through the allocator, rebound to the node type: 
+ * node_pool allocates them from a slab arena that clear() releases in chunks.
+ * The storage policy decides where the nodes live: linked_storage, the default, allocates them 
+ * one by one, while flat_storage keeps them in a contiguous array linked by 32-bit offsets.
  */
-template<typename key_type, typename value_type, typename comparison=std::less<key_type>>
+template<typename key_type, typename value_type, typename comparison=std::less<key_type>, 
+         typename instrumentation=no_instrumentation, typename balancing=no_balancing,
+         typename allocator=std::allocator<std::pair<const key_type, value_type>>,
+         typename storage=linked_storage>
 class bst {
 
     /** using declaration for pair_type. Represents a pair type of key and associated value. */
     using pair_type = std::pair<const key_type, value_type>;
+    /** using declaration for storage_type. Represents the storage of the nodes chosen by the storage policy. */
+    using storage_type = typename storage::template backend<pair_type, typename balancing::augment, allocator>;
     /** using declaration for pair_type. Represents a node type of a pair of key and associated value. */
-    using node_type = node<pair_type>;
+    using node_type = typename storage_type::node_type;
     /** using declaration for pair_type. Represents a constant iterator class, defined by a pair type and node type. */
     using const_iterator = Iterator<const pair_type, node_type>;
     /** using declaration for pair_type. Represents an iterator class, defined by a pair type and node type. */
     using iterator = Iterator<pair_type, node_type>;
+    /** using declaration for handle_type. Represents the owner of a node out of the tree, public as node_handle. */
+    using handle_type = ::node_handle<node_type, typename storage_type::node_allocator>;
 
     /** \brief head
      * 
-     * Root of the tree as \private head */
-    std::unique_ptr<node_type> head;
+     * Root of the tree as \private head. All the nodes are owned by the tree. */
+    node_type* head {nullptr};
 
     /** \brief size
      * 
-     * Size of the tree as \private _size .*/
-    std::size_t _size;
+     * Number of elements of the tree as \private _size .*/
+    std::size_t _size {0};
 
     /**  \brief compare two nodes
      * 
      * Compare two nodes, as \private comp.*/
     comparison comp;
 
+    /** \brief instrumentation policy
+     * 
+     * Policy notified of the operations on the tree, as \private instr. 
+     * Mutable because also const lookups are observed.*/
+    mutable instrumentation instr;
+
+    /** \brief balancing policy
+     * 
+     * Policy that restores the balance after insertions and erases, as \private balancer.*/
+    balancing balancer;
+
+    /** \brief node storage
+     * 
+     * Storage that creates and destroys the nodes through the allocator, as \private nodes.*/
+    storage_type nodes;
+
+    /** \brief make room for new nodes
+     * 
+     * Makes sure that \p n nodes can be created without moving the existing ones. 
+     * With flat_storage the nodes may be moved now, so no pointer to a node must be held but head. */
+    void _reserve(std::size_t n) {
+        nodes.reserve(n, head);
+    }
+
+    /** \brief create a node
+     * 
+     * Creates a node in the storage and constructs it with \p args , after _reserve(). */
+    template<typename... Types>
+    node_type* _create_node(Types&&... args);
+
+    /** \brief destroy a node
+     * 
+     * Destroys \p x and gives its memory back to the storage. */
+    void _destroy_node(node_type* x) noexcept;
+
+    /** \brief destroy all the nodes
+     * 
+     * Destroys every node of the tree iteratively, without recursion. 
+     * When the storage can release all its memory at once, e.g. the arena of a node_pool, it does. */
+    void _destroy_all() noexcept;
+
+    /** \brief destroy a subtree
+     * 
+     * Destroys every node of the subtree rooted in \p x iteratively, without recursion. 
+     * \p x must already be detached from the tree, or be the root of the whole tree. */
+    void _destroy_subtree(node_type* x) noexcept;
+
+    /** \brief build a balanced subtree
+     * 
+     * Creates a perfectly balanced subtree with the next \p n elements of the sorted range 
+     * starting at \p first , which is advanced past them. The nodes are created in order, 
+     * one per element, and the left half goes to the left subtree. Recursive, the depth is O(log n).
+     * \returns the root of the subtree */
+    template<typename It>
+    node_type* _build(It& first, std::size_t n);
+
+    /** \brief build a balanced tree in parallel
+     * 
+     * Same result as _build, for the next \p n elements starting at \p first . The nodes are 
+     * created in order on the calling thread, since the storage is not thread-safe, then linked 
+     * on the threads of \p p with _link.
+     * \returns the root of the tree */
+    template<typename It>
+    node_type* _build(It& first, std::size_t n, parallel_t p);
+
+    /** \brief link sorted nodes into a balanced subtree
+     * 
+     * Links the \p n nodes in \p x , in order, into a perfectly balanced subtree whose root is 
+     * the median and whose parent is \p parent , and updates their augmentations. The halves 
+     * around the median are independent and linked on \p threads threads, down to \p grain nodes.
+     * \returns the root of the subtree */
+    static node_type* _link(node_type** x, std::size_t n, node_type* parent, unsigned threads, std::size_t grain) noexcept;
+
+    /** \brief build the tree from a range
+     * 
+     * Replaces the content of the empty tree with the elements in [ \p first , \p last ). 
+     * If \p sorted is false, the elements are sorted once up front, keeping the first of equal keys.
+     * The sort and the linking run on the threads of \p p .*/
+    template<typename It>
+    void _assign(It first, It last, bool sorted, parallel_t p = parallel_t{1});
+
+    /** \brief copy a tree
+     * 
+     * Creates a copy of the tree rooted in \p x and stores its root in head. 
+     * The source is visited in pre-order through the parent pointers, without recursion 
+     * nor auxiliary memory, with exactly one allocation per node. Every copy is linked 
+     * before its children are copied, so that it is always reachable from head. 
+     * If \p N is not const, the values are moved out of the nodes of the source and the keys copied.*/
+    template<typename N>
+    void _copy(N* x);
+
+    /** using declaration for probe. Represents the probe of the instrumentation policy. */
+    using probe_type = typename instrumentation::probe;
+
     /** \brief internal insert
      * 
-     * Private function to insert node. \p x passed as r-value, of typename O. */
+     * Private function to insert node. \p x passed as r-value, of typename O. 
+     * The tree is walked once and a node is allocated only if the key is not present. */
     template<typename O>
     std::pair<iterator, bool> _insert(O&& x);
 
+    /** \brief internal try_emplace
+     * 
+     * Private function for try_emplace(): if the key \p k is not present, a node is created 
+     * with the pair constructed in place from \p k and \p args . */
+    template<typename K, typename... Types>
+    std::pair<iterator, bool> _try_emplace(K&& k, Types&&... args);
+
+    /** \brief locate a key
+     * 
+     * Walks the tree once looking for \p k . If found, returns its node; otherwise returns nullptr 
+     * and stores in \p parent and \p left where a node with key \p k has to be linked. 
+     * Every visited node is reported to \p probe .*/
+    template<typename K>
+    node_type* _locate(const K& k, node_type*& parent, bool& left, probe_type& probe) const noexcept;
+
+    /** \brief create a node for a new element
+     * 
+     * Creates the node with the pair constructed from \p args , to be linked at the position \p parent , 
+     * \p left found by _locate(). If the storage has to grow first, its nodes move and \p args may refer 
+     * to one of them: the pair is then constructed before growing, and the position located again. */
+    template<typename... Types>
+    node_type* _create_at(node_type*& parent, bool& left, probe_type& probe, Types&&... args);
+
+    /** \brief link a new node
+     * 
+     * Links \p x as left (if \p left ) or right child of \p parent , or as root if \p parent is nullptr, 
+     * and notifies the balancing policy. */
+    void _link(node_type* x, node_type* parent, bool left) noexcept;
+
     /** \brief internal find
      * 
      * Private function for finding a node based on key. \p x passed as r-value, of typename T. */
     template<typename T>
     node_type* _find(T&& x) const noexcept;
 
+    /** \brief notify the balancing policy that a lookup of a non-const tree found \p x , if not nullptr
+     * 
+     * The policy may restructure the tree, e.g. splay_balancing moves \p x to the root. \returns \p x */
+    node_type* _accessed(node_type* x) noexcept {
+        if(x)
+            balancer.accessed(head, x);
+        return x;
+    }
+
+    /** \brief present only if comparison is transparent
+     * 
+     * Enables the overloads that take keys of any type comparable with key_type, as std::map does. */
+    template<typename C>
+    using _transparent = typename C::is_transparent;
+
+    /** \brief internal erase by key, \p x of any type comparable with key_type */
+    template<typename T>
+    std::size_t _erase(const T& x);
+
+    /** \brief lookups interleaved by find_batch() and contains_batch() */
+    static constexpr std::size_t _batch_width {16};
+
+    /** \brief internal batched find
+     * 
+     * Looks up the keys in [ \p first , \p last ) up to _batch_width at a time and passes to \p found , 
+     * in the order of the keys, the node with each key or nullptr. */
+    template<typename It, typename F>
+    void _find_batch(It first, It last, F&& found) const;
+
+    /** \brief internal lower_bound
+     * 
+     * Private function returning the first node whose key is not less than \p x , nullptr if none. */
+    template<typename T>
+    node_type* _lower_bound(const T& x) const noexcept;
+
+    /** \brief internal upper_bound
+     * 
+     * Private function returning the first node whose key is greater than \p x , nullptr if none. */
+    template<typename T>
+    node_type* _upper_bound(const T& x) const noexcept;
+
+    /** \brief internal select
+     * 
+     * Private function returning the node with \p k smaller elements, nullptr if \p k >= size(). */
+    node_type* _select(std::size_t k) const noexcept;
+
     /** \brief internal print2D
      * 
-     * Private function for printing tree in 2D */
-    void _print2D(node_type *root, int space) const noexcept;
+     * Private function for printing tree in 2D to \p os . The tree is visited in reverse order 
+     * through the parent pointers, without recursion, keeping track of the depth. */
+    void _print2D(node_type *root, std::ostream& os) const noexcept;
+
+
+    /** \brief unlink a node
+     * 
+     * Removes \p x from the tree and deletes it, relinking its children in place. 
+     * If \p x has two children, its successor takes its place.
+     * \returns the deepest node whose subtree changed, where rebalancing has to start from */
+    node_type* unlink(node_type* x) noexcept;
+
+    /** \brief detach a node
+     * 
+     * As unlink(), but \p x is not deleted: it is left out of the tree with its old links. */
+    node_type* _detach(node_type* x) noexcept;
+
+    /** \brief hand a detached node over to a node_handle, as a node just created */
+    handle_type _handle(node_type* x) noexcept;
+
+    /** \brief internal extract by key, \p x of any type comparable with key_type */
+    template<typename T>
+    handle_type _extract(const T& x);
+
+    /** \brief rebuild a subtree
+     * 
+     * Auxiliary function for balance, in the style of Day-Stout-Warren. The subtree rooted in \p x 
+     * is first flattened with right rotations into a vine (a list linked through the right children), 
+     * then folded back with left rotations into a complete tree, that takes the place of \p x . 
+     * The existing nodes are relinked in place: no pair is copied and nothing is allocated.
+     * \returns the number of nodes of the subtree */
+    std::size_t _rebuild(node_type* x) noexcept;
+
+    /** \brief fold a vine
+     * 
+     * Auxiliary function for _rebuild, performs \p count left rotations along the vine starting at \p root .*/
+    static void _compress(node_type*& root, std::size_t count) noexcept;
+
+    /** \brief check if the balancing policy can join trees, so that split and set operations are O(log n) per step */
+    static constexpr bool _joinable {has_join<balancing, node_type>::value};
+
+    /** \brief check if the balancing policy bounds the depth by rebuilding subtrees, as scapegoat_balancing does */
+    static constexpr bool _depth_bounded {has_depth_bound<balancing>::value};
+
+    /** \brief rebuild after an insertion
+     * 
+     * If the new leaf \p x is too deep for the balancing policy, rebuilds the smallest subtree 
+     * containing it that is too deep for its size. The sizes of the subtrees are counted walking up 
+     * from \p x , so the cost is that of the rebuild, O(1) amortized per insertion. */
+    void _rebalance_inserted(node_type* x) noexcept;
+
+    /** \brief rebuild the whole tree after an erase, if the balancing policy asks for it */
+    void _rebalance_erased() noexcept {
+        if constexpr (_depth_bounded) {
+            if(balancer.shrunk(_size))
+                _rebuild(head);
+        }
+    }
+
+    /** \brief tell the balancing policy the size of the tree, after a change of many elements at once */
+    void _resized() noexcept {
+        if constexpr (_depth_bounded)
+            balancer.reset(_size);
+    }
+
+    /** \brief fix both parts after split(), this tree and \p right
+     * 
+     * A part keeps the shape of the tree it comes from, too deep for its size if the balancing 
+     * policy bounds the depth: then both parts are rebuilt. */
+    void _resplit(bst& right) noexcept {
+        if constexpr (_depth_bounded) {
+            _rebuild(head);
+            right._rebuild(right.head);
+        }
+        _resized();
+        right._resized();
+    }
+
+    /** \brief key of the node \p x */
+    static const key_type& _key(const node_type* x) noexcept {
+        return x->get_data().first;
+    }
+
+    /** \brief detach a node
+     * 
+     * Detaches the root \p x of a detached subtree from its children, stored in \p l and \p r .*/
+    static void _expose(node_type* x, node_type*& l, node_type*& r) noexcept;
+
+    /** \brief fix the augmentations from \p x up to the root of its tree */
+    static void _refresh(node_type* x) noexcept {
+        for(; x; x = x->get_parent())
+            x->update();
+    }
+
+    /** \brief number of nodes of the detached subtree \p x
+     * 
+     * Knowing that \p x and \p y hold \p total nodes: read from the root with order statistics, 
+     * otherwise counted walking both in step, which costs the smaller of the two.*/
+    static std::size_t _size_of(node_type* x, node_type* y, std::size_t total) noexcept;
+
+    /** \brief join with a middle node
+     * 
+     * Joins the detached subtrees \p l and \p r and the detached node \p k between them 
+     * with the balancing policy, or just hangs them from \p k if it cannot join. \returns the root */
+    node_type* _join(node_type* l, node_type* k, node_type* r) noexcept;
+
+    /** \brief join two detached subtrees, the keys of \p l less than those of \p r . \returns the root */
+    node_type* _join(node_type* l, node_type* r) noexcept;
+
+    /** \brief remove the last node
+     * 
+     * Removes the rightmost node of the detached subtree \p x , stored in \p last . \returns the root of the rest */
+    node_type* _split_last(node_type* x, node_type*& last) noexcept;
+
+    /** \brief split a subtree
+     * 
+     * Splits the detached subtree \p x into \p l , with the keys less than \p k , and \p r , with 
+     * the greater ones. \returns the detached node with key \p k , nullptr if not present */
+    node_type* _split(node_type* x, const key_type& k, node_type*& l, node_type*& r) noexcept;
+
+    /** \brief union of two subtrees
+     * 
+     * Joins the nodes of the detached subtrees \p x and \p y , recursing on the halves that 
+     * every root of \p y splits \p x into. When a key is in both the node of \p x is kept and 
+     * the one of \p y is appended to \p dups , in order. \returns the root */
+    node_type* _union(node_type* x, node_type* y, std::vector<node_type*>& dups) noexcept;
+
+    /** \brief intersection of two subtrees
+     * 
+     * Keeps the nodes of the detached subtree \p x whose key is in the subtree \p y , of another tree, 
+     * counted in \p kept , and destroys the others. \returns the root */
+    node_type* _intersect(node_type* x, const node_type* y, std::size_t& kept) noexcept;
+
+    /** \brief difference of two subtrees
+     * 
+     * Destroys the nodes of the detached subtree \p x whose key is in the subtree \p y , of another tree, 
+     * counted in \p removed . \returns the root */
+    node_type* _subtract(node_type* x, const node_type* y, std::size_t& removed) noexcept;
+
+    /** \brief nodes of the subtree \p x in order, appended to \p out */
+    static void _collect(node_type* x, std::vector<node_type*>& out);
+
+    /** \brief check if \p m searches in a tree of \p n elements cost less than a pass over it, m log2(n) < n */
+    static bool _few(std::size_t m, std::size_t n) noexcept {
+        std::size_t depth {1};
+        while(n >> depth)
+            ++depth;
+        return m * depth < n;
+    }
 
+    /** \brief membership in \p other for increasing keys
+     * 
+     * Returns a function telling if a key is in \p other , to be called with increasing keys: it searches 
+     * \p other if this tree is much smaller, otherwise it walks \p other in step, O(1) amortized. */
+    auto _member_of(const bst& other) const {
+        return [this, &other, few = _few(_size, other._size), j = other.begin()](const key_type& k) mutable {
+            if(few)
+                return other.contains(k);
+            while(j != other.end() && comp(j->first, k))
+                ++j;
+            return j != other.end() && !comp(k, j->first);
+        };
+    }
 
-    /** \brief repopulate the tree
+    /** \brief union by insertions
      * 
-     * Function to properly repopulate tree. \p child passed, pointer to a node type. 
-     * Used after erasing a node in the tree.*/
-    void repopulate(node_type* child);
+     * merge() for the policies that cannot join, when \p other is much smaller: every element of 
+     * \p other is searched here, and its node relinked (or copied) where the search ends. */
+    void _merge_each(bst& other);
+
+    /** \brief reset the links and the augmentation of the node \p x , that leaves its tree */
+    static void _reset(node_type* x) noexcept {
+        x->set_parent(nullptr);
+        x->set_left(nullptr);
+        x->set_right(nullptr);
+        static_cast<typename balancing::augment&>(*x) = typename balancing::augment{};
+    }
 
-    /** \brief recursive insert for balance
+    /** \brief fix a rebuilt subtree
      * 
-     * Auxiliary function for balance tree, recursive. The vector that holds the tree nodes, gets to be divided by the median. 
-     * Each splitted vector gets its' median inserted into the new, balanced tree. 
-     * Process repeated for each section divided by the median.
-     * Process stops when median doesn't hold anymore a positive value.*/
-    void insert_balanced_node(std::vector<pair_type> vec);
+     * Auxiliary function for _rebuild, sets the parent pointers and updates the augmentations 
+     * of the balanced subtree rooted in \p x . Recursive, the depth is O(log n).*/
+    static void _relink(node_type* x, node_type* parent) noexcept;
 
 
     public:
 
+    /** using declaration for node_handle. Represents a node extracted from the tree, see extract(). */
+    using node_handle = handle_type;
+    /** using declaration for insert_return_type. Represents the result of insert(node_handle&&). */
+    using insert_return_type = node_insert_return<iterator, node_handle>;
+
     /** \brief Default bst Constructor */
     bst() = default;
-    /** \brief Default bst Destructor */
-    ~bst() noexcept = default;
+
+    /** \brief Custom bst Constructor
+     * 
+     * Creates an empty tree that allocates its nodes through \p a . */
+    explicit bst(const allocator& a):
+    nodes{a} {}
+
+    /** \brief Range bst Constructor
+     * 
+     * Creates a perfectly balanced tree with the elements in [ \p first , \p last ), 
+     * that are sorted once up front. If a key is repeated, only its first element is kept. */
+    template<typename It, typename = typename std::iterator_traits<It>::iterator_category>
+    bst(It first, It last) {
+        _assign(first, last, false);
+    }
+
+    /** \brief Sorted range bst Constructor
+     * 
+     * Creates a perfectly balanced tree with the elements in [ \p first , \p last ), 
+     * that must be sorted by key without duplicates. It takes a single linear pass 
+     * and exactly one node allocation per element. */
+    template<typename It, typename = typename std::iterator_traits<It>::iterator_category>
+    bst(sorted_unique_t, It first, It last) {
+        _assign(first, last, true);
+    }
+
+    /** \brief Parallel range bst Constructor
+     * 
+     * Same as the range constructor, with the sort and the linking of the nodes split 
+     * among the threads of \p p , e.g. parallel . */
+    template<typename It, typename = typename std::iterator_traits<It>::iterator_category>
+    bst(parallel_t p, It first, It last) {
+        _assign(first, last, false, p);
+    }
+
+    /** \brief Parallel sorted range bst Constructor
+     * 
+     * Same as the sorted range constructor, with the linking of the nodes split 
+     * among the threads of \p p , e.g. parallel . */
+    template<typename It, typename = typename std::iterator_traits<It>::iterator_category>
+    bst(parallel_t p, sorted_unique_t, It first, It last) {
+        _assign(first, last, true, p);
+    }
+
+    /** \brief bst Destructor */
+    ~bst() noexcept {
+        _destroy_all();
+    }
 
     /** \brief  Move constructor */
-    explicit bst(bst&& other) noexcept = default;
-    /** \brief  Move assignment */
-	bst& operator=(bst&& other) noexcept = default;
+    explicit bst(bst&& other) noexcept:
+    head{other.head}, _size{other._size}, comp{std::move(other.comp)}, instr{std::move(other.instr)}, 
+    balancer{std::move(other.balancer)}, nodes{std::move(other.nodes)} {
+        other.head = nullptr;
+        other._size = 0;
+        other._resized();
+    }
+
+    /** \brief  Move assignment
+     * 
+     * The nodes are stolen if the allocator propagates or is equal to the one of \p other , 
+     * otherwise the tree is copied in one linear pass, with the same shape, moving the values. */
+	bst& operator=(bst&& other) {
+        if(this == &other)
+            return *this;
+        _destroy_all();
+        _size = 0;
+        comp = std::move(other.comp);
+        instr = std::move(other.instr);
+        balancer = std::move(other.balancer);
+        if(!nodes.adopt(other.nodes)) {
+            _size = other._size;
+            try {
+                _copy(other.head);
+            }
+            catch(...) {
+                _destroy_all();
+                _size = 0;
+                _resized();
+                throw;
+            }
+            other.clear();
+            _resized();
+            return *this;
+        }
+        head = other.head;
+        _size = other._size;
+        other.head = nullptr;
+        other._size = 0;
+        _resized();
+        other._resized();
+        return *this;
+    }
 
     /** \brief Deep-copy constructor */
     explicit bst(const bst& other):
-    _size{other._size}, comp{other.comp} {
-        if(other.head)
-            head.reset(new node_type{*(other.head.get())});
+    _size{other._size}, comp{other.comp}, instr{other.instr}, balancer{other.balancer},
+    nodes{other.nodes.select_on_container_copy_construction()} {
+        try {
+            _copy(static_cast<const node_type*>(other.head));
+        }
+        catch(...) {
+            _destroy_all();
+            throw;
+        }
     }
 
     /** \brief  Deep-copy assignment */
@@ -105,17 +570,45 @@ class bst {
 
     /** \brief delete tree
      * 
-     * Function to clear the contents of the tree by setting head to null-pointer. */
-    void clear() {
-        head.reset(nullptr);
+     * Function to clear the contents of the tree, destroying all the nodes. */
+    void clear() noexcept {
+        _destroy_all();
         _size = 0;
+        _resized();
+    }
+
+    /** \brief replace the content with a range
+     * 
+     * Clears the tree and rebuilds it perfectly balanced with the elements in [ \p first , \p last ), 
+     * that are sorted once up front. If a key is repeated, only its first element is kept. */
+    template<typename It, typename = typename std::iterator_traits<It>::iterator_category>
+    void assign(It first, It last) {
+        clear();
+        _assign(first, last, false);
+    }
+
+    /** \brief replace the content with a sorted range
+     * 
+     * Clears the tree and rebuilds it perfectly balanced with the elements in [ \p first , \p last ), 
+     * that must be sorted by key without duplicates, in linear time. */
+    template<typename It, typename = typename std::iterator_traits<It>::iterator_category>
+    void assign(sorted_unique_t, It first, It last) {
+        clear();
+        _assign(first, last, true);
+    }
+
+    /** \brief get allocator
+     * 
+     * Returns a copy of the allocator used by the tree. */
+    allocator get_allocator() const {
+        return allocator{nodes.get_allocator()};
     }
     
     /** \brief pretty print
      * 
-     * Function for a 2D design of the existing tree */
-    void print2D() const noexcept {  
-        _print2D(head.get(), 0);  
+     * Function for a 2D design of the existing tree, written to \p os */
+    void print2D(std::ostream& os = std::cout) const noexcept {  
+        _print2D(head, os);  
     } 
 
     /** \brief begin of for loop with iterator
@@ -124,7 +617,7 @@ class bst {
      * The returning value is obtained using the fucntion leftiest(),
      * which finds the leaf node placed at the very far left*/
     iterator begin() noexcept{
-        return iterator{head.get()->leftiest()};
+        return iterator{head ? head->leftiest() : nullptr};
     }
 
     /** \brief const begin of for loop with iterator
@@ -133,7 +626,7 @@ class bst {
      * The returning value is obtained using the fucntion leftiest(),
      * which finds the leaf node placed at the very far left*/
     const_iterator begin() const noexcept {
-        return const_iterator{head.get()->leftiest()};
+        return const_iterator{head ? head->leftiest() : nullptr};
     }
 
     /** \brief const begin of for loop with iterator
@@ -142,7 +635,7 @@ class bst {
      * The returning value is obtained using the fucntion leftiest(),
      * which finds the leaf node placed at the very far left*/
     const_iterator cbegin() const noexcept {
-        return const_iterator{head.get()->leftiest()};
+        return const_iterator{head ? head->leftiest() : nullptr};
     }
 
     /** \brief end of for loop with iterator
@@ -176,7 +669,7 @@ class bst {
      * the function _find() returns a nullptr, so equivalent result as end().
      */
     iterator find(const key_type& x) noexcept{
-        return iterator{_find(x)}; 
+        return iterator{_accessed(_find(x))}; 
     }
 
     /** \brief const find element in tree by key
@@ -189,6 +682,185 @@ class bst {
         return const_iterator{_find(x)};
     }
 
+    /** \brief find element by comparable key
+     * 
+     * As find(const key_type&), with \p x of any type that the comparison can compare with the keys, 
+     * e.g. a std::string_view on std::string keys with std::less<>: no key_type is built. 
+     * Only if comparison::is_transparent is defined. */
+    template<typename K, typename C = comparison, typename = _transparent<C>>
+    iterator find(const K& x) noexcept{
+        return iterator{_accessed(_find(x))};
+    }
+
+    /** \brief find element by comparable key
+     * 
+     * Const version of find(const K&). */
+    template<typename K, typename C = comparison, typename = _transparent<C>>
+    const_iterator find(const K& x) const noexcept{
+        return const_iterator{_find(x)};
+    }
+
+    /** \brief check if a key is present */
+    bool contains(const key_type& x) const noexcept{
+        return _find(x) != nullptr;
+    }
+
+    /** \brief check if a comparable key is present, only if comparison::is_transparent is defined */
+    template<typename K, typename C = comparison, typename = _transparent<C>>
+    bool contains(const K& x) const noexcept{
+        return _find(x) != nullptr;
+    }
+
+    /** \brief number of elements with a key, 0 or 1 */
+    std::size_t count(const key_type& x) const noexcept{
+        return contains(x);
+    }
+
+    /** \brief number of elements with a comparable key, 0 or 1, only if comparison::is_transparent is defined */
+    template<typename K, typename C = comparison, typename = _transparent<C>>
+    std::size_t count(const K& x) const noexcept{
+        return contains(x);
+    }
+
+    /** \brief find many keys
+     * 
+     * Writes to \p out , in order, an iterator to the element with each key in [ \p first , \p last ), 
+     * or end() for the missing ones, and returns \p out past the last write. 
+     * The lookups are walked down the tree together, one level per round, and the node each 
+     * one goes to next is prefetched: the cache misses of different keys overlap instead of 
+     * following each other, which pays off on trees larger than the cache. */
+    template<typename It, typename OutIt>
+    OutIt find_batch(It first, It last, OutIt out){
+        _find_batch(first, last, [&out](node_type* x) { *out++ = iterator{x}; });
+        return out;
+    }
+
+    /** \brief find many keys
+     * 
+     * Const version of find_batch(), writes const iterators. */
+    template<typename It, typename OutIt>
+    OutIt find_batch(It first, It last, OutIt out) const{
+        _find_batch(first, last, [&out](node_type* x) { *out++ = const_iterator{x}; });
+        return out;
+    }
+
+    /** \brief check many keys
+     * 
+     * Writes to \p out , in order, true for each key in [ \p first , \p last ) that is present and 
+     * false otherwise, interleaving the lookups as find_batch() does. Returns \p out past the last write. */
+    template<typename It, typename OutIt>
+    OutIt contains_batch(It first, It last, OutIt out) const{
+        _find_batch(first, last, [&out](node_type* x) { *out++ = x != nullptr; });
+        return out;
+    }
+
+    /** \brief first element not less than key
+     * 
+     * Returns an iterator to the first element whose key is not less than \p x , 
+     * end() if there is none. Takes O(h). */
+    iterator lower_bound(const key_type& x) noexcept{
+        return iterator{_lower_bound(x)};
+    }
+
+    /** \brief first element not less than key
+     * 
+     * Const version of lower_bound(). */
+    const_iterator lower_bound(const key_type& x) const noexcept{
+        return const_iterator{_lower_bound(x)};
+    }
+
+    /** \brief first element not less than a comparable key, only if comparison::is_transparent is defined */
+    template<typename K, typename C = comparison, typename = _transparent<C>>
+    iterator lower_bound(const K& x) noexcept{
+        return iterator{_lower_bound(x)};
+    }
+
+    /** \brief first element not less than a comparable key
+     * 
+     * Const version of lower_bound(const K&). */
+    template<typename K, typename C = comparison, typename = _transparent<C>>
+    const_iterator lower_bound(const K& x) const noexcept{
+        return const_iterator{_lower_bound(x)};
+    }
+
+    /** \brief first element greater than key
+     * 
+     * Returns an iterator to the first element whose key is greater than \p x , 
+     * end() if there is none. Takes O(h). */
+    iterator upper_bound(const key_type& x) noexcept{
+        return iterator{_upper_bound(x)};
+    }
+
+    /** \brief first element greater than key
+     * 
+     * Const version of upper_bound(). */
+    const_iterator upper_bound(const key_type& x) const noexcept{
+        return const_iterator{_upper_bound(x)};
+    }
+
+    /** \brief first element greater than a comparable key, only if comparison::is_transparent is defined */
+    template<typename K, typename C = comparison, typename = _transparent<C>>
+    iterator upper_bound(const K& x) noexcept{
+        return iterator{_upper_bound(x)};
+    }
+
+    /** \brief first element greater than a comparable key
+     * 
+     * Const version of upper_bound(const K&). */
+    template<typename K, typename C = comparison, typename = _transparent<C>>
+    const_iterator upper_bound(const K& x) const noexcept{
+        return const_iterator{_upper_bound(x)};
+    }
+
+    /** \brief elements equal to key
+     * 
+     * Returns the pair lower_bound(), upper_bound() of \p x : the range contains the element 
+     * with key \p x if present, and is empty otherwise. */
+    std::pair<iterator, iterator> equal_range(const key_type& x) noexcept{
+        return std::make_pair(lower_bound(x), upper_bound(x));
+    }
+
+    /** \brief elements equal to key
+     * 
+     * Const version of equal_range(). */
+    std::pair<const_iterator, const_iterator> equal_range(const key_type& x) const noexcept{
+        return std::make_pair(lower_bound(x), upper_bound(x));
+    }
+
+    /** \brief elements equal to a comparable key, only if comparison::is_transparent is defined */
+    template<typename K, typename C = comparison, typename = _transparent<C>>
+    std::pair<iterator, iterator> equal_range(const K& x) noexcept{
+        return std::make_pair(lower_bound(x), upper_bound(x));
+    }
+
+    /** \brief elements equal to a comparable key
+     * 
+     * Const version of equal_range(const K&). */
+    template<typename K, typename C = comparison, typename = _transparent<C>>
+    std::pair<const_iterator, const_iterator> equal_range(const K& x) const noexcept{
+        return std::make_pair(lower_bound(x), upper_bound(x));
+    }
+
+    /** \brief bounded scan
+     * 
+     * Returns the range of the elements with keys in [ \p a , \p b ), to be used in a range-based for loop. 
+     * Finding the bounds takes O(h), then each element costs an increment of the iterator. 
+     * The range is empty if \p b is not greater than \p a . */
+    iterator_range<iterator> range(const key_type& a, const key_type& b) noexcept{
+        if(!comp(a, b))
+            return iterator_range<iterator>{end(), end()};
+        return iterator_range<iterator>{lower_bound(a), lower_bound(b)};
+    }
+
+    /** \brief bounded scan
+     * 
+     * Const version of range(). */
+    iterator_range<const_iterator> range(const key_type& a, const key_type& b) const noexcept{
+        if(!comp(a, b))
+            return iterator_range<const_iterator>{end(), end()};
+        return iterator_range<const_iterator>{lower_bound(a), lower_bound(b)};
+    }
+
     /** \brief insert node by pair
      * 
      * Function to insert node based on \p x , as const l-value reference pair type. 
@@ -209,165 +881,502 @@ class bst {
         return _insert(std::move(x));
     }
 
+    /** \brief insert an extracted node
+     * 
+     * Links the node held by \p nh , taken from this or another tree with the same node type, 
+     * if its key is not present. If the allocators are equal nothing is allocated or copied; 
+     * otherwise the element is moved to a new node. Only for storages whose nodes are detachable.
+     * \returns the element with the key of the node, whether it has been inserted, 
+     * and the node if it has not */
+    insert_return_type insert(node_handle&& nh);
+
     /** \brief emplace element
      * 
      * Inserts a new element into the container constructed in-place with the given args 
-     * if there is no element with the key in the container.
+     * if there is no element with the key in the container. 
+     * The node is constructed before walking the tree, since the key is known only then, 
+     * and it is destroyed if the key is already present.
      */
     template< class... Types >
-    std::pair<iterator,bool> emplace(Types&&... args) {
-        return insert(std::make_pair(std::forward<Types>(args)...));
-    }
+    std::pair<iterator,bool> emplace(Types&&... args);
 
-    /** \brief erase element from tree
+    /** \brief emplace element if key is absent
      * 
-     * Function that removes the element (if one exists) with the key equivalent to key. 
-     * When element found, deleted. After erase, tree repopulated.
-     * Takes const \p x , l-value reference of type key. */
-    void erase(const key_type& x);
+     * If the key \p k , passed as l-value, is not present, inserts a new element 
+     * with the value constructed in-place from \p args . Otherwise nothing is constructed 
+     * and \p args are not moved from. Returns an iterator to the element with key \p k and 
+     * a bool that is true if the element has been inserted.
+     */
+    template< class... Types >
+    std::pair<iterator,bool> try_emplace(const key_type& k, Types&&... args) {
+        return _try_emplace(k, std::forward<Types>(args)...);
+    }
 
-    /** \brief balance tree
+    /** \brief emplace element if key is absent
      * 
-     * Function to balance the tree.*/
-    void balance();
-    
-    /** \brief depth of tree
-     * 
-     * Returns depth of the tree. */
-    std::size_t size() const noexcept{
-        return this->_size;
+     * As try_emplace(const key_type&, Types&&...), with the key \p k passed as r-value. */
+    template< class... Types >
+    std::pair<iterator,bool> try_emplace(key_type&& k, Types&&... args) {
+        return _try_emplace(std::move(k), std::forward<Types>(args)...);
     }
 
-    /** \brief put-to
+    /** \brief insert or assign element
      * 
-     * Put-to operator, takes instance of ostream, and \p x as l-value reference to bst type. 
+     * If the key \p k , passed as l-value, is present, \p obj is assigned to its value; 
+     * otherwise a new element is inserted. Returns an iterator to the element with key \p k and 
+     * a bool that is true if the element has been inserted, false if it has been assigned.
      */
-    friend
-    std::ostream& operator<<(std::ostream& os, const bst& x) {
-        os << "Depth of the tree is: " << x.size() << "\n";
-        for(const auto& el : x) {
-            os << "[ key=" << el.first <<" , value=" << el.second << " ] ";
-        }
-        os << std::endl;
-        return os;
+    template< class M >
+    std::pair<iterator,bool> insert_or_assign(const key_type& k, M&& obj) {
+        auto res = _try_emplace(k, std::forward<M>(obj));
+        if(!res.second)
+            res.first->second = std::forward<M>(obj);
+        return res;
     }
 
-    /** \brief subscripting l-value 
+    /** \brief insert or assign element
      * 
-     * Subscripting operator, takes \p x as l-value reference, of type key.
-     * Returns a reference to the value that is mapped to a key equivalent to x, 
-     * performing an insertion if such key does not already exist.
-     * Takes advantage of the already defined insert() function.
-     */
-    value_type& operator[](const key_type& x){
-        iterator it = find(x);
-        if(it != iterator{nullptr})
-            return it->second;
+     * As insert_or_assign(const key_type&, M&&), with the key \p k passed as r-value. */
+    template< class M >
+    std::pair<iterator,bool> insert_or_assign(key_type&& k, M&& obj) {
+        auto res = _try_emplace(std::move(k), std::forward<M>(obj));
+        if(!res.second)
+            res.first->second = std::forward<M>(obj);
+        return res;
+    }
 
-        return insert(pair_type{x,{}}).first->second;
+    /** \brief erase element from tree
+     * 
+     * Function that removes the element (if one exists) with the key equivalent to key. 
+     * When element found, it is unlinked and deleted; its children are relinked in place 
+     * and the balancing policy is notified. No node is copied or allocated, so it takes O(h).
+     * Takes const \p x , l-value reference of type key. 
+     * Returns the number of elements removed (0 or 1). Throws if the tree is empty. */
+    std::size_t erase(const key_type& x){
+        return _erase(x);
     }
-    
-    /** \brief subscripting r-value
+
+    /** \brief erase element by comparable key
      * 
-     * Subscripting operator, takes \p x as r-value reference, of type key.
-     * Returns a reference to the value that is mapped to a key equivalent to x, 
-     * performing an insertion if such key does not already exist.
-     * Takes advantage of the already defined insert() function.
-     */
-    value_type& operator[](key_type&& x){
-        iterator it = find(std::move(x));
-        if(it != iterator{nullptr})
-            return it->second;
+     * As erase(const key_type&), with \p x of any type that the comparison can compare with the keys. 
+     * Only if comparison::is_transparent is defined, and \p x is not an iterator. */
+    template<typename K, typename C = comparison, typename = _transparent<C>, 
+             typename = std::enable_if_t<!std::is_convertible<const K&, iterator>::value && !std::is_convertible<const K&, const_iterator>::value>>
+    std::size_t erase(const K& x){
+        return _erase(x);
+    }
 
-        return insert(pair_type{std::move(x),{}}).first->second;
-    } 
-};
+    /** \brief erase element from tree by position
+     * 
+     * Removes the element pointed by \p pos , which must be a valid dereferenceable iterator. 
+     * Returns an iterator to the element following the removed one. */
+    iterator erase(const_iterator pos) noexcept;
 
+    /** \brief erase element from tree by position
+     * 
+     * As erase(const_iterator), it avoids the ambiguity between iterator and key_type. */
+    iterator erase(iterator pos) noexcept {
+        return erase(const_iterator{pos});
+    }
 
-template<typename key_type, typename value_type, typename comparison>
-template<typename O>
-std::pair<typename bst<key_type, value_type, comparison>::iterator, bool> bst<key_type, value_type, comparison>::_insert(O&& x){
-    auto start = std::chrono::high_resolution_clock::now(); 
-    auto _node = new node<O>{std::forward<O>(x)};
-    auto tmp = head.get();
-    bool added = false;
-    if (!tmp) {
-        // our list is empty
-        head.reset(_node);
-        added = true;
-        std::cout << "root insert" << std::endl;
-        auto stop = std::chrono::high_resolution_clock::now(); 
-        auto duration = std::chrono::duration_cast<std::chrono::microseconds>(stop - start); 
-  
-        std::cout << "Time taken by insert: " << duration.count() << " microseconds" << std::endl; 
+    /** \brief erase range from tree
+     * 
+     * Removes the elements in [ \p first , \p last ). Returns \p last as an iterator. */
+    iterator erase(const_iterator first, const_iterator last) noexcept {
+        while(first != last)
+            first = erase(first);
+        return iterator{last.get_node()};
+    }
+
+    /** \brief extract element by position
+     * 
+     * Unlinks the element pointed by \p pos , which must be dereferenceable, as erase(const_iterator) does, 
+     * but instead of deleting its node hands it over to the returned node_handle. 
+     * Only the iterators to that element are invalidated. Only for storages whose nodes are detachable. */
+    node_handle extract(const_iterator pos) noexcept;
 
-        return std::make_pair(Iterator<O,node<O>>{_node},added);
+    /** \brief extract element by position
+     * 
+     * As extract(const_iterator), it avoids the ambiguity between iterator and key_type. */
+    node_handle extract(iterator pos) noexcept {
+        return extract(const_iterator{pos});
     }
 
-    else {
-        auto parent {tmp};
-        int flag {0};
-        // checking if we have to go left or right
-        while(tmp) {
-            // go right
-            if(comp(tmp->get_data().first, x.first)) {
-                parent = tmp;
-                tmp = tmp->get_right();
-                flag = 0;
-            }
-            // go left
-            else if(comp(x.first, tmp->get_data().first)){
-                parent = tmp;
-                tmp = tmp->get_left();
-                flag = 1;
+    /** \brief extract element by key
+     * 
+     * As extract(const_iterator) for the element with key \p x . Returns an empty handle if not present. */
+    node_handle extract(const key_type& x) {
+        return _extract(x);
+    }
+
+    /** \brief extract element by comparable key
+     * 
+     * As extract(const key_type&), with \p x of any type that the comparison can compare with the keys. 
+     * Only if comparison::is_transparent is defined, and \p x is not an iterator. */
+    template<typename K, typename C = comparison, typename = _transparent<C>, 
+             typename = std::enable_if_t<!std::is_convertible<const K&, iterator>::value && !std::is_convertible<const K&, const_iterator>::value>>
+    node_handle extract(const K& x) {
+        return _extract(x);
+    }
+
+    /** \brief balance tree
+     * 
+     * Function to balance the tree. With flat_storage the nodes are also moved in pre-order, 
+     * which invalidates all the iterators.*/
+    void balance();
+
+    /** \brief balance tree in parallel
+     * 
+     * Same result as balance(): the nodes are collected in order and relinked around the medians, 
+     * the independent halves on the threads of \p p , e.g. parallel . It needs a temporary array 
+     * of one pointer per node.*/
+    void balance(parallel_t p);
+    
+    /** \brief split by key
+     * 
+     * Moves the elements with key not less than \p x to the returned tree, which uses a copy of 
+     * the allocator, and keeps the smaller ones. The nodes are relinked, not copied: with 
+     * avl_balancing it takes O(log n), plus the count of the smaller part without order statistics. 
+     * With scapegoat_balancing both parts are rebuilt, in O(n), to fit the bound on their depth. 
+     * With flat_storage, or allocators that do not compare equal, the moved elements are copied.*/
+    bst split(const key_type& x);
+
+    /** \brief join with greater keys
+     * 
+     * Moves all the elements of \p other , whose keys must all be greater than the ones of this tree, 
+     * at the end of this tree and leaves \p other empty. The nodes are relinked, not copied, in 
+     * O(log n) with avl_balancing, if the storages can share nodes (see split()). With 
+     * scapegoat_balancing the result is rebuilt, in O(n + m), to fit the bound on its depth.
+     * \throws std::invalid_argument if the keys overlap */
+    void join(bst& other);
+
+    /** \brief union
+     * 
+     * Moves into this tree the elements of \p other whose key is not present; the others stay 
+     * in \p other , as with std::map::merge. With avl_balancing the nodes of \p other split this 
+     * tree and the parts are joined back, which takes O(m log(n/m + 1)) for m elements in the 
+     * smaller tree and leaves most of the larger one untouched. The policies that cannot join 
+     * (no_balancing, splay_balancing, scapegoat_balancing) take O(n + m): both trees are merged 
+     * in order and relinked perfectly balanced. Only if \p other is much smaller (m log2(n) < n) 
+     * its elements are linked one by one as insertions would, in O(m h).*/
+    void merge(bst& other);
+
+    /** \brief intersection
+     * 
+     * Keeps only the elements whose key is also in \p other , in O(m log(n/m + 1)) with 
+     * avl_balancing. The other policies take O(n + m), walking both trees in order, 
+     * or O(n h) searching \p other if this tree is much smaller. */
+    void intersect(const bst& other);
+
+    /** \brief difference
+     * 
+     * Erases the elements whose key is in \p other , in O(m log(n/m + 1)) with 
+     * avl_balancing. The other policies take O(n + m), walking both trees in order, 
+     * O(m h) erasing the keys one by one if \p other is much smaller, 
+     * or O(n h) searching \p other if this tree is much smaller. */
+    void subtract(const bst& other);
+
+    /** \brief frozen snapshot
+     * 
+     * Returns an immutable copy of the tree, a frozen_bst laid out for fast lookups, 
+     * built in O(n). Later changes to the tree do not affect it. */
+    frozen_bst<key_type, value_type, comparison> freeze() const {
+        return frozen_bst<key_type, value_type, comparison>{sorted_unique, begin(), end(), comp};
+    }
+
+    /** \brief write a binary snapshot
+     * 
+     * Writes to \p os , which should be opened in binary mode, a versioned header and the elements 
+     * in order (see snapshot_header). Keys and values are written with snapshot_traits: as raw bytes 
+     * if trivially copyable, in which case mapped_bst can serve the file without loading it.
+     * \throws std::runtime_error if the stream fails */
+    void save(std::ostream& os) const;
+
+    /** \brief read a binary snapshot
+     * 
+     * Replaces the elements with the ones of the snapshot read from \p is , written by save() 
+     * from a tree with the same key and value types and comparison. The tree is built perfectly 
+     * balanced in O(n), reserving the storage once, without comparing the keys.
+     * \throws std::runtime_error if the snapshot does not match the types or is truncated: the tree is 
+     * left unchanged, or empty if the failure comes while its nodes are being built */
+    void load(std::istream& is);
+
+    /** \brief size of tree
+     * 
+     * Returns the number of elements of the tree. */
+    std::size_t size() const noexcept{
+        return this->_size;
+    }
+
+    /** \brief k-th smallest element
+     * 
+     * Returns an iterator to the element with \p k smaller elements (0-based), end() if \p k >= size(). 
+     * Takes O(h); requires the order_statistics balancing policy. */
+    iterator select(std::size_t k) noexcept{
+        return iterator{_select(k)};
+    }
+
+    /** \brief k-th smallest element
+     * 
+     * Const version of select(). */
+    const_iterator select(std::size_t k) const noexcept{
+        return const_iterator{_select(k)};
+    }
+
+    /** \brief rank of a key
+     * 
+     * Returns the number of elements whose key is less than \p x , whether \p x is present or not. 
+     * Takes O(h); requires the order_statistics balancing policy. */
+    std::size_t rank(const key_type& x) const noexcept;
+
+    /** \brief count elements in a key range
+     * 
+     * Returns the number of elements with keys in [ \p a , \p b ), 0 if \p b is not greater than \p a . 
+     * Takes O(h); requires the order_statistics balancing policy. */
+    std::size_t count_range(const key_type& a, const key_type& b) const noexcept{
+        return comp(a, b) ? rank(b) - rank(a) : 0;
+    }
+
+    /** \brief instrumentation policy
+     * 
+     * Returns the instrumentation policy, e.g. to read the statistics collected by stats_instrumentation. */
+    const instrumentation& get_instrumentation() const noexcept{
+        return instr;
+    }
+
+    /** \brief instrumentation policy
+     * 
+     * Returns the instrumentation policy, e.g. to reset the statistics collected by stats_instrumentation. */
+    instrumentation& get_instrumentation() noexcept{
+        return instr;
+    }
+
+    /** \brief put-to
+     * 
+     * Put-to operator, takes instance of ostream, and \p x as l-value reference to bst type. 
+     */
+    friend
+    std::ostream& operator<<(std::ostream& os, const bst& x) {
+        os << "Size of the tree is: " << x.size() << "\n";
+        for(const auto& el : x) {
+            os << "[ key=" << el.first <<" , value=" << el.second << " ] ";
+        }
+        os << std::endl;
+        return os;
+    }
+
+    /** \brief subscripting l-value 
+     * 
+     * Subscripting operator, takes \p x as l-value reference, of type key.
+     * Returns a reference to the value that is mapped to a key equivalent to x, 
+     * performing an insertion if such key does not already exist.
+     * Takes advantage of try_emplace(), so the tree is walked only once.
+     */
+    value_type& operator[](const key_type& x){
+        return try_emplace(x).first->second;
+    }
+    
+    /** \brief subscripting r-value
+     * 
+     * Subscripting operator, takes \p x as r-value reference, of type key.
+     * Returns a reference to the value that is mapped to a key equivalent to x, 
+     * performing an insertion if such key does not already exist.
+     * Takes advantage of try_emplace(), so the tree is walked only once.
+     */
+    value_type& operator[](key_type&& x){
+        return try_emplace(std::move(x)).first->second;
+    } 
+
+    /** \brief subscripting by comparable key
+     * 
+     * As operator[](const key_type&), with \p x of any type that the comparison can compare with the keys 
+     * and from which a key_type can be built: the key is built from \p x only if it has to be inserted. 
+     * Only if comparison::is_transparent is defined. */
+    template<typename K, typename C = comparison, typename = _transparent<C>, 
+             typename = std::enable_if_t<std::is_constructible<key_type, K&&>::value>>
+    value_type& operator[](K&& x){
+        return _try_emplace(std::forward<K>(x)).first->second;
+    }
+};
+
+
+template<typename key_type, typename value_type, typename comparison, typename instrumentation, typename balancing, typename allocator, typename storage>
+template<typename K>
+typename bst<key_type, value_type, comparison, instrumentation, balancing, allocator, storage>::node_type* bst<key_type, value_type, comparison, instrumentation, balancing, allocator, storage>::_locate(const K& k, node_type*& parent, bool& left, probe_type& probe) const noexcept{
+    auto tmp {head};
+    parent = nullptr;
+    left = false;
+    // checking if we have to go left or right
+    while(tmp) {
+        probe.visit();
+        // go right
+        if(comp(tmp->get_data().first, k)) {
+            parent = tmp;
+            tmp = tmp->get_right();
+            left = false;
+        }
+        // go left
+        else if(comp(k, tmp->get_data().first)){
+            parent = tmp;
+            tmp = tmp->get_left();
+            left = true;
+        }
+        // this means that we have found that there already is a node
+        // with same key w.r.t. the one we wanted to insert
+        else {
+            return tmp;
+        }
+    }
+    return nullptr;
+}
+
+
+template<typename key_type, typename value_type, typename comparison, typename instrumentation, typename balancing, typename allocator, typename storage>
+void bst<key_type, value_type, comparison, instrumentation, balancing, allocator, storage>::_link(node_type* x, node_type* parent, bool left) noexcept{
+    x->set_parent(parent);
+    if(!parent) {
+        // our list is empty
+        head = x;
+    }
+    else if(left) {
+        parent->set_left(x);
+    }
+    else {
+        parent->set_right(x);
+    }
+    ++_size;
+    balancer.inserted(head, x);
+    if constexpr (_depth_bounded)
+        _rebalance_inserted(x);
+}
+
+
+template<typename key_type, typename value_type, typename comparison, typename instrumentation, typename balancing, typename allocator, typename storage>
+void bst<key_type, value_type, comparison, instrumentation, balancing, allocator, storage>::_rebalance_inserted(node_type* x) noexcept{
+    balancer.grown(_size);
+    std::size_t depth {0};
+    for(auto y = x->get_parent(); y; y = y->get_parent())
+        ++depth;
+    if(!balancer.too_deep(depth, _size))
+        return;
+    // the root is too deep for the size of the whole tree, so the walk stops at the latest there
+    std::size_t size {1};
+    std::size_t below {0};
+    for(auto child = x, y = x->get_parent(); y; child = y, y = y->get_parent()) {
+        auto sibling {y->get_left() == child ? y->get_right() : y->get_left()};
+        ++size;
+        visit_pre_order(sibling, [&size](node_type*) { ++size; });
+        if(balancer.too_deep(++below, size)) {
+            _rebuild(y);
+            return;
+        }
+    }
+}
+
+
+template<typename key_type, typename value_type, typename comparison, typename instrumentation, typename balancing, typename allocator, typename storage>
+template<typename O>
+std::pair<typename bst<key_type, value_type, comparison, instrumentation, balancing, allocator, storage>::iterator, bool> bst<key_type, value_type, comparison, instrumentation, balancing, allocator, storage>::_insert(O&& x){
+    auto probe = instr.start(operation::insert);
+    node_type* parent;
+    bool left;
+    auto found = _locate(x.first, parent, left, probe);
+    if(found) {
+        _accessed(found);
+        instr.stop(probe);
+        return std::make_pair(iterator{found}, false);
+    }
+    // after having found the correct position, we can add the node to the tree
+    auto final_node = _create_at(parent, left, probe, std::forward<O>(x));
+    _link(final_node, parent, left);
+    instr.stop(probe);
+    return std::make_pair(iterator{final_node}, true);
+}
+
+
+template<typename key_type, typename value_type, typename comparison, typename instrumentation, typename balancing, typename allocator, typename storage>
+template<typename K, typename... Types>
+std::pair<typename bst<key_type, value_type, comparison, instrumentation, balancing, allocator, storage>::iterator, bool> bst<key_type, value_type, comparison, instrumentation, balancing, allocator, storage>::_try_emplace(K&& k, Types&&... args){
+    auto probe = instr.start(operation::insert);
+    node_type* parent;
+    bool left;
+    auto found = _locate(k, parent, left, probe);
+    if(found) {
+        _accessed(found);
+        instr.stop(probe);
+        return std::make_pair(iterator{found}, false);
+    }
+    auto final_node = _create_at(parent, left, probe, std::piecewise_construct,
+                                 std::forward_as_tuple(std::forward<K>(k)),
+                                 std::forward_as_tuple(std::forward<Types>(args)...));
+    _link(final_node, parent, left);
+    instr.stop(probe);
+    return std::make_pair(iterator{final_node}, true);
+}
+
+
+template<typename key_type, typename value_type, typename comparison, typename instrumentation, typename balancing, typename allocator, typename storage>
+template<class... Types>
+std::pair<typename bst<key_type, value_type, comparison, instrumentation, balancing, allocator, storage>::iterator, bool> bst<key_type, value_type, comparison, instrumentation, balancing, allocator, storage>::emplace(Types&&... args){
+    auto probe = instr.start(operation::insert);
+    node_type* parent;
+    bool left;
+    if constexpr (!storage_type::detachable) {
+        if(!nodes.has_room(1)) {
+            // growing moves the nodes, and args may refer to one of them: the pair is built first, 
+            // so that nothing grows if the key is present
+            pair_type element(std::forward<Types>(args)...);
+            auto found = _locate(element.first, parent, left, probe);
+            if(found) {
+                _accessed(found);
+                instr.stop(probe);
+                return std::make_pair(iterator{found}, false);
             }
-            // this means that we have found that there already is a node
-            // with same key w.r.t. the one we wanted to insert
-            else {  
-                added = false;
-                flag = -1;
-                tmp = nullptr;
-            }  
-        }
-        // after having found the correct position, we can add the node to the tree
-        auto final_node = new node<O>{_node->get_data(),parent};
-        switch(flag) {
-            case 0:
-                parent->right_child.reset(final_node);
-                if(!parent->get_left()){
-                    ++_size;
-                }
-                std::cout << "right insert" << std::endl;
-                break;
-            case 1:
-                parent->left_child.reset(final_node);
-                if(!parent->get_right()){
-                    ++_size;
-                }
-                std::cout << "left insert" << std::endl;
-                break;
-            default:
-                std::cout << "node was already present" << std::endl;
-                break;
+            auto final_node = _create_at(parent, left, probe, std::move(element));
+            _link(final_node, parent, left);
+            instr.stop(probe);
+            return std::make_pair(iterator{final_node}, true);
         }
     }
-    auto stop = std::chrono::high_resolution_clock::now(); 
-    auto duration = std::chrono::duration_cast<std::chrono::microseconds>(stop - start); 
-  
-    std::cout << "Time taken by insert: " << duration.count() << " microseconds" << std::endl; 
+    auto final_node = _create_node(std::in_place, std::forward<Types>(args)...);
+    auto found = _locate(final_node->get_data().first, parent, left, probe);
+    if(found) {
+        _destroy_node(final_node);
+        _accessed(found);
+        instr.stop(probe);
+        return std::make_pair(iterator{found}, false);
+    }
+    _link(final_node, parent, left);
+    instr.stop(probe);
+    return std::make_pair(iterator{final_node}, true);
+}
+
 
-    return std::make_pair(Iterator<O,node<O>>{_node},added);
+template<typename key_type, typename value_type, typename comparison, typename instrumentation, typename balancing, typename allocator, typename storage>
+template<typename... Types>
+typename bst<key_type, value_type, comparison, instrumentation, balancing, allocator, storage>::node_type* bst<key_type, value_type, comparison, instrumentation, balancing, allocator, storage>::_create_at(node_type*& parent, bool& left, probe_type& probe, Types&&... args){
+    // nodes allocated one by one never move
+    if constexpr (!storage_type::detachable) {
+        if(!nodes.has_room(1)) {
+            pair_type element(std::forward<Types>(args)...);
+            _reserve(1);
+            _locate(element.first, parent, left, probe);
+            return _create_node(std::in_place, std::move(element));
+        }
+    }
+    return _create_node(std::in_place, std::forward<Types>(args)...);
 }
 
 
-template<typename key_type, typename value_type, typename comparison>
+template<typename key_type, typename value_type, typename comparison, typename instrumentation, typename balancing, typename allocator, typename storage>
 template<typename T>
-node<std::pair<const key_type, value_type>>* bst<key_type, value_type, comparison>::_find(T&& x) const noexcept{
+typename bst<key_type, value_type, comparison, instrumentation, balancing, allocator, storage>::node_type* bst<key_type, value_type, comparison, instrumentation, balancing, allocator, storage>::_find(T&& x) const noexcept{
 
-    auto start = std::chrono::high_resolution_clock::now(); 
-    auto tmp {head.get()};
+    auto probe = instr.start(operation::find);
+    auto tmp {head};
     // checking if we have to go left or right
     while(tmp) {
+        probe.visit();
         // go right
         if(comp(tmp->get_data().first, x)) {
             tmp = tmp->get_right();
@@ -379,167 +1388,1179 @@ node<std::pair<const key_type, value_type>>* bst<key_type, value_type, compariso
         // this means that we have found that there already is a node
         // with same key w.r.t. the one we wanted to insert
         else {
-            std::cout << "Found node with key = "<< x <<" . The value is: "<< tmp->get_data().second << std::endl;
+            instr.stop(probe);
+            return tmp;
+        }  
+    }
+    instr.stop(probe);
+    return nullptr;
+}
+
+
+template<typename key_type, typename value_type, typename comparison, typename instrumentation, typename balancing, typename allocator, typename storage>
+template<typename It, typename F>
+void bst<key_type, value_type, comparison, instrumentation, balancing, allocator, storage>::_find_batch(It first, It last, F&& found) const{
+    node_type* at[_batch_width];
+    It key[_batch_width];
+    probe_type probes[_batch_width];
+    while(first != last) {
+        std::size_t n {0};
+        for(; n < _batch_width && first != last; ++n, ++first) {
+            at[n] = head;
+            key[n] = first;
+            probes[n] = instr.start(operation::find);
+        }
+        // one level per round for every pending lookup: the loads of a round do not depend on 
+        // each other, and the nodes of the next round are already on their way
+        std::uint32_t pending {head ? (std::uint32_t{1} << n) - 1 : 0};
+        while(pending) {
+            for(std::size_t i = 0; i < n; ++i) {
+                const std::uint32_t bit {std::uint32_t{1} << i};
+                if(!(pending & bit))
+                    continue;
+                auto x {at[i]};
+                probes[i].visit();
+                const auto& k = x->get_data().first;
+                if(comp(k, *key[i]))
+                    x = x->get_right();
+                else if(comp(*key[i], k))
+                    x = x->get_left();
+                else {
+                    // found, at[i] stays on the node
+                    pending &= ~bit;
+                    continue;
+                }
+                at[i] = x;
+                if(!x)
+                    pending &= ~bit;
+#if defined(__GNUC__)
+                else
+                    __builtin_prefetch(x);
+#endif
+            }
+        }
+        for(std::size_t i = 0; i < n; ++i) {
+            instr.stop(probes[i]);
+            found(at[i]);
+        }
+    }
+}
+
+
+template<typename key_type, typename value_type, typename comparison, typename instrumentation, typename balancing, typename allocator, typename storage>
+template<typename... Types>
+typename bst<key_type, value_type, comparison, instrumentation, balancing, allocator, storage>::node_type* bst<key_type, value_type, comparison, instrumentation, balancing, allocator, storage>::_create_node(Types&&... args){
+    return nodes.create(std::forward<Types>(args)...);
+}
+
+
+template<typename key_type, typename value_type, typename comparison, typename instrumentation, typename balancing, typename allocator, typename storage>
+void bst<key_type, value_type, comparison, instrumentation, balancing, allocator, storage>::_destroy_node(node_type* x) noexcept{
+    nodes.destroy(x);
+}
+
+
+template<typename key_type, typename value_type, typename comparison, typename instrumentation, typename balancing, typename allocator, typename storage>
+void bst<key_type, value_type, comparison, instrumentation, balancing, allocator, storage>::_destroy_all() noexcept{
+    if(!nodes.release(head))
+        _destroy_subtree(head);
+    head = nullptr;
+}
+
+
+template<typename key_type, typename value_type, typename comparison, typename instrumentation, typename balancing, typename allocator, typename storage>
+void bst<key_type, value_type, comparison, instrumentation, balancing, allocator, storage>::_destroy_subtree(node_type* x) noexcept{
+    if(!x)
+        return;
+    auto top {x->get_parent()};
+    // post-order visit: a node is destroyed once both its children are gone
+    while(x != top) {
+        if(x->get_left()) {
+            x = x->get_left();
+        }
+        else if(x->get_right()) {
+            x = x->get_right();
+        }
+        else {
+            auto parent {x->get_parent()};
+            if(parent != top) {
+                if(parent->get_left() == x)
+                    parent->set_left(nullptr);
+                else
+                    parent->set_right(nullptr);
+            }
+            _destroy_node(x);
+            x = parent;
+        }
+    }
+}
+
+
+template<typename key_type, typename value_type, typename comparison, typename instrumentation, typename balancing, typename allocator, typename storage>
+template<typename It>
+typename bst<key_type, value_type, comparison, instrumentation, balancing, allocator, storage>::node_type* bst<key_type, value_type, comparison, instrumentation, balancing, allocator, storage>::_build(It& first, std::size_t n){
+    if(!n)
+        return nullptr;
+    const std::size_t half {n / 2};
+    auto left = _build(first, half);
+    node_type* x;
+    try {
+        x = _create_node(std::in_place, *first);
+    }
+    catch(...) {
+        _destroy_subtree(left);
+        throw;
+    }
+    x->set_left(left);
+    if(left)
+        left->set_parent(x);
+    node_type* right;
+    try {
+        ++first;
+        right = _build(first, n - half - 1);
+    }
+    catch(...) {
+        _destroy_subtree(x);
+        throw;
+    }
+    x->set_right(right);
+    if(right)
+        right->set_parent(x);
+    x->update();
+    return x;
+}
+
+
+template<typename key_type, typename value_type, typename comparison, typename instrumentation, typename balancing, typename allocator, typename storage>
+template<typename It>
+typename bst<key_type, value_type, comparison, instrumentation, balancing, allocator, storage>::node_type* bst<key_type, value_type, comparison, instrumentation, balancing, allocator, storage>::_build(It& first, std::size_t n, parallel_t p){
+    std::vector<node_type*> order;
+    order.reserve(n);
+    try {
+        for(std::size_t i = 0; i < n; ++i, ++first)
+            order.push_back(_create_node(std::in_place, *first));
+    }
+    catch(...) {
+        for(auto x : order)
+            _destroy_node(x);
+        throw;
+    }
+    return _link(order.data(), n, nullptr, p.workers(), p.grain);
+}
+
+
+template<typename key_type, typename value_type, typename comparison, typename instrumentation, typename balancing, typename allocator, typename storage>
+typename bst<key_type, value_type, comparison, instrumentation, balancing, allocator, storage>::node_type* bst<key_type, value_type, comparison, instrumentation, balancing, allocator, storage>::_link(node_type** x, std::size_t n, node_type* parent, unsigned threads, std::size_t grain) noexcept{
+    if(!n)
+        return nullptr;
+    const std::size_t half {n / 2};
+    auto root {x[half]};
+    root->set_parent(parent);
+    node_type* left {nullptr};
+    node_type* right {nullptr};
+    // the halves touch disjoint nodes: the left one goes to a new thread while there are threads to spare
+    fork_join(threads > 1 && n >= 2 * grain, 
+              [&] { left = _link(x, half, root, threads / 2, grain); }, 
+              [&] { right = _link(x + half + 1, n - half - 1, root, threads - threads / 2, grain); });
+    root->set_left(left);
+    root->set_right(right);
+    root->update();
+    return root;
+}
+
+
+template<typename key_type, typename value_type, typename comparison, typename instrumentation, typename balancing, typename allocator, typename storage>
+template<typename It>
+void bst<key_type, value_type, comparison, instrumentation, balancing, allocator, storage>::_assign(It first, It last, bool sorted, parallel_t p){
+    using category = typename std::iterator_traits<It>::iterator_category;
+    auto key_less = [this](const auto& a, const auto& b) { return comp(a.first, b.first); };
+    if constexpr (std::is_base_of<std::forward_iterator_tag, category>::value) {
+        // a range that is already strictly increasing is used as it is
+        if(sorted || std::adjacent_find(first, last, [&](const auto& a, const auto& b) { return !key_less(a, b); }) == last) {
+            auto n = static_cast<std::size_t>(std::distance(first, last));
+            _reserve(n);
+            head = p.workers() > 1 ? _build(first, n, p) : _build(first, n);
+            _size = n;
+            _resized();
+            return;
+        }
+    }
+    // sort once a buffer of the elements, keeping the first of equal keys
+    std::vector<std::pair<key_type, value_type>> buffer(first, last);
+    if(!sorted) {
+        parallel_stable_sort(buffer.begin(), buffer.end(), key_less, p.workers(), p.grain);
+        buffer.erase(std::unique(buffer.begin(), buffer.end(), 
+                                 [&](const auto& a, const auto& b) { return !key_less(a, b); }), 
+                     buffer.end());
+    }
+    auto it = std::make_move_iterator(buffer.begin());
+    _reserve(buffer.size());
+    head = p.workers() > 1 ? _build(it, buffer.size(), p) : _build(it, buffer.size());
+    _size = buffer.size();
+    _resized();
+}
+
+
+template<typename key_type, typename value_type, typename comparison, typename instrumentation, typename balancing, typename allocator, typename storage>
+template<typename N>
+void bst<key_type, value_type, comparison, instrumentation, balancing, allocator, storage>::_copy(N* x){
+    if(!x)
+        return;
+    auto copy_node = [this](N* from, node_type* parent) {
+        node_type* copy;
+        if constexpr (std::is_const<N>::value)
+            copy = _create_node(from->get_data(), parent);
+        else {
+            copy = _create_node(std::in_place, from->get_data().first, std::move(from->get_data().second));
+            copy->set_parent(parent);
+        }
+        static_cast<typename balancing::augment&>(*copy) = *from;
+        return copy;
+    };
+
+    _reserve(_size);
+    head = copy_node(x, nullptr);
+    auto src {x};
+    auto dst {head};
+    while(true) {
+        // the left subtree has not been copied yet
+        if(src->get_left() && !dst->get_left()) {
+            dst->set_left(copy_node(src->get_left(), dst));
+            src = src->get_left();
+            dst = dst->get_left();
+        }
+        // the right subtree has not been copied yet
+        else if(src->get_right() && !dst->get_right()) {
+            dst->set_right(copy_node(src->get_right(), dst));
+            src = src->get_right();
+            dst = dst->get_right();
+        }
+        // the whole subtree has been copied: go back up
+        else if(src != x) {
+            src = src->get_parent();
+            dst = dst->get_parent();
+        }
+        else {
+            break;
+        }
+    }
+}
+
+
+template<typename key_type, typename value_type, typename comparison, typename instrumentation, typename balancing, typename allocator, typename storage>
+template<typename T>
+typename bst<key_type, value_type, comparison, instrumentation, balancing, allocator, storage>::node_type* bst<key_type, value_type, comparison, instrumentation, balancing, allocator, storage>::_lower_bound(const T& x) const noexcept{
+    auto probe = instr.start(operation::find);
+    auto tmp {head};
+    node_type* bound {nullptr};
+    while(tmp) {
+        probe.visit();
+        // the key is less than x: the bound is on the right
+        if(comp(tmp->get_data().first, x)) {
+            tmp = tmp->get_right();
+        }
+        // candidate bound: look for a smaller one on the left
+        else {
+            bound = tmp;
+            tmp = tmp->get_left();
+        }
+    }
+    instr.stop(probe);
+    return bound;
+}
+
+
+template<typename key_type, typename value_type, typename comparison, typename instrumentation, typename balancing, typename allocator, typename storage>
+template<typename T>
+typename bst<key_type, value_type, comparison, instrumentation, balancing, allocator, storage>::node_type* bst<key_type, value_type, comparison, instrumentation, balancing, allocator, storage>::_upper_bound(const T& x) const noexcept{
+    auto probe = instr.start(operation::find);
+    auto tmp {head};
+    node_type* bound {nullptr};
+    while(tmp) {
+        probe.visit();
+        // candidate bound: look for a smaller one on the left
+        if(comp(x, tmp->get_data().first)) {
+            bound = tmp;
+            tmp = tmp->get_left();
+        }
+        // the key is not greater than x: the bound is on the right
+        else {
+            tmp = tmp->get_right();
+        }
+    }
+    instr.stop(probe);
+    return bound;
+}
 
-            auto stop = std::chrono::high_resolution_clock::now(); 
-            auto duration = std::chrono::duration_cast<std::chrono::microseconds>(stop - start);  
-            std::cout << "Time taken by find: " << duration.count() << " microseconds" << std::endl; 
 
+template<typename key_type, typename value_type, typename comparison, typename instrumentation, typename balancing, typename allocator, typename storage>
+typename bst<key_type, value_type, comparison, instrumentation, balancing, allocator, storage>::node_type* bst<key_type, value_type, comparison, instrumentation, balancing, allocator, storage>::_select(std::size_t k) const noexcept{
+    static_assert(has_subtree_size<typename balancing::augment>::value, 
+                  "select() requires the order_statistics balancing policy");
+    auto tmp {head};
+    while(tmp) {
+        auto left_size = tmp->get_left() ? tmp->get_left()->subtree_size : 0;
+        // the element is in the left subtree
+        if(k < left_size) {
+            tmp = tmp->get_left();
+        }
+        // the element is the current one
+        else if(k == left_size) {
             return tmp;
-        }  
+        }
+        // skip the left subtree and the current node
+        else {
+            k -= left_size + 1;
+            tmp = tmp->get_right();
+        }
     }
-    std::cout << "Node with key = "<< x  << " is not present" << std::endl;
-    auto stop = std::chrono::high_resolution_clock::now(); 
-    auto duration = std::chrono::duration_cast<std::chrono::microseconds>(stop - start);  
-    std::cout << "Time taken by find: " << duration.count() << " microseconds" << std::endl; 
     return nullptr;
 }
 
 
-template<typename key_type, typename value_type, typename comparison>
-void bst<key_type, value_type, comparison>::repopulate(node_type* child){
-    if(child->get_left()){
-        repopulate(child->get_left());
+template<typename key_type, typename value_type, typename comparison, typename instrumentation, typename balancing, typename allocator, typename storage>
+std::size_t bst<key_type, value_type, comparison, instrumentation, balancing, allocator, storage>::rank(const key_type& x) const noexcept{
+    static_assert(has_subtree_size<typename balancing::augment>::value, 
+                  "rank() requires the order_statistics balancing policy");
+    auto tmp {head};
+    std::size_t smaller {0};
+    while(tmp) {
+        // the current node and its left subtree are smaller than x
+        if(comp(tmp->get_data().first, x)) {
+            smaller += 1 + (tmp->get_left() ? tmp->get_left()->subtree_size : 0);
+            tmp = tmp->get_right();
+        }
+        else {
+            tmp = tmp->get_left();
+        }
+    }
+    return smaller;
+}
+
+
+template<typename key_type, typename value_type, typename comparison, typename instrumentation, typename balancing, typename allocator, typename storage>
+typename bst<key_type, value_type, comparison, instrumentation, balancing, allocator, storage>::node_type* bst<key_type, value_type, comparison, instrumentation, balancing, allocator, storage>::_detach(node_type* x) noexcept{
+    node_type* from {x->get_parent()};
+    node_type* replacement {nullptr};
+
+    if(!x->get_left() || !x->get_right()) {
+        // at most one child: it takes the place of x
+        replacement = x->get_left() ? x->get_left() : x->get_right();
+    }
+    else {
+        // two children: the successor (leftmost node of the right subtree) takes the place of x
+        auto succ {x->get_right()->leftiest()};
+        if(succ->get_parent() == x) {
+            from = succ;
+        }
+        else {
+            from = succ->get_parent();
+            from->set_left(succ->get_right());
+            if(from->get_left())
+                from->get_left()->set_parent(from);
+            succ->set_right(x->get_right());
+            succ->get_right()->set_parent(succ);
+        }
+        succ->set_left(x->get_left());
+        succ->get_left()->set_parent(succ);
+        // the successor inherits the augmentation of x together with its position
+        static_cast<typename balancing::augment&>(*succ) = *x;
+        replacement = succ;
+    }
+
+    if(replacement)
+        replacement->set_parent(x->get_parent());
+    replace_child(head, x->get_parent(), x, replacement);
+    --_size;
+    return from;
+}
+
+
+template<typename key_type, typename value_type, typename comparison, typename instrumentation, typename balancing, typename allocator, typename storage>
+typename bst<key_type, value_type, comparison, instrumentation, balancing, allocator, storage>::node_type* bst<key_type, value_type, comparison, instrumentation, balancing, allocator, storage>::unlink(node_type* x) noexcept{
+    auto from = _detach(x);
+    _destroy_node(x);
+    return from;
+}
+
+
+template<typename key_type, typename value_type, typename comparison, typename instrumentation, typename balancing, typename allocator, typename storage>
+typename bst<key_type, value_type, comparison, instrumentation, balancing, allocator, storage>::node_handle bst<key_type, value_type, comparison, instrumentation, balancing, allocator, storage>::_handle(node_type* x) noexcept{
+    _reset(x);
+    return node_handle{x, nodes.get_allocator()};
+}
+
+
+template<typename key_type, typename value_type, typename comparison, typename instrumentation, typename balancing, typename allocator, typename storage>
+typename bst<key_type, value_type, comparison, instrumentation, balancing, allocator, storage>::node_handle bst<key_type, value_type, comparison, instrumentation, balancing, allocator, storage>::extract(const_iterator pos) noexcept{
+    static_assert(storage_type::detachable, "extract() needs a storage whose nodes can leave the tree, e.g. linked_storage");
+    auto probe = instr.start(operation::erase);
+    auto x {pos.get_node()};
+    balancer.erased(head, _detach(x));
+    _rebalance_erased();
+    instr.stop(probe);
+    return _handle(x);
+}
+
+
+template<typename key_type, typename value_type, typename comparison, typename instrumentation, typename balancing, typename allocator, typename storage>
+template<typename T>
+typename bst<key_type, value_type, comparison, instrumentation, balancing, allocator, storage>::node_handle bst<key_type, value_type, comparison, instrumentation, balancing, allocator, storage>::_extract(const T& x){
+    static_assert(storage_type::detachable, "extract() needs a storage whose nodes can leave the tree, e.g. linked_storage");
+    auto probe = instr.start(operation::erase);
+    node_type* parent;
+    bool left;
+    auto found = _locate(x, parent, left, probe);
+    if(found) {
+        balancer.erased(head, _detach(found));
+        _rebalance_erased();
+    }
+    instr.stop(probe);
+    return found ? _handle(found) : node_handle{};
+}
+
+
+template<typename key_type, typename value_type, typename comparison, typename instrumentation, typename balancing, typename allocator, typename storage>
+typename bst<key_type, value_type, comparison, instrumentation, balancing, allocator, storage>::insert_return_type bst<key_type, value_type, comparison, instrumentation, balancing, allocator, storage>::insert(node_handle&& nh){
+    static_assert(storage_type::detachable, "insert(node_handle&&) needs a storage whose nodes can leave the tree, e.g. linked_storage");
+    if(nh.empty())
+        return insert_return_type{end(), false, node_handle{}};
+    auto probe = instr.start(operation::insert);
+    node_type* parent;
+    bool left;
+    auto found = _locate(nh.key(), parent, left, probe);
+    if(found) {
+        _accessed(found);
+        instr.stop(probe);
+        return insert_return_type{iterator{found}, false, std::move(nh)};
+    }
+    node_type* x;
+    if(nodes.get_allocator() == *nh.alloc) {
+        x = nh._release();
+    }
+    else {
+        // this tree cannot free a node of another allocator: the element is moved to a new node
+        x = _create_node(std::in_place, std::move(nh.key()), std::move(nh.mapped()));
+        nh._destroy();
+    }
+    _link(x, parent, left);
+    instr.stop(probe);
+    return insert_return_type{iterator{x}, true, node_handle{}};
+}
+
+
+template<typename key_type, typename value_type, typename comparison, typename instrumentation, typename balancing, typename allocator, typename storage>
+template<typename T>
+std::size_t bst<key_type, value_type, comparison, instrumentation, balancing, allocator, storage>::_erase(const T& x){
+    auto tmp {head};
+    if(!tmp){
+        throw std::logic_error{"In function erase(): there is not a root node"};
+    }
+    auto probe = instr.start(operation::erase);
+    while(tmp) {
+        probe.visit();
+        // go right
+        if(comp(tmp->get_data().first, x)) {
+            tmp = tmp->get_right();
+        }
+        // go left
+        else if(comp(x, tmp->get_data().first)){
+            tmp = tmp->get_left();
+        }
+        // this means that we have found that there already is a node
+        // with same key w.r.t. the one we wanted to erase
+        else {
+            balancer.erased(head, unlink(tmp));
+            _rebalance_erased();
+            instr.stop(probe);
+            return 1;
+        } 
+    }
+    instr.stop(probe);
+    return 0;
+}
+
+
+template<typename key_type, typename value_type, typename comparison, typename instrumentation, typename balancing, typename allocator, typename storage>
+typename bst<key_type, value_type, comparison, instrumentation, balancing, allocator, storage>::iterator bst<key_type, value_type, comparison, instrumentation, balancing, allocator, storage>::erase(const_iterator pos) noexcept{
+    auto probe = instr.start(operation::erase);
+    auto x {pos.get_node()};
+    // the successor keeps its identity when it is spliced in place of x, so it stays valid
+    iterator next {x};
+    ++next;
+    balancer.erased(head, unlink(x));
+    _rebalance_erased();
+    instr.stop(probe);
+    return next;
+}
+
+
+template<typename key_type, typename value_type, typename comparison, typename instrumentation, typename balancing, typename allocator, typename storage>
+void bst<key_type, value_type, comparison, instrumentation, balancing, allocator, storage>::balance(){
+    auto probe = instr.start(operation::balance);
+    _rebuild(head);
+    nodes.renumber(head);
+    _resized();
+    instr.stop(probe);
+}
+
+
+template<typename key_type, typename value_type, typename comparison, typename instrumentation, typename balancing, typename allocator, typename storage>
+void bst<key_type, value_type, comparison, instrumentation, balancing, allocator, storage>::balance(parallel_t p){
+    auto probe = instr.start(operation::balance);
+    std::vector<node_type*> order;
+    order.reserve(_size);
+    for(auto it = begin(); it != end(); ++it)
+        order.push_back(it.get_node());
+    head = _link(order.data(), order.size(), nullptr, p.workers(), p.grain);
+    nodes.renumber(head);
+    _resized();
+    instr.stop(probe);
+}
+
+
+template<typename key_type, typename value_type, typename comparison, typename instrumentation, typename balancing, typename allocator, typename storage>
+std::size_t bst<key_type, value_type, comparison, instrumentation, balancing, allocator, storage>::_rebuild(node_type* x) noexcept{
+    if(!x)
+        return 0;
+    auto parent {x->get_parent()};
+
+    // tree to vine: rotate right until no node of the spine has a left child, 
+    // tail is the last node already on the vine
+    std::size_t n {0};
+    node_type* root {nullptr};
+    node_type* tail {nullptr};
+    auto rest {x};
+    while(rest) {
+        if(auto tmp = rest->get_left()) {
+            rest->set_left(tmp->get_right());
+            tmp->set_right(rest);
+            rest = tmp;
+        }
+        else {
+            ++n;
+            if(tail)
+                tail->set_right(rest);
+            else
+                root = rest;
+            tail = rest;
+            rest = rest->get_right();
+        }
+    }
+
+    // vine to tree: the first pass places the nodes of the last, incomplete level, 
+    // the following ones halve the vine at each step
+    std::size_t full {1};
+    while(full <= n + 1)
+        full *= 2;
+    full = full / 2 - 1;
+    _compress(root, n - full);
+    for(auto m = full / 2; m > 0; m /= 2)
+        _compress(root, m);
+
+    replace_child(head, parent, x, root);
+    _relink(root, parent);
+    return n;
+}
+
+
+template<typename key_type, typename value_type, typename comparison, typename instrumentation, typename balancing, typename allocator, typename storage>
+void bst<key_type, value_type, comparison, instrumentation, balancing, allocator, storage>::_compress(node_type*& root, std::size_t count) noexcept{
+    node_type* prev {nullptr};
+    auto child {root};
+    for(std::size_t i = 0; i < count; ++i) {
+        auto grandchild {child->get_right()};
+        child->set_right(grandchild->get_left());
+        grandchild->set_left(child);
+        if(prev)
+            prev->set_right(grandchild);
+        else
+            root = grandchild;
+        prev = grandchild;
+        child = grandchild->get_right();
+    }
+}
+
+
+template<typename key_type, typename value_type, typename comparison, typename instrumentation, typename balancing, typename allocator, typename storage>
+void bst<key_type, value_type, comparison, instrumentation, balancing, allocator, storage>::_relink(node_type* x, node_type* parent) noexcept{
+    if(!x)
+        return;
+    x->set_parent(parent);
+    _relink(x->get_left(), x);
+    _relink(x->get_right(), x);
+    x->update();
+}
+
+
+template<typename key_type, typename value_type, typename comparison, typename instrumentation, typename balancing, typename allocator, typename storage>
+void bst<key_type, value_type, comparison, instrumentation, balancing, allocator, storage>::_expose(node_type* x, node_type*& l, node_type*& r) noexcept{
+    l = x->get_left();
+    r = x->get_right();
+    if(l)
+        l->set_parent(nullptr);
+    if(r)
+        r->set_parent(nullptr);
+    x->set_left(nullptr);
+    x->set_right(nullptr);
+    x->set_parent(nullptr);
+}
+
+
+template<typename key_type, typename value_type, typename comparison, typename instrumentation, typename balancing, typename allocator, typename storage>
+std::size_t bst<key_type, value_type, comparison, instrumentation, balancing, allocator, storage>::_size_of(node_type* x, node_type* y, std::size_t total) noexcept{
+    if constexpr (has_subtree_size<typename balancing::augment>::value) {
+        (void)y;
+        (void)total;
+        return x ? x->subtree_size : 0;
     }
-    if(child->get_right()){
-        repopulate(child->get_right());
+    else {
+        iterator a {x ? x->leftiest() : nullptr};
+        iterator b {y ? y->leftiest() : nullptr};
+        const iterator last {nullptr};
+        std::size_t n {0};
+        for(; a != last && b != last; ++a, ++b)
+            ++n;
+        return a == last ? n : total - n;
     }
-    const pair_type i = child->get_data();
-    std::cout << "Repopulating node with key: "<<i.first<< " value: "<<i.second<< std::endl;
+}
+
+
+template<typename key_type, typename value_type, typename comparison, typename instrumentation, typename balancing, typename allocator, typename storage>
+typename bst<key_type, value_type, comparison, instrumentation, balancing, allocator, storage>::node_type* bst<key_type, value_type, comparison, instrumentation, balancing, allocator, storage>::_join(node_type* l, node_type* k, node_type* r) noexcept{
+    if constexpr (_joinable)
+        return balancer.join(l, k, r);
+    else {
+        k->set_left(l);
+        k->set_right(r);
+        if(l)
+            l->set_parent(k);
+        if(r)
+            r->set_parent(k);
+        k->set_parent(nullptr);
+        k->update();
+        return k;
+    }
+}
 
-    emplace(i.first, i.second);
+
+template<typename key_type, typename value_type, typename comparison, typename instrumentation, typename balancing, typename allocator, typename storage>
+typename bst<key_type, value_type, comparison, instrumentation, balancing, allocator, storage>::node_type* bst<key_type, value_type, comparison, instrumentation, balancing, allocator, storage>::_join(node_type* l, node_type* r) noexcept{
+    if(!l)
+        return r;
+    if(!r)
+        return l;
+    if constexpr (_joinable) {
+        node_type* last {nullptr};
+        l = _split_last(l, last);
+        return _join(l, last, r);
+    }
+    else {
+        // r hangs from the rightmost node of l
+        auto x {l};
+        while(x->get_right())
+            x = x->get_right();
+        x->set_right(r);
+        r->set_parent(x);
+        _refresh(x);
+        return l;
+    }
 }
 
 
-template<typename key_type, typename value_type, typename comparison>
-void bst<key_type, value_type, comparison>::erase(const key_type& x){
-    auto start = std::chrono::high_resolution_clock::now();
-    auto tmp {head.get()};
-    if(tmp){
-        bool isPresent{false};
-        while(tmp) {
-            // go right
-            if(comp(tmp->get_data().first, x)) {
-                tmp = tmp->get_right();
+template<typename key_type, typename value_type, typename comparison, typename instrumentation, typename balancing, typename allocator, typename storage>
+typename bst<key_type, value_type, comparison, instrumentation, balancing, allocator, storage>::node_type* bst<key_type, value_type, comparison, instrumentation, balancing, allocator, storage>::_split_last(node_type* x, node_type*& last) noexcept{
+    node_type* l;
+    node_type* r;
+    _expose(x, l, r);
+    if(!r) {
+        last = x;
+        return l;
+    }
+    r = _split_last(r, last);
+    return _join(l, x, r);
+}
+
+
+template<typename key_type, typename value_type, typename comparison, typename instrumentation, typename balancing, typename allocator, typename storage>
+typename bst<key_type, value_type, comparison, instrumentation, balancing, allocator, storage>::node_type* bst<key_type, value_type, comparison, instrumentation, balancing, allocator, storage>::_split(node_type* x, const key_type& k, node_type*& l, node_type*& r) noexcept{
+    if constexpr (_joinable) {
+        // the parts cut off on the way down are joined back on the way up, O(log n) overall
+        if(!x) {
+            l = r = nullptr;
+            return nullptr;
+        }
+        node_type* xl;
+        node_type* xr;
+        _expose(x, xl, xr);
+        if(comp(k, _key(x))) {
+            auto found = _split(xl, k, l, r);
+            r = _join(r, x, xr);
+            return found;
+        }
+        if(comp(_key(x), k)) {
+            auto found = _split(xr, k, l, r);
+            l = _join(xl, x, l);
+            return found;
+        }
+        l = xl;
+        r = xr;
+        return x;
+    }
+    else {
+        // down the search path, every node goes with one of its subtrees to the tail of l or of r
+        node_type* found {nullptr};
+        node_type* l_tail {nullptr};
+        node_type* r_tail {nullptr};
+        l = r = nullptr;
+        while(x) {
+            if(comp(_key(x), k)) {
+                auto next {x->get_right()};
+                if(l_tail)
+                    l_tail->set_right(x);
+                else
+                    l = x;
+                x->set_parent(l_tail);
+                l_tail = x;
+                x = next;
             }
-            // go left
-            else if(comp(x, tmp->get_data().first)){
-                tmp = tmp->get_left();
+            else if(comp(k, _key(x))) {
+                auto next {x->get_left()};
+                if(r_tail)
+                    r_tail->set_left(x);
+                else
+                    r = x;
+                x->set_parent(r_tail);
+                r_tail = x;
+                x = next;
             }
-            // this means that we have found that there already is a node
-            // with same key w.r.t. the one we wanted to erase
             else {
-                isPresent = true;
-                bool hasRight{false};
-                bool hasLeft{false};
-                //save the children before erasing the father
-                auto rightChild = new node_type{nullptr};
-                auto leftChild = new node_type{nullptr};
-                if(tmp->get_right()){
-                     rightChild = new node_type{*(tmp->get_right())};
-                     hasRight = true;
-                }
+                found = x;
+                node_type* xl;
+                node_type* xr;
+                _expose(x, xl, xr);
+                if(l_tail)
+                    l_tail->set_right(xl);
+                else
+                    l = xl;
+                if(xl)
+                    xl->set_parent(l_tail);
+                if(r_tail)
+                    r_tail->set_left(xr);
+                else
+                    r = xr;
+                if(xr)
+                    xr->set_parent(r_tail);
+                _refresh(l_tail);
+                _refresh(r_tail);
+                return found;
+            }
+        }
+        if(l_tail)
+            l_tail->set_right(nullptr);
+        if(r_tail)
+            r_tail->set_left(nullptr);
+        _refresh(l_tail);
+        _refresh(r_tail);
+        return nullptr;
+    }
+}
 
-                if(tmp->get_left()){
-                     leftChild = new node_type{*(tmp->get_left())};
-                     hasLeft = true;
-                }
 
-                //erase
-                if(tmp != head.get()) {
-                    if(tmp->get_parent()->get_left() == tmp) {
-                        tmp->parent_node->left_child.release();
-                    }
-                    if(tmp->get_parent()->get_right() == tmp) {
-                        tmp->parent_node->right_child.release();
-                    }
-                }
-                else {
-                    std::cout << "deleting root node" << std::endl;
-                    clear();
-                }
+template<typename key_type, typename value_type, typename comparison, typename instrumentation, typename balancing, typename allocator, typename storage>
+typename bst<key_type, value_type, comparison, instrumentation, balancing, allocator, storage>::node_type* bst<key_type, value_type, comparison, instrumentation, balancing, allocator, storage>::_union(node_type* x, node_type* y, std::vector<node_type*>& dups) noexcept{
+    if(!x)
+        return y;
+    if(!y)
+        return x;
+    node_type* yl;
+    node_type* yr;
+    _expose(y, yl, yr);
+    node_type* xl;
+    node_type* xr;
+    auto found = _split(x, _key(y), xl, xr);
+    auto l = _union(xl, yl, dups);
+    if(found) {
+        dups.push_back(y);
+        y = found;
+    }
+    auto r = _union(xr, yr, dups);
+    return _join(l, y, r);
+}
+
+
+template<typename key_type, typename value_type, typename comparison, typename instrumentation, typename balancing, typename allocator, typename storage>
+typename bst<key_type, value_type, comparison, instrumentation, balancing, allocator, storage>::node_type* bst<key_type, value_type, comparison, instrumentation, balancing, allocator, storage>::_intersect(node_type* x, const node_type* y, std::size_t& kept) noexcept{
+    if(!x)
+        return nullptr;
+    if(!y) {
+        _destroy_subtree(x);
+        return nullptr;
+    }
+    node_type* xl;
+    node_type* xr;
+    auto found = _split(x, _key(y), xl, xr);
+    auto l = _intersect(xl, y->get_left(), kept);
+    auto r = _intersect(xr, y->get_right(), kept);
+    if(!found)
+        return _join(l, r);
+    ++kept;
+    return _join(l, found, r);
+}
+
+
+template<typename key_type, typename value_type, typename comparison, typename instrumentation, typename balancing, typename allocator, typename storage>
+typename bst<key_type, value_type, comparison, instrumentation, balancing, allocator, storage>::node_type* bst<key_type, value_type, comparison, instrumentation, balancing, allocator, storage>::_subtract(node_type* x, const node_type* y, std::size_t& removed) noexcept{
+    if(!x || !y)
+        return x;
+    node_type* xl;
+    node_type* xr;
+    auto found = _split(x, _key(y), xl, xr);
+    auto l = _subtract(xl, y->get_left(), removed);
+    auto r = _subtract(xr, y->get_right(), removed);
+    if(found) {
+        ++removed;
+        _destroy_node(found);
+    }
+    return _join(l, r);
+}
+
+
+template<typename key_type, typename value_type, typename comparison, typename instrumentation, typename balancing, typename allocator, typename storage>
+void bst<key_type, value_type, comparison, instrumentation, balancing, allocator, storage>::_collect(node_type* x, std::vector<node_type*>& out){
+    for(iterator it {x ? x->leftiest() : nullptr}; it != iterator{nullptr}; ++it)
+        out.push_back(it.get_node());
+}
+
+
+template<typename key_type, typename value_type, typename comparison, typename instrumentation, typename balancing, typename allocator, typename storage>
+bst<key_type, value_type, comparison, instrumentation, balancing, allocator, storage> bst<key_type, value_type, comparison, instrumentation, balancing, allocator, storage>::split(const key_type& x){
+    bst right {get_allocator()};
+    right.comp = comp;
+    right.balancer = balancer;
+    if(!nodes.shares_nodes(right.nodes)) {
+        // the moved elements are copied first, so that a failure leaves this tree unchanged
+        auto first = lower_bound(x);
+        std::size_t n {0};
+        for(auto it = first; it != end(); ++it)
+            ++n;
+        right._reserve(n);
+        right.head = right._build(first, n);
+        right._size = n;
+        node_type* l;
+        node_type* r;
+        if(auto found = _split(head, x, l, r))
+            r = _join(nullptr, found, r);
+        head = l;
+        _size -= n;
+        _destroy_subtree(r);
+        _resplit(right);
+        return bst{std::move(right)};
+    }
+    node_type* l;
+    node_type* r;
+    if(auto found = _split(head, x, l, r)) {
+        // the element with key x goes right, as the smallest
+        r = _join(nullptr, found, r);
+    }
+    const auto n = _size_of(r, l, _size);
+    head = l;
+    _size -= n;
+    right.head = r;
+    right._size = n;
+    _resplit(right);
+    return bst{std::move(right)};
+}
+
+
+template<typename key_type, typename value_type, typename comparison, typename instrumentation, typename balancing, typename allocator, typename storage>
+void bst<key_type, value_type, comparison, instrumentation, balancing, allocator, storage>::join(bst& other){
+    if(this == &other || !other.head)
+        return;
+    auto last {head};
+    while(last && last->get_right())
+        last = last->get_right();
+    if(last && !comp(_key(last), other.begin()->first))
+        throw std::invalid_argument{"In function join(): the keys of the two trees overlap"};
+    node_type* r;
+    const auto n {other._size};
+    if(nodes.shares_nodes(other.nodes)) {
+        r = other.head;
+        other.head = nullptr;
+        other._size = 0;
+    }
+    else {
+        _reserve(n);
+        auto first = other.cbegin();
+        r = _build(first, n);
+        other.clear();
+    }
+    head = _join(head, r);
+    _size += n;
+    if constexpr (_depth_bounded)
+        _rebuild(head);
+    _resized();
+    other._resized();
+}
 
-                tmp->parent_node = nullptr;
-                tmp->left_child.reset();
-                tmp->right_child.reset();
-                tmp = nullptr;
 
-                //insert all the "sub-tree" that starts from temp in order to keep the correct structure of bst
-                if(hasRight)
-                    repopulate(rightChild);
-                if(hasLeft)
-                    repopulate(leftChild);
-                
-                std::cout << "Erased node with key = "<< x << std::endl;
-            } 
+template<typename key_type, typename value_type, typename comparison, typename instrumentation, typename balancing, typename allocator, typename storage>
+void bst<key_type, value_type, comparison, instrumentation, balancing, allocator, storage>::merge(bst& other){
+    if(this == &other || !other.head)
+        return;
+    const auto m {other._size};
+    if constexpr (!_joinable) {
+        if(_few(m, _size)) {
+            _merge_each(other);
+            return;
         }
-        if(!isPresent){
-            std::cout << "Node with key = "<< x << " not found" <<std::endl;
+    }
+    const bool shared {nodes.shares_nodes(other.nodes)};
+    std::vector<node_type*> dups;
+    node_type* y;
+    if constexpr (_joinable) {
+        dups.reserve(std::min(_size, m));
+        if(shared)
+            y = other.head;
+        else {
+            // the elements of other are copied into this storage, other is fixed at the end
+            _reserve(m);
+            auto first = other.cbegin();
+            y = _build(first, m);
         }
-        auto stop = std::chrono::high_resolution_clock::now(); 
-        auto duration = std::chrono::duration_cast<std::chrono::microseconds>(stop - start);  
-        std::cout << "Time taken by erase: " << duration.count() << " microseconds" << std::endl; 
+        head = _union(head, y, dups);
     }
-    else{
-        throw std::logic_error{"In function erase(): there is not a root node"};
+    else {
+        // merge in order and relink perfectly balanced
+        std::vector<node_type*> a, b, merged;
+        a.reserve(_size);
+        b.reserve(m);
+        merged.reserve(_size + m);
+        dups.reserve(std::min(_size, m));
+        if(shared)
+            y = other.head;
+        else {
+            _reserve(m);
+            auto first = other.cbegin();
+            y = _build(first, m);
+        }
+        _collect(head, a);
+        _collect(y, b);
+        auto i = a.begin(), j = b.begin();
+        while(i != a.end() && j != b.end()) {
+            if(comp(_key(*i), _key(*j)))
+                merged.push_back(*i++);
+            else if(comp(_key(*j), _key(*i)))
+                merged.push_back(*j++);
+            else {
+                merged.push_back(*i++);
+                dups.push_back(*j++);
+            }
+        }
+        merged.insert(merged.end(), i, a.end());
+        merged.insert(merged.end(), j, b.end());
+        head = _link(merged.data(), merged.size(), nullptr, 1, 0);
     }
+    _size += m - dups.size();
+    auto rest = _link(dups.data(), dups.size(), nullptr, 1, 0);
+    _resized();
+    if(shared) {
+        other.head = rest;
+        other._size = dups.size();
+        other._resized();
+        return;
+    }
+    // other keeps the elements whose key was already here, the copies are dropped
+    std::size_t kept {0};
+    other.head = other._intersect(other.head, rest, kept);
+    other._size = kept;
+    other._resized();
+    _destroy_subtree(rest);
 }
 
 
-template<typename key_type, typename value_type, typename comparison>
-void bst<key_type, value_type, comparison>::balance(){
-    auto start = std::chrono::high_resolution_clock::now();
-    std::vector<pair_type> v{};
+template<typename key_type, typename value_type, typename comparison, typename instrumentation, typename balancing, typename allocator, typename storage>
+void bst<key_type, value_type, comparison, instrumentation, balancing, allocator, storage>::_merge_each(bst& other){
+    const bool shared {nodes.shares_nodes(other.nodes)};
+    std::vector<node_type*> b, dups, moved;
+    b.reserve(other._size);
+    _collect(other.head, b);
+    if(!shared)
+        _reserve(b.size());
+    for(auto y : b) {
+        auto probe = instr.start(operation::insert);
+        node_type* parent;
+        bool left;
+        if(_locate(_key(y), parent, left, probe))
+            dups.push_back(y);
+        else if(shared) {
+            _reset(y);
+            _link(y, parent, left);
+        }
+        else {
+            _link(_create_node(std::in_place, y->get_data()), parent, left);
+            moved.push_back(y);
+        }
+        instr.stop(probe);
+    }
+    // other keeps the elements whose key was already here, its moved nodes are gone or copied
+    for(auto y : moved)
+        other._destroy_node(y);
+    other.head = other._link(dups.data(), dups.size(), nullptr, 1, 0);
+    other._size = dups.size();
+    other._resized();
+}
 
-    for(iterator it = begin(); it != end(); ++it){
-        v.push_back(*it);
+
+template<typename key_type, typename value_type, typename comparison, typename instrumentation, typename balancing, typename allocator, typename storage>
+void bst<key_type, value_type, comparison, instrumentation, balancing, allocator, storage>::intersect(const bst& other){
+    if(this == &other)
+        return;
+    if constexpr (_joinable) {
+        std::size_t kept {0};
+        head = _intersect(head, other.head, kept);
+        _size = kept;
     }
-    clear();
-    insert_balanced_node(v);
-    auto stop = std::chrono::high_resolution_clock::now(); 
-    auto duration = std::chrono::duration_cast<std::chrono::microseconds>(stop - start);  
-    std::cout << "Time taken by balance: " << duration.count() << " microseconds" << std::endl;
+    else {
+        std::vector<node_type*> a, kept;
+        a.reserve(_size);
+        kept.reserve(std::min(_size, other._size));
+        _collect(head, a);
+        auto in_other = _member_of(other);
+        for(auto x : a) {
+            if(in_other(_key(x)))
+                kept.push_back(x);
+            else
+                _destroy_node(x);
+        }
+        head = _link(kept.data(), kept.size(), nullptr, 1, 0);
+        _size = kept.size();
+    }
+    _resized();
 }
 
 
+template<typename key_type, typename value_type, typename comparison, typename instrumentation, typename balancing, typename allocator, typename storage>
+void bst<key_type, value_type, comparison, instrumentation, balancing, allocator, storage>::subtract(const bst& other){
+    if(this == &other) {
+        clear();
+        return;
+    }
+    if constexpr (_joinable) {
+        std::size_t removed {0};
+        head = _subtract(head, other.head, removed);
+        _size -= removed;
+    }
+    else if(_few(other._size, _size)) {
+        // few keys to remove: each one is erased by a search
+        for(auto it = other.begin(); it != other.end() && head; ++it)
+            _erase(it->first);
+    }
+    else {
+        std::vector<node_type*> a, kept;
+        a.reserve(_size);
+        kept.reserve(_size);
+        _collect(head, a);
+        auto in_other = _member_of(other);
+        for(auto x : a) {
+            if(in_other(_key(x)))
+                _destroy_node(x);
+            else
+                kept.push_back(x);
+        }
+        head = _link(kept.data(), kept.size(), nullptr, 1, 0);
+        _size = kept.size();
+    }
+    _resized();
+}
 
-template<typename key_type, typename value_type, typename comparison>
-void bst<key_type, value_type, comparison>:: insert_balanced_node(std::vector<pair_type> vec){
-    
-    if(vec.size() > 0){
-        std::size_t const median = vec.size()/2;
-        emplace(vec[median].first, vec[median].second);
-        if(median > 0){
-            std::vector<pair_type> split_left(vec.begin(), vec.begin() + median);
-            std::vector<pair_type> split_right(vec.begin() + median + 1, vec.end());
-            insert_balanced_node(split_left);
-            insert_balanced_node(split_right);
+
+template<typename key_type, typename value_type, typename comparison, typename instrumentation, typename balancing, typename allocator, typename storage>
+void bst<key_type, value_type, comparison, instrumentation, balancing, allocator, storage>::save(std::ostream& os) const{
+    using key_traits = snapshot_traits<key_type>;
+    using value_traits = snapshot_traits<value_type>;
+    const auto header = snapshot_header::make(_size, key_traits::fixed_size, value_traits::fixed_size);
+    os.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    if(header.layout == snapshot_header::arrays) {
+        const char padding[alignof(key_type) + alignof(value_type)] {};
+        const auto keys_at = snapshot_header::keys_offset<key_type>();
+        os.write(padding, static_cast<std::streamsize>(keys_at - sizeof(header)));
+        // a single visit of the tree, the values wait in a buffer
+        std::vector<value_type> values;
+        values.reserve(_size);
+        for(const auto& x : *this) {
+            key_traits::write(os, x.first);
+            values.push_back(x.second);
         }
+        os.write(padding, static_cast<std::streamsize>(header.template values_offset<key_type, value_type>() - keys_at - _size * sizeof(key_type)));
+        for(const auto& v : values)
+            value_traits::write(os, v);
     }
-    else{
-        return;
-    }    
+    else {
+        for(const auto& x : *this) {
+            key_traits::write(os, x.first);
+            value_traits::write(os, x.second);
+        }
+    }
+    if(!os)
+        throw std::runtime_error{"In function save(): the snapshot could not be written"};
 }
- 
 
-template<typename key_type, typename value_type, typename comparison>
-void bst<key_type, value_type, comparison>::_print2D(node_type *root, int space) const noexcept{   
-    if (root == NULL)  
-        return;  
 
-    // Increase distance between levels  
-    space += COUNT;  
+template<typename key_type, typename value_type, typename comparison, typename instrumentation, typename balancing, typename allocator, typename storage>
+void bst<key_type, value_type, comparison, instrumentation, balancing, allocator, storage>::load(std::istream& is){
+    snapshot_reader<key_type, value_type> reader {is};
+    if(reader.size() > std::numeric_limits<std::size_t>::max())
+        throw std::runtime_error{"In function load(): the snapshot is too large"};
+    const auto n = static_cast<std::size_t>(reader.size());
+    clear();
+    _reserve(n);
+    head = _build(reader, n);
+    _size = n;
+    _resized();
+}
 
-    // Process right child first  
-    _print2D(root->get_right(), space);  
 
-    // Print current node after space  
-    // count  
-    std::cout<<std::endl;  
-    for (int i = COUNT; i < space; i++)  
-        std::cout<<" ";  
-    std::cout<< root->get_data().first <<"\n";  
+template<typename key_type, typename value_type, typename comparison, typename instrumentation, typename balancing, typename allocator, typename storage>
+void bst<key_type, value_type, comparison, instrumentation, balancing, allocator, storage>::_print2D(node_type *root, std::ostream& os) const noexcept{   
+    if (root == NULL)  
+        return;  
 
-    // Process left child  
-    _print2D(root->get_left(), space);  
-}  
+    // start from the rightmost node, one level is COUNT spaces
+    auto x {root};
+    int space {COUNT};
+    while(x->get_right()) {
+        x = x->get_right();
+        space += COUNT;
+    }
+
+    while(x) {
+        // Print current node after space  
+        // count  
+        os<<std::endl;  
+        for (int i = COUNT; i < space; i++)  
+            os<<" ";  
+        os<< x->get_data().first <<"\n";  
+
+        // Process left child: the previous node is the rightmost of the left subtree
+        if(x->get_left()) {
+            x = x->get_left();
+            space += COUNT;
+            while(x->get_right()) {
+                x = x->get_right();
+                space += COUNT;
+            }
+        }
+        // otherwise go up until we come from a right child
+        else {
+            auto child {x};
+            x = x->get_parent();
+            space -= COUNT;
+            while(x && x->get_left() == child) {
+                child = x;
+                x = x->get_parent();
+                space -= COUNT;
+            }
+        }
+    }
+}
@@ -0,0 +1,1026 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <exception>
+#include <functional> // std::less
+#include <iostream>
+#include <iterator>
+#include <memory> // std::unique_ptr
+#include <new>
+#include <stdexcept>
+#include <type_traits>
+#include <utility>
+
+
+/** \class uninitialized_array
+ *
+ * Raw storage for \p N objects of type T, that are constructed and destroyed one by one.
+ * Used by the nodes of the btree, whose slots are filled only up to their count.
+ */
+template <typename T, std::size_t N>
+class uninitialized_array {
+    /** \brief storage of the objects, as \private raw */
+    alignas(T) unsigned char raw[N * sizeof(T)];
+
+    public:
+
+    /** \brief object in the slot \p i , that must be constructed */
+    T& operator[](std::size_t i) noexcept {
+        return *std::launder(reinterpret_cast<T*>(raw + i * sizeof(T)));
+    }
+
+    /** \brief object in the slot \p i , that must be constructed */
+    const T& operator[](std::size_t i) const noexcept {
+        return *std::launder(reinterpret_cast<const T*>(raw + i * sizeof(T)));
+    }
+
+    /** \brief construct the object in the free slot \p i from \p args */
+    template <typename... Types>
+    void construct(std::size_t i, Types&&... args) {
+        ::new (static_cast<void*>(raw + i * sizeof(T))) T(std::forward<Types>(args)...);
+    }
+
+    /** \brief destroy the object in the slot \p i */
+    void destroy(std::size_t i) noexcept {
+        (*this)[i].~T();
+    }
+
+    /** \brief move the objects in [ \p first , \p last ) one slot right, the slot \p last must be free */
+    void shift_right(std::size_t first, std::size_t last) noexcept {
+        for(auto i = last; i > first; --i) {
+            construct(i, std::move((*this)[i - 1]));
+            destroy(i - 1);
+        }
+    }
+
+    /** \brief move the objects in [ \p first , \p last ) one slot left, the slot \p first - 1 must be free */
+    void shift_left(std::size_t first, std::size_t last) noexcept {
+        for(auto i = first; i < last; ++i) {
+            construct(i - 1, std::move((*this)[i]));
+            destroy(i);
+        }
+    }
+
+    /** \brief move the objects in [ \p first , \p last ) to the free slots of \p other starting at \p to */
+    void move_to(std::size_t first, std::size_t last, uninitialized_array& other, std::size_t to) noexcept {
+        for(auto i = first; i < last; ++i, ++to) {
+            other.construct(to, std::move((*this)[i]));
+            destroy(i);
+        }
+    }
+};
+
+
+template <typename key_type, std::size_t N>
+struct btree_inner;
+
+/** \class btree_node_base
+ *
+ * Part common to the leaves and the inner nodes of a btree: up to \p N sorted keys.
+ */
+template <typename key_type, std::size_t N>
+struct btree_node_base {
+    /** \brief parent node, nullptr for the root */
+    btree_inner<key_type, N>* parent {nullptr};
+    /** \brief number of keys */
+    std::size_t count {0};
+    /** \brief true for a leaf */
+    bool leaf;
+    /** \brief sorted keys */
+    uninitialized_array<key_type, N> keys;
+
+    explicit btree_node_base(bool is_leaf) noexcept: leaf{is_leaf} {}
+};
+
+/** \class btree_inner
+ *
+ * Inner node of a btree: count keys separate count + 1 children. The keys of the child i
+ * are not less than the key i - 1 and less than the key i.
+ */
+template <typename key_type, std::size_t N>
+struct btree_inner : btree_node_base<key_type, N> {
+    /** \brief children, nullptr past count */
+    btree_node_base<key_type, N>* children[N + 1] {};
+
+    btree_inner() noexcept: btree_node_base<key_type, N>{false} {}
+};
+
+/** \class btree_leaf
+ *
+ * Leaf of a btree: the elements, as keys and values in two parallel arrays,
+ * and the link to the next leaf for the in-order visit.
+ */
+template <typename key_type, typename mapped_type, std::size_t N>
+struct btree_leaf : btree_node_base<key_type, N> {
+    /** \brief values, the value i belongs to the key i */
+    uninitialized_array<mapped_type, N> values;
+    /** \brief next leaf in order, nullptr for the last one */
+    btree_leaf* next {nullptr};
+
+    btree_leaf() noexcept: btree_node_base<key_type, N>{true} {}
+};
+
+
+/** \class btree_iterator
+ *
+ * Forward iterator over the elements of a btree: a leaf and a position inside it.
+ * Keys and values are stored apart, so dereferencing gives a pair of references
+ * to the key and to the value, as in std::flat_map.
+ */
+template <typename key_type, typename mapped_type, typename leaf_type, bool constant>
+class btree_iterator {
+
+    template <typename, typename, typename, bool>
+    friend class btree_iterator;
+
+    /** \brief current leaf, as \private leaf */
+    std::conditional_t<constant, const leaf_type, leaf_type>* leaf {nullptr};
+
+    /** \brief position in the leaf, as \private pos */
+    std::size_t pos {0};
+
+    public:
+
+    using difference_type = std::ptrdiff_t;
+    using value_type = std::pair<const key_type, mapped_type>;
+    using reference = std::pair<const key_type&, std::conditional_t<constant, const mapped_type&, mapped_type&>>;
+    using iterator_category = std::forward_iterator_tag;
+
+    /** \brief pointer to a reference, returned by operator->() */
+    struct pointer {
+        reference ref;
+        const reference* operator->() const noexcept {
+            return &ref;
+        }
+    };
+
+    /** \brief Default btree_iterator Constructor, the end of any btree */
+    btree_iterator() = default;
+
+    /** \brief Custom btree_iterator Constructor
+     *
+     * Creates an iterator to the element \p p of the leaf \p l , the end if \p l is nullptr. */
+    btree_iterator(decltype(leaf) l, std::size_t p) noexcept: leaf{l}, pos{p} {}
+
+    /** \brief Converting btree_iterator Constructor, from a non-const iterator \p other */
+    template <bool other_constant, typename = std::enable_if_t<constant && !other_constant>>
+    btree_iterator(const btree_iterator<key_type, mapped_type, leaf_type, other_constant>& other) noexcept:
+    leaf{other.leaf}, pos{other.pos} {}
+
+    /** \brief current leaf */
+    decltype(leaf) get_leaf() const noexcept {
+        return leaf;
+    }
+
+    /** \brief position in the current leaf */
+    std::size_t get_pos() const noexcept {
+        return pos;
+    }
+
+    /** \brief star operator overload, the key and the value of the current element */
+    reference operator*() const noexcept {
+        return reference{leaf->keys[pos], leaf->values[pos]};
+    }
+
+    /** \brief -> overload */
+    pointer operator->() const noexcept {
+        return pointer{**this};
+    }
+
+    /** \brief ++ overload, as pre-increment */
+    btree_iterator& operator++() noexcept {
+        if(++pos == leaf->count) {
+            leaf = leaf->next;
+            pos = 0;
+        }
+        return *this;
+    }
+
+    /** \brief ++ overload, as post-increment with \p int */
+    btree_iterator operator++(int) noexcept {
+        auto update = *this;
+        ++(*this);
+        return update;
+    }
+
+    /** \brief == overload */
+    friend bool operator==(const btree_iterator& lhs, const btree_iterator& rhs) noexcept {
+        return lhs.leaf == rhs.leaf && lhs.pos == rhs.pos;
+    }
+
+    /** \brief \!= overload */
+    friend bool operator!=(const btree_iterator& lhs, const btree_iterator& rhs) noexcept {
+        return !(lhs == rhs);
+    }
+};
+
+
+/** \class btree
+ *
+ * Sorted map with the interface of bst, stored as a B+tree: every node holds between 16 and 64
+ * sorted keys (depending on their size), the elements are all in the leaves and the leaves are
+ * linked in order. A lookup costs one cache miss per level instead of one per binary node.
+ * The keys of a node are searched linearly, in a loop the compiler can vectorize, when they are
+ * arithmetic, and with a binary search otherwise.
+ * Insertions split the full nodes on the way down, erases borrow from or merge with a sibling,
+ * so the tree is always balanced. Both may invalidate all the iterators.
+ * Keys and values must be nothrow move constructible and assignable, since they are moved
+ * inside and across the nodes.
+ */
+template <typename key_type, typename value_type, typename comparison = std::less<key_type>>
+class btree {
+
+    static_assert(std::is_nothrow_move_constructible<key_type>::value && std::is_nothrow_move_assignable<key_type>::value,
+                  "btree keys must be nothrow movable");
+    static_assert(std::is_nothrow_move_constructible<value_type>::value,
+                  "btree values must be nothrow move constructible");
+
+    /** \brief maximum number of keys of a node, about 512 bytes of keys */
+    static constexpr std::size_t fanout {std::clamp<std::size_t>(512 / sizeof(key_type), 16, 64)};
+    /** \brief minimum number of elements of a leaf but the root */
+    static constexpr std::size_t min_leaf {fanout / 2};
+    /** \brief minimum number of keys of an inner node but the root */
+    static constexpr std::size_t min_inner {fanout / 2 - 1};
+
+    /** using declaration for pair_type. Represents a pair type of key and associated value. */
+    using pair_type = std::pair<const key_type, value_type>;
+    /** using declaration for node_base. Represents the part common to all the nodes. */
+    using node_base = btree_node_base<key_type, fanout>;
+    /** using declaration for inner_node. Represents a node with children. */
+    using inner_node = btree_inner<key_type, fanout>;
+    /** using declaration for leaf_node. Represents a node with elements. */
+    using leaf_node = btree_leaf<key_type, value_type, fanout>;
+
+    public:
+
+    /** using declaration for iterator. */
+    using iterator = btree_iterator<key_type, value_type, leaf_node, false>;
+    /** using declaration for const_iterator. */
+    using const_iterator = btree_iterator<key_type, value_type, leaf_node, true>;
+
+    private:
+
+    /** \brief root of the tree, as \private root */
+    node_base* root {nullptr};
+
+    /** \brief number of elements, as \private _size */
+    std::size_t _size {0};
+
+    /** \brief compare two keys, as \private comp */
+    comparison comp;
+
+    /** \brief number of keys of \p n less than \p x */
+    std::size_t _lower(const node_base* n, const key_type& x) const noexcept;
+
+    /** \brief number of keys of \p n not greater than \p x */
+    std::size_t _upper(const node_base* n, const key_type& x) const noexcept;
+
+    /** \brief leaf where the key \p x is, or would be */
+    leaf_node* _leaf_of(const key_type& x) const noexcept;
+
+    /** \brief iterator to the slot \p pos of \p leaf , moved to the next leaf if past the end */
+    static iterator _at(leaf_node* leaf, std::size_t pos) noexcept {
+        return pos < leaf->count ? iterator{leaf, pos} : iterator{leaf->next, 0};
+    }
+
+    /** \brief position of \p n among the children of its parent */
+    static std::size_t _child_index(const node_base* n) noexcept {
+        std::size_t i {0};
+        while(n->parent->children[i] != n)
+            ++i;
+        return i;
+    }
+
+    /** \brief split a full child
+     *
+     * Moves the upper half of the full child \p i of \p parent , which is not full, to a new node
+     * and adds the separating key to \p parent . */
+    void _split_child(inner_node* parent, std::size_t i);
+
+    /** \brief find the leaf of a new key
+     *
+     * Walks down to the leaf of \p x splitting the full nodes met, so that the leaf has a free slot. */
+    leaf_node* _descend_splitting(const key_type& x);
+
+    /** \brief internal try_emplace
+     *
+     * If the key \p k is not present, inserts it with the value constructed in place from \p args . */
+    template <typename K, typename... Types>
+    std::pair<iterator, bool> _try_emplace(K&& k, Types&&... args);
+
+    /** \brief remove an element
+     *
+     * Removes the element \p pos of \p leaf and restores the minimum size of the nodes.
+     * \returns an iterator to the following element */
+    iterator _erase_at(leaf_node* leaf, std::size_t pos) noexcept;
+
+    /** \brief fix a leaf with too few elements
+     *
+     * Borrows an element from a sibling or merges \p leaf with it.
+     * \p next is the iterator to the element following the erased one, kept valid. */
+    void _rebalance_leaf(leaf_node* leaf, iterator& next) noexcept;
+
+    /** \brief fix an inner node with too few keys
+     *
+     * Rotates a key through the parent from a sibling or merges \p n with it. */
+    void _rebalance_inner(inner_node* n) noexcept;
+
+    /** \brief remove a merged child
+     *
+     * Removes the child \p i of \p parent and the key before it, then fixes \p parent . */
+    void _remove_child(inner_node* parent, std::size_t i) noexcept;
+
+    /** \brief copy a subtree
+     *
+     * Copies the subtree rooted in \p n under \p parent , linking the copied leaves after \p last .
+     * Recursive, the depth is the height of the tree. */
+    node_base* _clone(const node_base* n, inner_node* parent, leaf_node*& last);
+
+    /** \brief destroy a subtree
+     *
+     * Destroys the elements and the nodes of the subtree rooted in \p n .
+     * Recursive, the depth is the height of the tree. */
+    static void _destroy(node_base* n) noexcept;
+
+    public:
+
+    /** \brief Default btree Constructor */
+    btree() = default;
+
+    /** \brief btree Destructor */
+    ~btree() noexcept {
+        clear();
+    }
+
+    /** \brief Move constructor */
+    btree(btree&& other) noexcept:
+    root{other.root}, _size{other._size}, comp{std::move(other.comp)} {
+        other.root = nullptr;
+        other._size = 0;
+    }
+
+    /** \brief Move assignment */
+    btree& operator=(btree&& other) noexcept {
+        if(this == &other)
+            return *this;
+        clear();
+        root = other.root;
+        _size = other._size;
+        comp = std::move(other.comp);
+        other.root = nullptr;
+        other._size = 0;
+        return *this;
+    }
+
+    /** \brief Deep-copy constructor */
+    btree(const btree& other):
+    _size{other._size}, comp{other.comp} {
+        if(!other.root)
+            return;
+        leaf_node* last {nullptr};
+        root = _clone(other.root, nullptr, last);
+    }
+
+    /** \brief Deep-copy assignment */
+    btree& operator=(const btree& x) {
+        auto tmp {x}; // copy ctor
+        *this = std::move(tmp); // move assignment
+        return *this;
+    }
+
+    /** \brief delete tree
+     *
+     * Destroys all the elements and the nodes. */
+    void clear() noexcept {
+        if(root)
+            _destroy(root);
+        root = nullptr;
+        _size = 0;
+    }
+
+    /** \brief begin of for loop with iterator, the first element of the leftmost leaf */
+    iterator begin() noexcept {
+        if(!root)
+            return end();
+        auto n {root};
+        while(!n->leaf)
+            n = static_cast<inner_node*>(n)->children[0];
+        return iterator{static_cast<leaf_node*>(n), 0};
+    }
+
+    /** \brief const begin of for loop with iterator */
+    const_iterator begin() const noexcept {
+        return const_cast<btree*>(this)->begin();
+    }
+
+    /** \brief const begin of for loop with iterator */
+    const_iterator cbegin() const noexcept {
+        return begin();
+    }
+
+    /** \brief end of for loop with iterator */
+    iterator end() noexcept {
+        return iterator{};
+    }
+
+    /** \brief const end of for loop with iterator */
+    const_iterator end() const noexcept {
+        return const_iterator{};
+    }
+
+    /** \brief const end of for loop with iterator */
+    const_iterator cend() const noexcept {
+        return const_iterator{};
+    }
+
+    /** \brief find element in tree
+     *
+     * Returns an iterator to the element with key \p x , end() if not present. */
+    iterator find(const key_type& x) noexcept {
+        auto leaf = _leaf_of(x);
+        if(!leaf)
+            return end();
+        auto pos = _lower(leaf, x);
+        if(pos == leaf->count || comp(x, leaf->keys[pos]))
+            return end();
+        return iterator{leaf, pos};
+    }
+
+    /** \brief find element in tree, const version */
+    const_iterator find(const key_type& x) const noexcept {
+        return const_cast<btree*>(this)->find(x);
+    }
+
+    /** \brief first element not less than key */
+    iterator lower_bound(const key_type& x) noexcept {
+        auto leaf = _leaf_of(x);
+        return leaf ? _at(leaf, _lower(leaf, x)) : end();
+    }
+
+    /** \brief first element not less than key, const version */
+    const_iterator lower_bound(const key_type& x) const noexcept {
+        return const_cast<btree*>(this)->lower_bound(x);
+    }
+
+    /** \brief first element greater than key */
+    iterator upper_bound(const key_type& x) noexcept {
+        auto leaf = _leaf_of(x);
+        return leaf ? _at(leaf, _upper(leaf, x)) : end();
+    }
+
+    /** \brief first element greater than key, const version */
+    const_iterator upper_bound(const key_type& x) const noexcept {
+        return const_cast<btree*>(this)->upper_bound(x);
+    }
+
+    /** \brief insert element by pair
+     *
+     * Inserts \p x if its key is not present. Returns an iterator to the element with that key
+     * and a bool that is true if the element has been inserted. */
+    std::pair<iterator, bool> insert(const pair_type& x) {
+        return _try_emplace(x.first, x.second);
+    }
+
+    /** \brief insert element by pair, with \p x passed as r-value */
+    std::pair<iterator, bool> insert(pair_type&& x) {
+        return _try_emplace(x.first, std::move(x.second));
+    }
+
+    /** \brief emplace element
+     *
+     * Constructs a pair from \p args and inserts it if its key is not present. */
+    template <class... Types>
+    std::pair<iterator, bool> emplace(Types&&... args) {
+        std::pair<key_type, value_type> x(std::forward<Types>(args)...);
+        return _try_emplace(std::move(x.first), std::move(x.second));
+    }
+
+    /** \brief emplace element if key is absent
+     *
+     * If the key \p k is not present, inserts it with the value constructed in place from \p args ,
+     * otherwise \p args are not moved from. */
+    template <class... Types>
+    std::pair<iterator, bool> try_emplace(const key_type& k, Types&&... args) {
+        return _try_emplace(k, std::forward<Types>(args)...);
+    }
+
+    /** \brief emplace element if key is absent, with the key \p k passed as r-value */
+    template <class... Types>
+    std::pair<iterator, bool> try_emplace(key_type&& k, Types&&... args) {
+        return _try_emplace(std::move(k), std::forward<Types>(args)...);
+    }
+
+    /** \brief insert or assign element
+     *
+     * If the key \p k is present, \p obj is assigned to its value, otherwise a new element is inserted. */
+    template <class M>
+    std::pair<iterator, bool> insert_or_assign(const key_type& k, M&& obj) {
+        auto res = _try_emplace(k, std::forward<M>(obj));
+        if(!res.second)
+            res.first->second = std::forward<M>(obj);
+        return res;
+    }
+
+    /** \brief insert or assign element, with the key \p k passed as r-value */
+    template <class M>
+    std::pair<iterator, bool> insert_or_assign(key_type&& k, M&& obj) {
+        auto res = _try_emplace(std::move(k), std::forward<M>(obj));
+        if(!res.second)
+            res.first->second = std::forward<M>(obj);
+        return res;
+    }
+
+    /** \brief erase element from tree
+     *
+     * Removes the element with key \p x , if present. Returns the number of elements removed
+     * (0 or 1). Throws if the tree is empty, as bst::erase(). */
+    std::size_t erase(const key_type& x) {
+        if(!root)
+            throw std::logic_error{"In function erase(): there is not a root node"};
+        auto it = find(x);
+        if(it == end())
+            return 0;
+        _erase_at(it.get_leaf(), it.get_pos());
+        return 1;
+    }
+
+    /** \brief erase element from tree by position
+     *
+     * Removes the element pointed by \p pos . Returns an iterator to the following element. */
+    iterator erase(const_iterator pos) noexcept {
+        return _erase_at(const_cast<leaf_node*>(pos.get_leaf()), pos.get_pos());
+    }
+
+    /** \brief erase element from tree by position, as erase(const_iterator) */
+    iterator erase(iterator pos) noexcept {
+        return _erase_at(pos.get_leaf(), pos.get_pos());
+    }
+
+    /** \brief erase range from tree
+     *
+     * Removes the elements in [ \p first , \p last ). Returns an iterator to the element that followed them. */
+    iterator erase(const_iterator first, const_iterator last) noexcept {
+        // last may move while erasing: count the elements first
+        auto n = static_cast<std::size_t>(std::distance(first, last));
+        iterator it {const_cast<leaf_node*>(first.get_leaf()), first.get_pos()};
+        while(n--)
+            it = erase(it);
+        return it;
+    }
+
+    /** \brief balance tree
+     *
+     * Nothing to do: a btree is always balanced. Provided for compatibility with bst. */
+    void balance() noexcept {}
+
+    /** \brief size of tree */
+    std::size_t size() const noexcept {
+        return _size;
+    }
+
+    /** \brief put-to
+     *
+     * Put-to operator, prints the elements in order as bst does. */
+    friend
+    std::ostream& operator<<(std::ostream& os, const btree& x) {
+        os << "Size of the tree is: " << x.size() << "\n";
+        for(const auto& el : x) {
+            os << "[ key=" << el.first <<" , value=" << el.second << " ] ";
+        }
+        os << std::endl;
+        return os;
+    }
+
+    /** \brief subscripting l-value
+     *
+     * Returns a reference to the value mapped to \p x , inserting a default one if not present. */
+    value_type& operator[](const key_type& x) {
+        return try_emplace(x).first->second;
+    }
+
+    /** \brief subscripting r-value */
+    value_type& operator[](key_type&& x) {
+        return try_emplace(std::move(x)).first->second;
+    }
+};
+
+
+template <typename key_type, typename value_type, typename comparison>
+std::size_t btree<key_type, value_type, comparison>::_lower(const node_base* n, const key_type& x) const noexcept {
+    if constexpr (std::is_arithmetic<key_type>::value) {
+        // branch-free count over the whole node
+        std::size_t less {0};
+        for(std::size_t i = 0; i < n->count; ++i)
+            less += comp(n->keys[i], x);
+        return less;
+    }
+    else {
+        std::size_t first {0}, len {n->count};
+        while(len) {
+            auto half = len / 2;
+            if(comp(n->keys[first + half], x)) {
+                first += half + 1;
+                len -= half + 1;
+            }
+            else {
+                len = half;
+            }
+        }
+        return first;
+    }
+}
+
+
+template <typename key_type, typename value_type, typename comparison>
+std::size_t btree<key_type, value_type, comparison>::_upper(const node_base* n, const key_type& x) const noexcept {
+    if constexpr (std::is_arithmetic<key_type>::value) {
+        std::size_t not_greater {0};
+        for(std::size_t i = 0; i < n->count; ++i)
+            not_greater += !comp(x, n->keys[i]);
+        return not_greater;
+    }
+    else {
+        std::size_t first {0}, len {n->count};
+        while(len) {
+            auto half = len / 2;
+            if(!comp(x, n->keys[first + half])) {
+                first += half + 1;
+                len -= half + 1;
+            }
+            else {
+                len = half;
+            }
+        }
+        return first;
+    }
+}
+
+
+template <typename key_type, typename value_type, typename comparison>
+typename btree<key_type, value_type, comparison>::leaf_node* btree<key_type, value_type, comparison>::_leaf_of(const key_type& x) const noexcept {
+    auto n {root};
+    if(!n)
+        return nullptr;
+    while(!n->leaf) {
+        auto inner = static_cast<inner_node*>(n);
+        n = inner->children[_upper(inner, x)];
+    }
+    return static_cast<leaf_node*>(n);
+}
+
+
+template <typename key_type, typename value_type, typename comparison>
+void btree<key_type, value_type, comparison>::_split_child(inner_node* parent, std::size_t i) {
+    auto child {parent->children[i]};
+    node_base* right;
+    if(child->leaf) {
+        // the first key of the right half is copied up
+        auto left = static_cast<leaf_node*>(child);
+        auto fresh = std::make_unique<leaf_node>();
+        const auto m = left->count / 2;
+        key_type separator {left->keys[m]};
+        // nothing can throw from here on
+        left->keys.move_to(m, left->count, fresh->keys, 0);
+        left->values.move_to(m, left->count, fresh->values, 0);
+        fresh->count = left->count - m;
+        left->count = m;
+        fresh->next = left->next;
+        left->next = fresh.get();
+        parent->keys.shift_right(i, parent->count);
+        parent->keys.construct(i, std::move(separator));
+        right = fresh.release();
+    }
+    else {
+        // the middle key is moved up
+        auto left = static_cast<inner_node*>(child);
+        auto fresh = std::make_unique<inner_node>();
+        const auto m = left->count / 2;
+        left->keys.move_to(m + 1, left->count, fresh->keys, 0);
+        for(std::size_t j = m + 1; j <= left->count; ++j) {
+            fresh->children[j - m - 1] = left->children[j];
+            fresh->children[j - m - 1]->parent = fresh.get();
+            left->children[j] = nullptr;
+        }
+        fresh->count = left->count - m - 1;
+        parent->keys.shift_right(i, parent->count);
+        parent->keys.construct(i, std::move(left->keys[m]));
+        left->keys.destroy(m);
+        left->count = m;
+        right = fresh.release();
+    }
+    for(auto j = parent->count + 1; j > i + 1; --j)
+        parent->children[j] = parent->children[j - 1];
+    parent->children[i + 1] = right;
+    right->parent = parent;
+    ++parent->count;
+}
+
+
+template <typename key_type, typename value_type, typename comparison>
+typename btree<key_type, value_type, comparison>::leaf_node* btree<key_type, value_type, comparison>::_descend_splitting(const key_type& x) {
+    if(!root)
+        root = new leaf_node;
+    // a full root is split under a new root: this is how the tree grows
+    if(root->count == fanout) {
+        auto top = new inner_node;
+        top->children[0] = root;
+        root->parent = top;
+        try {
+            _split_child(top, 0);
+        }
+        catch(...) {
+            root->parent = nullptr;
+            delete top;
+            throw;
+        }
+        root = top;
+    }
+    auto n {root};
+    while(!n->leaf) {
+        auto inner = static_cast<inner_node*>(n);
+        auto i = _upper(inner, x);
+        if(inner->children[i]->count == fanout) {
+            _split_child(inner, i);
+            if(!comp(x, inner->keys[i]))
+                ++i;
+        }
+        n = inner->children[i];
+    }
+    return static_cast<leaf_node*>(n);
+}
+
+
+template <typename key_type, typename value_type, typename comparison>
+template <typename K, typename... Types>
+std::pair<typename btree<key_type, value_type, comparison>::iterator, bool> btree<key_type, value_type, comparison>::_try_emplace(K&& k, Types&&... args) {
+    auto leaf = _descend_splitting(k);
+    auto pos = _lower(leaf, k);
+    if(pos < leaf->count && !comp(k, leaf->keys[pos]))
+        return std::make_pair(iterator{leaf, pos}, false);
+
+    leaf->keys.shift_right(pos, leaf->count);
+    leaf->values.shift_right(pos, leaf->count);
+    try {
+        leaf->keys.construct(pos, std::forward<K>(k));
+        try {
+            leaf->values.construct(pos, std::forward<Types>(args)...);
+        }
+        catch(...) {
+            leaf->keys.destroy(pos);
+            throw;
+        }
+    }
+    catch(...) {
+        leaf->keys.shift_left(pos + 1, leaf->count + 1);
+        leaf->values.shift_left(pos + 1, leaf->count + 1);
+        if(!_size) {
+            delete leaf;
+            root = nullptr;
+        }
+        throw;
+    }
+    ++leaf->count;
+    ++_size;
+    return std::make_pair(iterator{leaf, pos}, true);
+}
+
+
+template <typename key_type, typename value_type, typename comparison>
+typename btree<key_type, value_type, comparison>::iterator btree<key_type, value_type, comparison>::_erase_at(leaf_node* leaf, std::size_t pos) noexcept {
+    leaf->keys.destroy(pos);
+    leaf->values.destroy(pos);
+    leaf->keys.shift_left(pos + 1, leaf->count);
+    leaf->values.shift_left(pos + 1, leaf->count);
+    --leaf->count;
+    --_size;
+
+    auto next = _at(leaf, pos);
+    if(leaf == root) {
+        if(!leaf->count) {
+            delete leaf;
+            root = nullptr;
+        }
+    }
+    else if(leaf->count < min_leaf) {
+        _rebalance_leaf(leaf, next);
+    }
+    return next;
+}
+
+
+template <typename key_type, typename value_type, typename comparison>
+void btree<key_type, value_type, comparison>::_rebalance_leaf(leaf_node* leaf, iterator& next) noexcept {
+    auto parent {leaf->parent};
+    const auto i = _child_index(leaf);
+    auto left = i > 0 ? static_cast<leaf_node*>(parent->children[i - 1]) : nullptr;
+    auto right = i < parent->count ? static_cast<leaf_node*>(parent->children[i + 1]) : nullptr;
+
+    // borrow the last element of the left sibling, that becomes the separator.
+    // The separator is a copy: if copying throws, the leaf is left a little underfull
+    if(left && left->count > min_leaf) {
+        try {
+            key_type separator {left->keys[left->count - 1]};
+            leaf->keys.shift_right(0, leaf->count);
+            leaf->values.shift_right(0, leaf->count);
+            left->keys.move_to(left->count - 1, left->count, leaf->keys, 0);
+            left->values.move_to(left->count - 1, left->count, leaf->values, 0);
+            --left->count;
+            ++leaf->count;
+            parent->keys[i - 1] = std::move(separator);
+            if(next.get_leaf() == leaf)
+                next = iterator{leaf, next.get_pos() + 1};
+            return;
+        }
+        catch(...) {}
+    }
+    // borrow the first element of the right sibling, its second one becomes the separator
+    if(right && right->count > min_leaf) {
+        try {
+            key_type separator {right->keys[1]};
+            right->keys.move_to(0, 1, leaf->keys, leaf->count);
+            right->values.move_to(0, 1, leaf->values, leaf->count);
+            right->keys.shift_left(1, right->count);
+            right->values.shift_left(1, right->count);
+            --right->count;
+            ++leaf->count;
+            parent->keys[i] = std::move(separator);
+            if(next.get_leaf() == right)
+                next = iterator{leaf, leaf->count - 1};
+            return;
+        }
+        catch(...) {}
+    }
+
+    // merge with a sibling: the right leaf of the two is emptied and removed
+    leaf_node* into;
+    leaf_node* from;
+    std::size_t from_index;
+    if(left && left->count + leaf->count <= fanout) {
+        into = left;
+        from = leaf;
+        from_index = i;
+    }
+    else if(right && right->count + leaf->count <= fanout) {
+        into = leaf;
+        from = right;
+        from_index = i + 1;
+    }
+    else {
+        return;
+    }
+    if(next.get_leaf() == from)
+        next = iterator{into, into->count + next.get_pos()};
+    from->keys.move_to(0, from->count, into->keys, into->count);
+    from->values.move_to(0, from->count, into->values, into->count);
+    into->count += from->count;
+    into->next = from->next;
+    delete from;
+    _remove_child(parent, from_index);
+}
+
+
+template <typename key_type, typename value_type, typename comparison>
+void btree<key_type, value_type, comparison>::_remove_child(inner_node* parent, std::size_t i) noexcept {
+    parent->keys.destroy(i - 1);
+    parent->keys.shift_left(i, parent->count);
+    for(auto j = i; j < parent->count; ++j)
+        parent->children[j] = parent->children[j + 1];
+    parent->children[parent->count] = nullptr;
+    --parent->count;
+
+    if(parent == root) {
+        // an empty root leaves its only child as the new root: this is how the tree shrinks
+        if(!parent->count) {
+            root = parent->children[0];
+            root->parent = nullptr;
+            delete parent;
+        }
+    }
+    else if(parent->count < min_inner) {
+        _rebalance_inner(parent);
+    }
+}
+
+
+template <typename key_type, typename value_type, typename comparison>
+void btree<key_type, value_type, comparison>::_rebalance_inner(inner_node* n) noexcept {
+    auto parent {n->parent};
+    const auto i = _child_index(n);
+    auto left = i > 0 ? static_cast<inner_node*>(parent->children[i - 1]) : nullptr;
+    auto right = i < parent->count ? static_cast<inner_node*>(parent->children[i + 1]) : nullptr;
+
+    // rotate right: the separator comes down in front of n, the last key of left goes up
+    if(left && left->count > min_inner) {
+        n->keys.shift_right(0, n->count);
+        n->keys.construct(0, std::move(parent->keys[i - 1]));
+        for(auto j = n->count + 1; j > 0; --j)
+            n->children[j] = n->children[j - 1];
+        n->children[0] = left->children[left->count];
+        n->children[0]->parent = n;
+        left->children[left->count] = nullptr;
+        parent->keys[i - 1] = std::move(left->keys[left->count - 1]);
+        left->keys.destroy(left->count - 1);
+        --left->count;
+        ++n->count;
+        return;
+    }
+    // rotate left: the separator comes down at the end of n, the first key of right goes up
+    if(right && right->count > min_inner) {
+        n->keys.construct(n->count, std::move(parent->keys[i]));
+        n->children[n->count + 1] = right->children[0];
+        n->children[n->count + 1]->parent = n;
+        parent->keys[i] = std::move(right->keys[0]);
+        right->keys.destroy(0);
+        right->keys.shift_left(1, right->count);
+        for(std::size_t j = 0; j < right->count; ++j)
+            right->children[j] = right->children[j + 1];
+        right->children[right->count] = nullptr;
+        --right->count;
+        ++n->count;
+        return;
+    }
+
+    // merge with a sibling, the separator comes down between the two
+    auto into = left ? left : n;
+    auto from = left ? n : right;
+    const auto from_index = left ? i : i + 1;
+    into->keys.construct(into->count, std::move(parent->keys[from_index - 1]));
+    from->keys.move_to(0, from->count, into->keys, into->count + 1);
+    for(std::size_t j = 0; j <= from->count; ++j) {
+        into->children[into->count + 1 + j] = from->children[j];
+        from->children[j]->parent = into;
+    }
+    into->count += from->count + 1;
+    delete from;
+    _remove_child(parent, from_index);
+}
+
+
+template <typename key_type, typename value_type, typename comparison>
+typename btree<key_type, value_type, comparison>::node_base* btree<key_type, value_type, comparison>::_clone(const node_base* n, inner_node* parent, leaf_node*& last) {
+    if(n->leaf) {
+        auto from = static_cast<const leaf_node*>(n);
+        auto copy = new leaf_node;
+        copy->parent = parent;
+        try {
+            for(std::size_t i = 0; i < from->count; ++i) {
+                copy->keys.construct(i, from->keys[i]);
+                try {
+                    copy->values.construct(i, from->values[i]);
+                }
+                catch(...) {
+                    copy->keys.destroy(i);
+                    throw;
+                }
+                ++copy->count;
+            }
+        }
+        catch(...) {
+            _destroy(copy);
+            throw;
+        }
+        if(last)
+            last->next = copy;
+        last = copy;
+        return copy;
+    }
+
+    auto from = static_cast<const inner_node*>(n);
+    auto copy = new inner_node;
+    copy->parent = parent;
+    try {
+        for(std::size_t i = 0; i < from->count; ++i) {
+            copy->keys.construct(i, from->keys[i]);
+            ++copy->count;
+        }
+        for(std::size_t i = 0; i <= from->count; ++i)
+            copy->children[i] = _clone(from->children[i], copy, last);
+    }
+    catch(...) {
+        _destroy(copy);
+        throw;
+    }
+    return copy;
+}
+
+
+template <typename key_type, typename value_type, typename comparison>
+void btree<key_type, value_type, comparison>::_destroy(node_base* n) noexcept {
+    if(n->leaf) {
+        auto leaf = static_cast<leaf_node*>(n);
+        for(std::size_t i = 0; i < leaf->count; ++i) {
+            leaf->keys.destroy(i);
+            leaf->values.destroy(i);
+        }
+        delete leaf;
+        return;
+    }
+    auto inner = static_cast<inner_node*>(n);
+    for(std::size_t i = 0; i <= inner->count; ++i)
+        if(inner->children[i])
+            _destroy(inner->children[i]);
+    for(std::size_t i = 0; i < inner->count; ++i)
+        inner->keys.destroy(i);
+    delete inner;
+}
@@ -0,0 +1,523 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <functional> // std::less
+#include <mutex>
+#include <optional>
+#include <utility> // std::pair
+#include <vector>
+#include "epoch.hpp"
+#include "path_iterator.hpp"
+
+
+/** \class concurrent_node
+ *
+ * Node of a concurrent_bst. Once published a node is never modified:
+ * a writer copies the nodes it has to change and publishes the copies.
+ */
+template <typename pair_type>
+struct concurrent_node {
+    /** \brief node content */
+    pair_type data;
+    /** \brief left child */
+    concurrent_node* left {nullptr};
+    /** \brief right child */
+    concurrent_node* right {nullptr};
+    /** \brief height of the subtree rooted in the node, 1 for a leaf */
+    unsigned char height {1};
+    /** \brief true until the node is published, only the writer reads it */
+    bool fresh {true};
+
+    template <typename... Types>
+    explicit concurrent_node(std::in_place_t, Types&&... args): data(std::forward<Types>(args)...) {}
+};
+
+
+/** \class concurrent_bst
+ *
+ * Sorted map that many threads can read while one thread at a time writes it.
+ * The tree is an immutable AVL tree published through an atomic root. A writer copies the
+ * O(log n) nodes on the path it changes, publishes the new root with a single store and
+ * retires the replaced nodes to an epoch_domain, which frees them once no reader can see them.
+ * Readers never lock and never write shared memory: they pin the domain, load the root and
+ * walk an immutable version of the tree, so lookups and iteration are wait-free and their
+ * throughput scales with the number of cores. Writers are serialized by a mutex.
+ */
+template <typename key_type, typename value_type, typename comparison = std::less<key_type>>
+class concurrent_bst {
+
+    using pair_type = std::pair<const key_type, value_type>;
+    using node_type = concurrent_node<pair_type>;
+
+    /** \brief nodes created and replaced by a write */
+    struct write_batch {
+        std::vector<node_type*> fresh;
+        std::vector<node_type*> replaced;
+    };
+
+    /** \brief current version of the tree, as \private root */
+    std::atomic<node_type*> root {nullptr};
+
+    /** \brief number of elements of the current version, as \private _size */
+    std::atomic<std::size_t> _size {0};
+
+    /** \brief compare two keys, as \private comp */
+    comparison comp;
+
+    /** \brief serializes the writers, as \private writer */
+    std::mutex writer;
+
+    /** \brief reclamation of the replaced nodes, as \private epochs */
+    mutable epoch_domain epochs;
+
+    static unsigned char _height(const node_type* x) noexcept {
+        return x ? x->height : 0;
+    }
+
+    static void _update(node_type* x) noexcept {
+        auto l = _height(x->left), r = _height(x->right);
+        x->height = static_cast<unsigned char>((l > r ? l : r) + 1);
+    }
+
+    /** \brief new unpublished node constructed from \p args */
+    template <typename... Types>
+    static node_type* _make(write_batch& batch, Types&&... args);
+
+    /** \brief writable version of \p x
+     *
+     * \p x itself if created by this write, otherwise a copy of it, and \p x is replaced. */
+    static node_type* _own(node_type* x, write_batch& batch);
+
+    static node_type* _rotate_left(node_type* x, write_batch& batch);
+    static node_type* _rotate_right(node_type* x, write_batch& batch);
+
+    /** \brief restore the AVL invariant at the writable node \p x , returns the new subtree root */
+    static node_type* _rebalance(node_type* x, write_batch& batch);
+
+    /** \brief internal insert
+     *
+     * Returns the new root of the subtree \p x with the key \p k , \p inserted tells if it is new.
+     * An existing element is replaced by one with value \p v only if \p assign is true. */
+    template <typename V>
+    node_type* _insert(node_type* x, const key_type& k, V&& v, bool assign, bool& inserted, bool& changed,
+                       write_batch& batch);
+
+    /** \brief internal erase, returns the new root of the subtree \p x without the key \p k */
+    node_type* _erase(node_type* x, const key_type& k, bool& erased, write_batch& batch);
+
+    /** \brief remove the leftmost node of the subtree \p x , stored in \p min */
+    static node_type* _erase_min(node_type* x, node_type*& min, write_batch& batch);
+
+    /** \brief publish \p new_root , adjusting the size by \p delta , and retire the replaced nodes */
+    void _publish(node_type* new_root, std::ptrdiff_t delta, write_batch& batch);
+
+    /** \brief delete the nodes of an unpublished write */
+    static void _discard(write_batch& batch) noexcept {
+        for(auto x : batch.fresh)
+            delete x;
+    }
+
+    /** \brief delete the subtree rooted in \p x , reachable by no reader */
+    static void _destroy(node_type* x) noexcept;
+
+    public:
+
+    /** using declaration for const_iterator. Elements of a published version cannot be modified. */
+    using const_iterator = path_iterator<node_type, pair_type>;
+    /** using declaration for iterator */
+    using iterator = const_iterator;
+
+    /** \class snapshot
+     *
+     * A version of the tree, unchanged by later writes and kept alive until the snapshot is destroyed.
+     * A snapshot belongs to the thread that took it and should be short-lived, since the
+     * nodes replaced meanwhile cannot be freed. */
+    class snapshot {
+        friend class concurrent_bst;
+
+        /** \brief keeps the nodes alive, as \private guard */
+        epoch_domain::guard guard;
+
+        /** \brief root of the version, as \private root */
+        const node_type* root;
+
+        /** \brief compare two keys, as \private comp */
+        const comparison* comp;
+
+        snapshot(epoch_domain& epochs, const std::atomic<node_type*>& r, const comparison& c):
+        guard{epochs.pin()}, root{r.load(std::memory_order_seq_cst)}, comp{&c} {}
+
+        public:
+
+        /** \brief begin of for loop with iterator */
+        const_iterator begin() const noexcept {
+            return const_iterator{root};
+        }
+
+        /** \brief end of for loop with iterator */
+        const_iterator end() const noexcept {
+            return const_iterator{};
+        }
+
+        /** \brief check if the version is empty */
+        bool empty() const noexcept {
+            return !root;
+        }
+
+        /** \brief find element by key
+         *
+         * Returns an iterator to the element with key \p x , end() if not present. */
+        const_iterator find(const key_type& x) const {
+            auto it = lower_bound(x);
+            if(it != end() && (*comp)(x, it->first))
+                return end();
+            return it;
+        }
+
+        /** \brief first element not less than key
+         *
+         * Returns an iterator to the first element whose key is not less than \p x , end() if none. */
+        const_iterator lower_bound(const key_type& x) const {
+            return const_iterator{root, x, *comp};
+        }
+    };
+
+    /** \brief Default concurrent_bst Constructor */
+    concurrent_bst() = default;
+
+    /** \brief Custom concurrent_bst Constructor, with the comparison \p c */
+    explicit concurrent_bst(const comparison& c): comp{c} {}
+
+    /** \brief a concurrent tree is neither copied nor moved, take a snapshot to read it */
+    concurrent_bst(const concurrent_bst&) = delete;
+    concurrent_bst& operator=(const concurrent_bst&) = delete;
+
+    /** \brief concurrent_bst Destructor, no thread may be using the tree */
+    ~concurrent_bst() noexcept {
+        _destroy(root.load(std::memory_order_relaxed));
+    }
+
+    /** \brief take a snapshot of the current version, wait-free */
+    snapshot read() const {
+        return snapshot{epochs, root, comp};
+    }
+
+    /** \brief number of elements of the current version */
+    std::size_t size() const noexcept {
+        return _size.load(std::memory_order_acquire);
+    }
+
+    /** \brief check if the key \p x is in the current version, wait-free */
+    bool contains(const key_type& x) const {
+        auto s = read();
+        return s.find(x) != s.end();
+    }
+
+    /** \brief copy of the element with key \p x in the current version, wait-free */
+    std::optional<pair_type> get(const key_type& x) const {
+        auto s = read();
+        auto it = s.find(x);
+        if(it == s.end())
+            return std::nullopt;
+        return *it;
+    }
+
+    /** \brief insert a new element
+     *
+     * Inserts \p x if its key is not present, returns true if inserted. */
+    bool insert(const pair_type& x) {
+        return _put(x.first, x.second, false);
+    }
+
+    /** \brief insert or assign an element
+     *
+     * Inserts an element with key \p k and value \p v , or replaces the value of the existing one.
+     * Returns true if inserted, false if assigned. */
+    template <typename V>
+    bool insert_or_assign(const key_type& k, V&& v) {
+        return _put(k, std::forward<V>(v), true);
+    }
+
+    /** \brief erase element by key, returns true if \p x was present */
+    bool erase(const key_type& x);
+
+    /** \brief erase all the elements */
+    void clear();
+
+    /** \brief free now the replaced nodes that no reader can see */
+    void reclaim() noexcept {
+        epochs.reclaim();
+    }
+
+    private:
+
+    /** \brief insert, or assign if \p assign is true, under the writer lock */
+    template <typename V>
+    bool _put(const key_type& k, V&& v, bool assign);
+};
+
+
+template <typename key_type, typename value_type, typename comparison>
+template <typename... Types>
+typename concurrent_bst<key_type, value_type, comparison>::node_type*
+concurrent_bst<key_type, value_type, comparison>::_make(write_batch& batch, Types&&... args) {
+    batch.fresh.reserve(batch.fresh.size() + 1);
+    auto x = new node_type{std::in_place, std::forward<Types>(args)...};
+    batch.fresh.push_back(x);
+    return x;
+}
+
+
+template <typename key_type, typename value_type, typename comparison>
+typename concurrent_bst<key_type, value_type, comparison>::node_type*
+concurrent_bst<key_type, value_type, comparison>::_own(node_type* x, write_batch& batch) {
+    if(x->fresh)
+        return x;
+    batch.replaced.reserve(batch.replaced.size() + 1);
+    auto copy = _make(batch, x->data);
+    copy->left = x->left;
+    copy->right = x->right;
+    copy->height = x->height;
+    batch.replaced.push_back(x);
+    return copy;
+}
+
+
+template <typename key_type, typename value_type, typename comparison>
+typename concurrent_bst<key_type, value_type, comparison>::node_type*
+concurrent_bst<key_type, value_type, comparison>::_rotate_left(node_type* x, write_batch& batch) {
+    auto y = _own(x->right, batch);
+    x->right = y->left;
+    y->left = x;
+    _update(x);
+    _update(y);
+    return y;
+}
+
+
+template <typename key_type, typename value_type, typename comparison>
+typename concurrent_bst<key_type, value_type, comparison>::node_type*
+concurrent_bst<key_type, value_type, comparison>::_rotate_right(node_type* x, write_batch& batch) {
+    auto y = _own(x->left, batch);
+    x->left = y->right;
+    y->right = x;
+    _update(x);
+    _update(y);
+    return y;
+}
+
+
+template <typename key_type, typename value_type, typename comparison>
+typename concurrent_bst<key_type, value_type, comparison>::node_type*
+concurrent_bst<key_type, value_type, comparison>::_rebalance(node_type* x, write_batch& batch) {
+    _update(x);
+    const int factor {_height(x->left) - _height(x->right)};
+    if(factor > 1) {
+        if(_height(x->left->left) < _height(x->left->right))
+            x->left = _rotate_left(_own(x->left, batch), batch);
+        return _rotate_right(x, batch);
+    }
+    if(factor < -1) {
+        if(_height(x->right->right) < _height(x->right->left))
+            x->right = _rotate_right(_own(x->right, batch), batch);
+        return _rotate_left(x, batch);
+    }
+    return x;
+}
+
+
+template <typename key_type, typename value_type, typename comparison>
+template <typename V>
+typename concurrent_bst<key_type, value_type, comparison>::node_type*
+concurrent_bst<key_type, value_type, comparison>::_insert(node_type* x, const key_type& k, V&& v, bool assign,
+                                                          bool& inserted, bool& changed, write_batch& batch) {
+    if(!x) {
+        inserted = changed = true;
+        return _make(batch, k, std::forward<V>(v));
+    }
+    if(comp(k, x->data.first)) {
+        auto l = _insert(x->left, k, std::forward<V>(v), assign, inserted, changed, batch);
+        if(!changed)
+            return x;
+        x = _own(x, batch);
+        x->left = l;
+        return _rebalance(x, batch);
+    }
+    if(comp(x->data.first, k)) {
+        auto r = _insert(x->right, k, std::forward<V>(v), assign, inserted, changed, batch);
+        if(!changed)
+            return x;
+        x = _own(x, batch);
+        x->right = r;
+        return _rebalance(x, batch);
+    }
+    if(!assign)
+        return x;
+    // the key is const: a new node takes the place of x
+    batch.replaced.reserve(batch.replaced.size() + 1);
+    auto y = _make(batch, x->data.first, std::forward<V>(v));
+    y->left = x->left;
+    y->right = x->right;
+    y->height = x->height;
+    batch.replaced.push_back(x);
+    changed = true;
+    return y;
+}
+
+
+template <typename key_type, typename value_type, typename comparison>
+typename concurrent_bst<key_type, value_type, comparison>::node_type*
+concurrent_bst<key_type, value_type, comparison>::_erase_min(node_type* x, node_type*& min, write_batch& batch) {
+    if(!x->left) {
+        batch.replaced.reserve(batch.replaced.size() + 1);
+        min = x;
+        batch.replaced.push_back(x);
+        return x->right;
+    }
+    auto l = _erase_min(x->left, min, batch);
+    x = _own(x, batch);
+    x->left = l;
+    return _rebalance(x, batch);
+}
+
+
+template <typename key_type, typename value_type, typename comparison>
+typename concurrent_bst<key_type, value_type, comparison>::node_type*
+concurrent_bst<key_type, value_type, comparison>::_erase(node_type* x, const key_type& k, bool& erased,
+                                                         write_batch& batch) {
+    if(!x)
+        return nullptr;
+    if(comp(k, x->data.first)) {
+        auto l = _erase(x->left, k, erased, batch);
+        if(!erased)
+            return x;
+        x = _own(x, batch);
+        x->left = l;
+        return _rebalance(x, batch);
+    }
+    if(comp(x->data.first, k)) {
+        auto r = _erase(x->right, k, erased, batch);
+        if(!erased)
+            return x;
+        x = _own(x, batch);
+        x->right = r;
+        return _rebalance(x, batch);
+    }
+    erased = true;
+    batch.replaced.reserve(batch.replaced.size() + 1);
+    batch.replaced.push_back(x);
+    if(!x->left)
+        return x->right;
+    if(!x->right)
+        return x->left;
+    // the successor takes the place of x, copied since its old version may still be read
+    node_type* min {nullptr};
+    auto r = _erase_min(x->right, min, batch);
+    auto y = _make(batch, min->data);
+    y->left = x->left;
+    y->right = r;
+    return _rebalance(y, batch);
+}
+
+
+template <typename key_type, typename value_type, typename comparison>
+void concurrent_bst<key_type, value_type, comparison>::_publish(node_type* new_root, std::ptrdiff_t delta,
+                                                                write_batch& batch) {
+    for(auto x : batch.fresh)
+        x->fresh = false;
+    root.store(new_root, std::memory_order_seq_cst);
+    _size.store(static_cast<std::size_t>(static_cast<std::ptrdiff_t>(_size.load(std::memory_order_relaxed)) + delta),
+                std::memory_order_release);
+    // a node the domain cannot take now is leaked rather than freed under a reader
+    try {
+        for(auto x : batch.replaced)
+            epochs.retire(x);
+    }
+    catch(...) {}
+}
+
+
+template <typename key_type, typename value_type, typename comparison>
+void concurrent_bst<key_type, value_type, comparison>::_destroy(node_type* x) noexcept {
+    // iterative: the right spine is followed in place and the left subtrees are rotated onto it
+    while(x) {
+        if(x->left) {
+            auto l = x->left;
+            x->left = l->right;
+            l->right = x;
+            x = l;
+        }
+        else {
+            auto r = x->right;
+            delete x;
+            x = r;
+        }
+    }
+}
+
+
+template <typename key_type, typename value_type, typename comparison>
+template <typename V>
+bool concurrent_bst<key_type, value_type, comparison>::_put(const key_type& k, V&& v, bool assign) {
+    std::lock_guard<std::mutex> lock {writer};
+    write_batch batch;
+    bool inserted {false}, changed {false};
+    node_type* new_root;
+    try {
+        new_root = _insert(root.load(std::memory_order_relaxed), k, std::forward<V>(v), assign, inserted, changed, batch);
+    }
+    catch(...) {
+        _discard(batch);
+        throw;
+    }
+    if(changed)
+        _publish(new_root, inserted ? 1 : 0, batch);
+    return inserted;
+}
+
+
+template <typename key_type, typename value_type, typename comparison>
+bool concurrent_bst<key_type, value_type, comparison>::erase(const key_type& x) {
+    std::lock_guard<std::mutex> lock {writer};
+    write_batch batch;
+    bool erased {false};
+    node_type* new_root;
+    try {
+        new_root = _erase(root.load(std::memory_order_relaxed), x, erased, batch);
+    }
+    catch(...) {
+        _discard(batch);
+        throw;
+    }
+    if(erased)
+        _publish(new_root, -1, batch);
+    return erased;
+}
+
+
+template <typename key_type, typename value_type, typename comparison>
+void concurrent_bst<key_type, value_type, comparison>::clear() {
+    std::lock_guard<std::mutex> lock {writer};
+    write_batch batch;
+    // every node of the old version is replaced
+    std::vector<node_type*> stack;
+    if(auto r = root.load(std::memory_order_relaxed))
+        stack.push_back(r);
+    while(!stack.empty()) {
+        auto x = stack.back();
+        stack.pop_back();
+        batch.replaced.push_back(x);
+        if(x->left)
+            stack.push_back(x->left);
+        if(x->right)
+            stack.push_back(x->right);
+    }
+    root.store(nullptr, std::memory_order_seq_cst);
+    _size.store(0, std::memory_order_release);
+    try {
+        for(auto x : batch.replaced)
+            epochs.retire(x);
+    }
+    catch(...) {}
+}
@@ -0,0 +1,243 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory> // std::unique_ptr
+#include <mutex>
+#include <stdexcept>
+#include <vector>
+
+
+/** \class thread_registry
+ *
+ * Gives every running thread a small index, used to find its reader slot in an epoch_domain.
+ * An index is taken the first time a thread asks for it and given back when the thread exits,
+ * so that at most max_threads threads can read concurrent trees at the same time.
+ */
+class thread_registry {
+    public:
+
+    /** \brief maximum number of threads that hold an index at the same time */
+    static constexpr std::size_t max_threads {256};
+
+    /** \brief index of the calling thread */
+    static std::size_t index() {
+        thread_local holder h;
+        return h.id;
+    }
+
+    /** \brief number of indices handed out so far, all the indices in use are below it */
+    static std::size_t used() noexcept {
+        return instance().next.load(std::memory_order_acquire);
+    }
+
+    private:
+
+    /** \brief index owned by a thread, released when the thread exits */
+    struct holder {
+        std::size_t id;
+        holder(): id{instance().acquire()} {}
+        ~holder() noexcept {
+            instance().release(id);
+        }
+    };
+
+    /** \brief guards the free indices, as \private m */
+    std::mutex m;
+
+    /** \brief indices released by threads that exited, as \private free */
+    std::vector<std::size_t> free;
+
+    /** \brief first index never handed out, as \private next */
+    std::atomic<std::size_t> next {0};
+
+    static thread_registry& instance() noexcept {
+        static thread_registry registry;
+        return registry;
+    }
+
+    std::size_t acquire() {
+        std::lock_guard<std::mutex> lock {m};
+        if(!free.empty()) {
+            auto id = free.back();
+            free.pop_back();
+            return id;
+        }
+        if(next.load(std::memory_order_relaxed) == max_threads)
+            throw std::runtime_error{"In function index(): too many threads"};
+        return next.fetch_add(1, std::memory_order_acq_rel);
+    }
+
+    void release(std::size_t id) noexcept {
+        std::lock_guard<std::mutex> lock {m};
+        try {
+            free.push_back(id);
+        }
+        catch(...) {} // the index is lost, the registry stays consistent
+    }
+};
+
+
+/** \class epoch_domain
+ *
+ * Epoch-based reclamation of the memory shared by readers and writers.
+ * A reader pins the domain for the duration of its visit, publishing the current epoch in its
+ * own slot: it is a single store, so pinning never waits. A writer that unlinks an object
+ * retires it, tagged with the epoch of the unlinking, and the object is freed only once no
+ * reader is pinned at that epoch or an older one, since only those can still see it.
+ * Slots are one per thread and one per cache line, so readers never write to shared lines.
+ */
+class epoch_domain {
+
+    /** \brief reader slot of a thread */
+    struct alignas(64) slot {
+        /** \brief epoch at which the thread pinned the domain, 0 if it is not pinned */
+        std::atomic<std::uint64_t> epoch {0};
+        /** \brief nesting of the guards of the thread, written only by the owner */
+        std::uint32_t depth {0};
+    };
+
+    /** \brief object waiting to be freed */
+    struct retired {
+        void* object;
+        void (*destroy)(void*) noexcept;
+        std::uint64_t epoch;
+    };
+
+    /** \brief objects retired between two reclaims */
+    static constexpr std::size_t reclaim_threshold {128};
+
+    /** \brief current epoch, as \private global */
+    std::atomic<std::uint64_t> global {1};
+
+    /** \brief reader slots, one per thread index, as \private slots */
+    std::unique_ptr<slot[]> slots {new slot[thread_registry::max_threads]};
+
+    /** \brief guards the retired objects, as \private limbo_mutex */
+    std::mutex limbo_mutex;
+
+    /** \brief retired objects not freed yet, as \private limbo */
+    std::vector<retired> limbo;
+
+    /** \brief size of limbo that triggers the next reclaim, as \private next_reclaim */
+    std::size_t next_reclaim {reclaim_threshold};
+
+    /** \brief free the retired objects that no reader can see, limbo_mutex must be held */
+    void _reclaim() noexcept;
+
+    public:
+
+    /** \class guard
+     *
+     * Keeps the domain pinned by the calling thread while alive.
+     * Guards can be nested and moved, but not passed to another thread. */
+    class guard {
+        /** \brief slot of the owning thread, as \private s */
+        slot* s {nullptr};
+
+        public:
+
+        /** \brief Custom guard Constructor, pins the slot \p x at the epoch \p e */
+        guard(slot& x, std::uint64_t e) noexcept: s{&x} {
+            if(s->depth++ == 0)
+                s->epoch.store(e, std::memory_order_seq_cst);
+        }
+
+        guard(const guard&) = delete;
+        guard& operator=(const guard&) = delete;
+
+        /** \brief Move constructor, \p other is left unpinned */
+        guard(guard&& other) noexcept: s{other.s} {
+            other.s = nullptr;
+        }
+
+        /** \brief Move assignment */
+        guard& operator=(guard&& other) noexcept {
+            if(this != &other) {
+                unpin();
+                s = other.s;
+                other.s = nullptr;
+            }
+            return *this;
+        }
+
+        /** \brief guard Destructor, unpins */
+        ~guard() noexcept {
+            unpin();
+        }
+
+        /** \brief unpin the domain before the end of the guard */
+        void unpin() noexcept {
+            if(s && --s->depth == 0)
+                s->epoch.store(0, std::memory_order_release);
+            s = nullptr;
+        }
+    };
+
+    epoch_domain() = default;
+    epoch_domain(const epoch_domain&) = delete;
+    epoch_domain& operator=(const epoch_domain&) = delete;
+
+    /** \brief epoch_domain Destructor
+     *
+     * Frees all the retired objects: no reader may be pinned any more. */
+    ~epoch_domain() noexcept {
+        for(auto& r : limbo)
+            r.destroy(r.object);
+    }
+
+    /** \brief pin the domain
+     *
+     * The objects reachable after this call are not freed until the returned guard is destroyed. */
+    guard pin() {
+        return guard{slots[thread_registry::index()], global.load(std::memory_order_seq_cst)};
+    }
+
+    /** \brief retire an object
+     *
+     * \p x has been unlinked by a writer and is deleted once no reader can see it.
+     * Thread-safe: several writers can retire at the same time. */
+    template <typename T>
+    void retire(T* x) {
+        std::lock_guard<std::mutex> lock {limbo_mutex};
+        limbo.push_back(retired{x, [](void* p) noexcept { delete static_cast<T*>(p); },
+                                global.fetch_add(1, std::memory_order_seq_cst)});
+        if(limbo.size() >= next_reclaim)
+            _reclaim();
+    }
+
+    /** \brief free now the retired objects that no reader can see */
+    void reclaim() noexcept {
+        std::lock_guard<std::mutex> lock {limbo_mutex};
+        _reclaim();
+    }
+
+    /** \brief number of retired objects not freed yet */
+    std::size_t pending() noexcept {
+        std::lock_guard<std::mutex> lock {limbo_mutex};
+        return limbo.size();
+    }
+};
+
+
+inline void epoch_domain::_reclaim() noexcept {
+    // the oldest epoch a reader is pinned at: objects retired before it are unreachable
+    auto oldest = global.load(std::memory_order_seq_cst);
+    const auto used = thread_registry::used();
+    for(std::size_t i = 0; i < used; ++i) {
+        auto e = slots[i].epoch.load(std::memory_order_seq_cst);
+        if(e && e < oldest)
+            oldest = e;
+    }
+    std::size_t kept {0};
+    for(auto& r : limbo) {
+        if(r.epoch < oldest)
+            r.destroy(r.object);
+        else
+            limbo[kept++] = r;
+    }
+    limbo.resize(kept);
+    // a reader that stays pinned keeps objects alive: scan again only after as many new ones
+    next_reclaim = kept + reclaim_threshold > 2 * kept ? kept + reclaim_threshold : 2 * kept;
+}
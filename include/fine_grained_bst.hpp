@@ -0,0 +1,337 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <functional> // std::less
+#include <memory> // std::unique_ptr
+#include <mutex> // std::lock_guard
+#include <optional>
+#include <thread> // std::this_thread::yield
+#include <utility> // std::pair
+#include <vector>
+#include "epoch.hpp"
+
+
+/** \class spin_lock
+ *
+ * One-byte lock for the nodes of a fine_grained_bst, held only for a few stores.
+ * It waits reading its own cache line and yields, so it also behaves with more threads than cores.
+ */
+class spin_lock {
+    /** \brief true while held, as \private locked */
+    std::atomic<bool> locked {false};
+
+    public:
+
+    void lock() noexcept {
+        while(locked.exchange(true, std::memory_order_acquire))
+            while(locked.load(std::memory_order_relaxed))
+                std::this_thread::yield();
+    }
+
+    void unlock() noexcept {
+        locked.store(false, std::memory_order_release);
+    }
+};
+
+
+/** \class fine_grained_bst
+ *
+ * Sorted map that many threads can insert into, erase from and search at the same time.
+ * It is an external (leaf-oriented) binary search tree: the elements are in the leaves and the
+ * inner nodes only route the searches, so an insertion replaces a leaf with a new inner node and
+ * two leaves, and an erase replaces the parent of a leaf with its sibling: a single link changes.
+ * Searches take no lock. A writer searches optimistically, locks the parent (and the grandparent
+ * for an erase), checks that they are still linked as seen and retries otherwise, so writers
+ * on different parts of the tree never wait for each other. Unlinked nodes are freed by an
+ * epoch_domain once no thread can reach them.
+ * The tree is not rebalanced: its height is O(log n) on random keys, but sorted insertions
+ * make it a list.
+ */
+template <typename key_type, typename value_type, typename comparison = std::less<key_type>>
+class fine_grained_bst {
+
+    using pair_type = std::pair<const key_type, value_type>;
+
+    /** \brief common part of the nodes */
+    struct node {
+        /** \brief 0 for a real key, 1 and 2 for the two sentinel keys larger than any other */
+        unsigned char inf;
+        /** \brief true for a leaf */
+        bool leaf;
+    };
+
+    /** \brief leaf holding an element, never modified once linked */
+    struct leaf_node: node {
+        pair_type data;
+
+        template <typename V>
+        leaf_node(const key_type& k, V&& v): node{0, true}, data{k, std::forward<V>(v)} {}
+    };
+
+    /** \brief routing node, keys less than key go left */
+    struct inner_node: node {
+        std::optional<key_type> key;
+        std::atomic<node*> left {nullptr};
+        std::atomic<node*> right {nullptr};
+        /** \brief guards the children links and removed */
+        spin_lock lock;
+        /** \brief set when the node is unlinked */
+        std::atomic<bool> removed {false};
+
+        explicit inner_node(unsigned char i): node{i, false} {}
+    };
+
+    /** \brief where the search for a key ended */
+    struct position {
+        inner_node* gp;
+        inner_node* p;
+        node* l;
+    };
+
+    /** \brief a counter per cache line, each thread updates its own */
+    struct alignas(64) counter {
+        std::atomic<std::ptrdiff_t> value {0};
+    };
+
+    static constexpr std::size_t counters {64};
+
+    /** \brief root sentinel, never removed, as \private root */
+    inner_node* root;
+
+    /** \brief compare two keys, as \private comp */
+    comparison comp;
+
+    /** \brief number of elements, split to avoid contention, as \private sizes */
+    std::unique_ptr<counter[]> sizes {new counter[counters]};
+
+    /** \brief reclamation of the unlinked nodes, as \private epochs */
+    mutable epoch_domain epochs;
+
+    /** \brief check if the key \p k is routed to the left of \p x */
+    bool _goes_left(const key_type& k, const inner_node* x) const {
+        return x->inf || comp(k, *x->key);
+    }
+
+    /** \brief child of \p x toward the key \p k */
+    std::atomic<node*>& _child(inner_node* x, const key_type& k) const {
+        return _goes_left(k, x) ? x->left : x->right;
+    }
+
+    /** \brief check if \p x is the leaf with key \p k */
+    bool _matches(const key_type& k, const node* x) const {
+        if(x->inf)
+            return false;
+        const auto& y = static_cast<const leaf_node*>(x)->data.first;
+        return !comp(k, y) && !comp(y, k);
+    }
+
+    /** \brief search without locks, the caller has pinned the epochs */
+    position _search(const key_type& k) const;
+
+    /** \brief add \p delta to the size */
+    void _count(std::ptrdiff_t delta) {
+        sizes[thread_registry::index() % counters].value.fetch_add(delta, std::memory_order_relaxed);
+    }
+
+    /** \brief delete the node \p x , of any kind */
+    static void _delete(node* x) noexcept {
+        if(!x->leaf)
+            delete static_cast<inner_node*>(x);
+        else if(x->inf)
+            delete x;
+        else
+            delete static_cast<leaf_node*>(x);
+    }
+
+    /** \brief hand the unlinked node \p x to the epochs, leaking it if they cannot take it */
+    template <typename T>
+    void _retire(T* x) noexcept {
+        try {
+            epochs.retire(x);
+        }
+        catch(...) {}
+    }
+
+    /** \brief insert, or assign if \p assign is true */
+    template <typename V>
+    bool _put(const key_type& k, V&& v, bool assign);
+
+    public:
+
+    /** \brief Default fine_grained_bst Constructor */
+    fine_grained_bst(): fine_grained_bst{comparison{}} {}
+
+    /** \brief Custom fine_grained_bst Constructor, with the comparison \p c */
+    explicit fine_grained_bst(const comparison& c);
+
+    /** \brief a concurrent tree is neither copied nor moved */
+    fine_grained_bst(const fine_grained_bst&) = delete;
+    fine_grained_bst& operator=(const fine_grained_bst&) = delete;
+
+    /** \brief fine_grained_bst Destructor, no thread may be using the tree */
+    ~fine_grained_bst() noexcept;
+
+    /** \brief number of elements
+     *
+     * Exact when no writer is running, otherwise a value the size had while it was computed. */
+    std::size_t size() const noexcept {
+        std::ptrdiff_t n {0};
+        for(std::size_t i = 0; i < counters; ++i)
+            n += sizes[i].value.load(std::memory_order_relaxed);
+        return n > 0 ? static_cast<std::size_t>(n) : 0;
+    }
+
+    /** \brief check if the key \p x is present */
+    bool contains(const key_type& x) const {
+        auto guard = epochs.pin();
+        return _matches(x, _search(x).l);
+    }
+
+    /** \brief copy of the element with key \p x , if present */
+    std::optional<pair_type> get(const key_type& x) const {
+        auto guard = epochs.pin();
+        auto l = _search(x).l;
+        if(!_matches(x, l))
+            return std::nullopt;
+        return static_cast<const leaf_node*>(l)->data;
+    }
+
+    /** \brief insert a new element
+     *
+     * Inserts \p x if its key is not present, returns true if inserted. */
+    bool insert(const pair_type& x) {
+        return _put(x.first, x.second, false);
+    }
+
+    /** \brief insert or assign an element
+     *
+     * Inserts an element with key \p k and value \p v , or replaces the value of the existing one.
+     * Returns true if inserted, false if assigned. */
+    template <typename V>
+    bool insert_or_assign(const key_type& k, V&& v) {
+        return _put(k, std::forward<V>(v), true);
+    }
+
+    /** \brief erase element by key, returns true if \p x was present */
+    bool erase(const key_type& x);
+
+    /** \brief free now the unlinked nodes that no thread can reach */
+    void reclaim() noexcept {
+        epochs.reclaim();
+    }
+};
+
+
+template <typename key_type, typename value_type, typename comparison>
+fine_grained_bst<key_type, value_type, comparison>::fine_grained_bst(const comparison& c): comp{c} {
+    // the real keys are all left of the root, so every real leaf has a parent and a grandparent
+    auto r = std::make_unique<inner_node>(2);
+    auto l = std::make_unique<node>(node{1, true});
+    auto g = std::make_unique<node>(node{2, true});
+    r->left.store(l.release(), std::memory_order_relaxed);
+    r->right.store(g.release(), std::memory_order_relaxed);
+    root = r.release();
+}
+
+
+template <typename key_type, typename value_type, typename comparison>
+fine_grained_bst<key_type, value_type, comparison>::~fine_grained_bst() noexcept {
+    // iterative, the tree may be as deep as it is large
+    std::vector<node*> stack {root};
+    while(!stack.empty()) {
+        auto x = stack.back();
+        stack.pop_back();
+        if(!x->leaf) {
+            auto y = static_cast<inner_node*>(x);
+            stack.push_back(y->left.load(std::memory_order_relaxed));
+            stack.push_back(y->right.load(std::memory_order_relaxed));
+        }
+        _delete(x);
+    }
+}
+
+
+template <typename key_type, typename value_type, typename comparison>
+typename fine_grained_bst<key_type, value_type, comparison>::position
+fine_grained_bst<key_type, value_type, comparison>::_search(const key_type& k) const {
+    inner_node* gp {nullptr};
+    inner_node* p {root};
+    node* l {root->left.load(std::memory_order_acquire)};
+    while(!l->leaf) {
+        gp = p;
+        p = static_cast<inner_node*>(l);
+        l = _child(p, k).load(std::memory_order_acquire);
+    }
+    return position{gp, p, l};
+}
+
+
+template <typename key_type, typename value_type, typename comparison>
+template <typename V>
+bool fine_grained_bst<key_type, value_type, comparison>::_put(const key_type& k, V&& v, bool assign) {
+    auto guard = epochs.pin();
+    // the new leaf is created once, the new inner node by every attempt since it depends on the search
+    std::unique_ptr<leaf_node> leaf;
+    std::unique_ptr<inner_node> inner;
+    for(;;) {
+        auto pos = _search(k);
+        const bool found {_matches(k, pos.l)};
+        if(found && !assign)
+            return false;
+        if(!leaf)
+            leaf.reset(new leaf_node{k, std::forward<V>(v)});
+        if(!found) {
+            // the inner node routes between the new leaf and the one it replaces, its key is the larger
+            const bool smaller {pos.l->inf || comp(k, static_cast<leaf_node*>(pos.l)->data.first)};
+            inner.reset(new inner_node{smaller ? pos.l->inf : static_cast<unsigned char>(0)});
+            if(!inner->inf)
+                inner->key.emplace(smaller ? static_cast<leaf_node*>(pos.l)->data.first : k);
+            inner->left.store(smaller ? leaf.get() : pos.l, std::memory_order_relaxed);
+            inner->right.store(smaller ? pos.l : leaf.get(), std::memory_order_relaxed);
+        }
+
+        std::lock_guard<spin_lock> lock {pos.p->lock};
+        auto& link = _child(pos.p, k);
+        if(pos.p->removed.load(std::memory_order_relaxed) || link.load(std::memory_order_relaxed) != pos.l)
+            continue;
+        if(found) {
+            // the old leaf may still be read, the new one takes its place
+            link.store(leaf.release(), std::memory_order_release);
+            _retire(static_cast<leaf_node*>(pos.l));
+            return false;
+        }
+        link.store(inner.release(), std::memory_order_release);
+        leaf.release();
+        _count(1);
+        return true;
+    }
+}
+
+
+template <typename key_type, typename value_type, typename comparison>
+bool fine_grained_bst<key_type, value_type, comparison>::erase(const key_type& x) {
+    auto guard = epochs.pin();
+    for(;;) {
+        auto pos = _search(x);
+        if(!_matches(x, pos.l))
+            return false;
+        {
+            // always locked top-down, so that two writers never wait for each other in a cycle
+            std::lock_guard<spin_lock> outer {pos.gp->lock};
+            std::lock_guard<spin_lock> lock {pos.p->lock};
+            auto& up = _child(pos.gp, x);
+            auto& link = _child(pos.p, x);
+            if(pos.gp->removed.load(std::memory_order_relaxed) || pos.p->removed.load(std::memory_order_relaxed)
+               || up.load(std::memory_order_relaxed) != pos.p || link.load(std::memory_order_relaxed) != pos.l)
+                continue;
+            auto& sibling = &link == &pos.p->left ? pos.p->right : pos.p->left;
+            up.store(sibling.load(std::memory_order_relaxed), std::memory_order_release);
+            pos.p->removed.store(true, std::memory_order_relaxed);
+        }
+        _count(-1);
+        _retire(pos.p);
+        _retire(static_cast<leaf_node*>(pos.l));
+        return true;
+    }
+}
@@ -0,0 +1,163 @@
+#pragma once
+
+#include <cstdint>
+#include <utility> // std::move and std::pair
+#include "node.hpp" // no_augment
+
+
+/** \class flat_node
+ *
+ * Node of a bst whose nodes live in a single contiguous array, see flat_storage.
+ * It has the same interface of node, but the links are stored as 32-bit offsets
+ * from the node itself, counted in nodes, with 0 meaning no link.
+ * Three offsets take 12 bytes instead of the 24 of three pointers, and being relative
+ * they need no base pointer to be followed.
+ */
+template <typename pair_type, typename augment = no_augment>
+class flat_node : public augment {
+    /** \brief node content
+     *
+     * Pair type, containing a key and associated value, stored in var \private data. */
+    pair_type data;
+
+    /** \brief offset of the parent, as \private parent_offset */
+    std::int32_t parent_offset {0};
+
+    /** \brief offset of the left child, as \private left_offset */
+    std::int32_t left_offset {0};
+
+    /** \brief offset of the right child, as \private right_offset */
+    std::int32_t right_offset {0};
+
+    /** \brief node at \p offset from this one, nullptr if \p offset is 0 */
+    flat_node* _at(std::int32_t offset) noexcept {
+        return offset ? this + offset : nullptr;
+    }
+
+    /** \brief node at \p offset from this one, nullptr if \p offset is 0 */
+    const flat_node* _at(std::int32_t offset) const noexcept {
+        return offset ? this + offset : nullptr;
+    }
+
+    /** \brief offset of \p x from this node, 0 if \p x is nullptr */
+    std::int32_t _offset(const flat_node* x) const noexcept {
+        return x ? static_cast<std::int32_t>(x - this) : 0;
+    }
+
+    public:
+
+    /** \brief Custom flat_node Constructor
+     *
+     * Creates a node receiving an l-value reference to the content, as \p d ,
+     * and parent node as \p parent with default value as nullptr.
+     */
+    flat_node(const pair_type& d, flat_node* parent = nullptr):
+    data{d}, parent_offset{_offset(parent)} {}
+
+    /** \brief Custom flat_node Constructor
+     *
+     * Creates a node receiving an r-value reference to the content, as \p d ,
+     * and parent node as \p parent with default value as nullptr.
+     */
+    flat_node(pair_type&& d, flat_node* parent = nullptr):
+    data{std::move(d)}, parent_offset{_offset(parent)} {}
+
+    /** \brief Custom flat_node Constructor
+     *
+     * Creates a node whose content is constructed in place from \p args ,
+     * forwarded to the constructor of pair_type. The node is not linked to any parent.
+     */
+    template <typename... Types>
+    explicit flat_node(std::in_place_t, Types&&... args):
+    data(std::forward<Types>(args)...) {}
+
+    /** \brief copy and move are deleted
+     *
+     * The offsets are relative to the position of the node, the storage relocates the nodes itself.
+     */
+    flat_node(const flat_node&) = delete;
+    flat_node& operator=(const flat_node&) = delete;
+
+
+    /** \brief get left child of a node */
+    flat_node* get_left() noexcept {
+        return _at(left_offset);
+    }
+
+    /** \brief get right child of a node */
+    flat_node* get_right() noexcept {
+        return _at(right_offset);
+    }
+
+    /** \brief get parent of a node */
+    flat_node* get_parent() noexcept {
+        return _at(parent_offset);
+    }
+
+    /** \brief get left child of a node */
+    const flat_node* get_left() const noexcept {
+        return _at(left_offset);
+    }
+
+    /** \brief get right child of a node */
+    const flat_node* get_right() const noexcept {
+        return _at(right_offset);
+    }
+
+    /** \brief get parent of a node */
+    const flat_node* get_parent() const noexcept {
+        return _at(parent_offset);
+    }
+
+    /** \brief set left child of a node to \p x */
+    void set_left(flat_node* x) noexcept {
+        left_offset = _offset(x);
+    }
+
+    /** \brief set right child of a node to \p x */
+    void set_right(flat_node* x) noexcept {
+        right_offset = _offset(x);
+    }
+
+    /** \brief set parent of a node to \p x */
+    void set_parent(flat_node* x) noexcept {
+        parent_offset = _offset(x);
+    }
+
+    /** \brief update the augmentation
+     *
+     * Recomputes the fields of the augment from the current children. */
+    void update() noexcept {
+        augment::update(get_left(), get_right());
+    }
+
+    /** \brief get data contained in a node */
+    pair_type& get_data() noexcept {
+        return data;
+    }
+
+    /** \brief get data contained in a node */
+    const pair_type& get_data() const noexcept {
+        return data;
+    }
+
+    /** \brief get far left leaf node
+     *
+     * \returns pointer to the leftmost node of the subtree rooted in this node */
+    flat_node* leftiest() noexcept {
+        auto x {this};
+        while(x->left_offset)
+            x += x->left_offset;
+        return x;
+    }
+
+    /** \brief get far left leaf node
+     *
+     * \returns const pointer to the leftmost node of the subtree rooted in this node */
+    const flat_node* leftiest() const noexcept {
+        auto x {this};
+        while(x->left_offset)
+            x += x->left_offset;
+        return x;
+    }
+};
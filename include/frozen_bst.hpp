@@ -0,0 +1,267 @@
+#pragma once
+
+#include <cstddef>
+#include <functional> // std::less
+#include <iterator>
+#include <utility> // std::pair
+#include <vector>
+#include "sorted_unique.hpp"
+
+
+/** \class frozen_iterator
+ *
+ * Forward iterator over the elements of a frozen_bst, in order of the keys.
+ * It walks the implicit tree of the Eytzinger layout: the children of the slot k
+ * (counting from 1) are the slots 2k and 2k+1, and 0 is the end.
+ */
+template <typename key_type, typename mapped_type>
+class frozen_iterator {
+
+    /** \brief keys in Eytzinger order, as \private keys */
+    const key_type* keys {nullptr};
+
+    /** \brief values in Eytzinger order, as \private values */
+    const mapped_type* values {nullptr};
+
+    /** \brief number of elements, as \private n */
+    std::size_t n {0};
+
+    /** \brief current slot, counting from 1, as \private k */
+    std::size_t k {0};
+
+    public:
+
+    using difference_type = std::ptrdiff_t;
+    using value_type = std::pair<const key_type, mapped_type>;
+    using reference = std::pair<const key_type&, const mapped_type&>;
+    using iterator_category = std::forward_iterator_tag;
+
+    /** \brief pointer to a reference, returned by operator->() */
+    struct pointer {
+        reference ref;
+        const reference* operator->() const noexcept {
+            return &ref;
+        }
+    };
+
+    /** \brief Default frozen_iterator Constructor, the end of any frozen_bst */
+    frozen_iterator() = default;
+
+    /** \brief Custom frozen_iterator Constructor
+     *
+     * Creates an iterator to the slot \p slot of the \p size elements in \p ks and \p vs . */
+    frozen_iterator(const key_type* ks, const mapped_type* vs, std::size_t size, std::size_t slot) noexcept:
+    keys{ks}, values{vs}, n{size}, k{slot} {}
+
+    /** \brief star operator overload, the key and the value of the current element */
+    reference operator*() const noexcept {
+        return reference{keys[k - 1], values[k - 1]};
+    }
+
+    /** \brief -> overload */
+    pointer operator->() const noexcept {
+        return pointer{**this};
+    }
+
+    /** \brief ++ overload
+     *
+     * Operator ++ as pre-increment: the leftmost slot of the right subtree, if any,
+     * otherwise the first ancestor reached from a left child. */
+    frozen_iterator& operator++() noexcept {
+        if(2 * k + 1 <= n) {
+            k = 2 * k + 1;
+            while(2 * k <= n)
+                k *= 2;
+        }
+        else {
+            while(k & 1)
+                k >>= 1;
+            k >>= 1;
+        }
+        return *this;
+    }
+
+    /** \brief ++ overload
+     *
+     * Operator ++ as post-increment with \p int . */
+    frozen_iterator operator++(int) noexcept {
+        auto update = *this;
+        ++(*this);
+        return update;
+    }
+
+    /** \brief == overload */
+    friend bool operator==(const frozen_iterator& lhs, const frozen_iterator& rhs) noexcept {
+        return lhs.k == rhs.k;
+    }
+
+    /** \brief \!= overload */
+    friend bool operator!=(const frozen_iterator& lhs, const frozen_iterator& rhs) noexcept {
+        return !(lhs == rhs);
+    }
+};
+
+
+/** \class frozen_bst
+ *
+ * Immutable snapshot of a sorted map, usually obtained with bst::freeze().
+ * The keys are stored in a single array in Eytzinger (breadth-first) order and the values in
+ * a parallel array, so that a lookup reads only keys and touches the values once, at the end.
+ * The lookup has no unpredictable branch: the next slot is computed from the result of the
+ * comparison, and the slots that will be compared some levels below are prefetched, since the
+ * 2^d descendants of a slot at depth d below it are adjacent in the array.
+ */
+template <typename key_type, typename value_type, typename comparison = std::less<key_type>>
+class frozen_bst {
+
+    /** \brief keys in Eytzinger order, as \private keys */
+    std::vector<key_type> keys;
+
+    /** \brief values in Eytzinger order, as \private values */
+    std::vector<value_type> values;
+
+    /** \brief compare two keys, as \private comp */
+    comparison comp;
+
+    /** \brief slots per cache line
+     *
+     * Keys that fit in 64 bytes, rounded down to a power of two: the descendants of a slot
+     * this many levels below it fill one cache line. */
+    static constexpr std::size_t block {[] {
+        std::size_t b {1};
+        while(2 * b * sizeof(key_type) <= 64)
+            b *= 2;
+        return b;
+    }()};
+
+    /** \brief assign the ranks
+     *
+     * Stores in \p rank the in-order rank of every slot of the subtree rooted in \p k ,
+     * starting from \p next . Recursive, the depth is O(log n). */
+    static void _ranks(std::vector<std::size_t>& rank, std::size_t k, std::size_t& next) {
+        if(k > rank.size())
+            return;
+        _ranks(rank, 2 * k, next);
+        rank[k - 1] = next++;
+        _ranks(rank, 2 * k + 1, next);
+    }
+
+    /** \brief internal lower_bound
+     *
+     * Returns the slot (counting from 1) of the first key not less than \p x , 0 if none. */
+    std::size_t _lower_bound(const key_type& x) const noexcept;
+
+    public:
+
+    /** using declaration for const_iterator. Represents an iterator over the elements in order. */
+    using const_iterator = frozen_iterator<key_type, value_type>;
+    /** using declaration for iterator. Elements cannot be modified, it is a const_iterator. */
+    using iterator = const_iterator;
+
+    /** \brief Default frozen_bst Constructor, an empty snapshot */
+    frozen_bst() = default;
+
+    /** \brief Sorted range frozen_bst Constructor
+     *
+     * Creates the snapshot of the pairs in [ \p first , \p last ), that must be sorted by key
+     * according to \p c without duplicates. Takes O(n) time. */
+    template <typename It>
+    frozen_bst(sorted_unique_t, It first, It last, comparison c = comparison{});
+
+    /** \brief size of the snapshot */
+    std::size_t size() const noexcept {
+        return keys.size();
+    }
+
+    /** \brief check if the snapshot is empty */
+    bool empty() const noexcept {
+        return keys.empty();
+    }
+
+    /** \brief begin of for loop with iterator, the leftmost slot */
+    const_iterator begin() const noexcept {
+        std::size_t k {keys.empty() ? 0u : 1u};
+        while(k && 2 * k <= keys.size())
+            k *= 2;
+        return const_iterator{keys.data(), values.data(), keys.size(), k};
+    }
+
+    /** \brief end of for loop with iterator */
+    const_iterator end() const noexcept {
+        return const_iterator{keys.data(), values.data(), keys.size(), 0};
+    }
+
+    /** \brief const begin of for loop with iterator */
+    const_iterator cbegin() const noexcept {
+        return begin();
+    }
+
+    /** \brief const end of for loop with iterator */
+    const_iterator cend() const noexcept {
+        return end();
+    }
+
+    /** \brief find element by key
+     *
+     * Returns an iterator to the element with key \p x , end() if not present. */
+    const_iterator find(const key_type& x) const noexcept {
+        auto k = _lower_bound(x);
+        if(k && comp(x, keys[k - 1]))
+            k = 0;
+        return const_iterator{keys.data(), values.data(), keys.size(), k};
+    }
+
+    /** \brief first element not less than key
+     *
+     * Returns an iterator to the first element whose key is not less than \p x , end() if none. */
+    const_iterator lower_bound(const key_type& x) const noexcept {
+        return const_iterator{keys.data(), values.data(), keys.size(), _lower_bound(x)};
+    }
+};
+
+
+template <typename key_type, typename value_type, typename comparison>
+template <typename It>
+frozen_bst<key_type, value_type, comparison>::frozen_bst(sorted_unique_t, It first, It last, comparison c):
+comp{std::move(c)} {
+    std::vector<It> at;
+    for(; first != last; ++first)
+        at.push_back(first);
+
+    std::vector<std::size_t> rank(at.size());
+    std::size_t next {0};
+    _ranks(rank, 1, next);
+
+    keys.reserve(at.size());
+    values.reserve(at.size());
+    for(auto r : rank) {
+        keys.push_back((*at[r]).first);
+        values.push_back((*at[r]).second);
+    }
+}
+
+
+template <typename key_type, typename value_type, typename comparison>
+std::size_t frozen_bst<key_type, value_type, comparison>::_lower_bound(const key_type& x) const noexcept {
+    const auto n {keys.size()};
+    const auto data {keys.data()};
+    std::size_t k {1};
+    while(k <= n) {
+#if defined(__GNUC__)
+        if(k * block <= n)
+            __builtin_prefetch(data + k * block - 1);
+#endif
+        // right child if the key is less than x, left child otherwise
+        k = 2 * k + static_cast<std::size_t>(comp(data[k - 1], x));
+    }
+    // the path ends with the last left turn followed by right turns only:
+    // drop the right turns and that left turn to get back to the bound
+#if defined(__GNUC__)
+    k >>= __builtin_ctzll(~static_cast<unsigned long long>(k)) + 1;
+#else
+    while(k & 1)
+        k >>= 1;
+    k >>= 1;
+#endif
+    return k;
+}
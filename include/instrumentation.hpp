@@ -0,0 +1,212 @@
+#pragma once
+
+#include <array>
+#include <chrono>
+#include <cstddef>
+#include <iostream>
+
+
+/** \brief observed operations
+ *
+ * Operations of the bst that are reported to the instrumentation policy.
+ */
+enum class operation : std::size_t {
+    insert,
+    find,
+    erase,
+    balance
+};
+
+/** \brief number of observed operations */
+constexpr std::size_t operation_count {4};
+
+/** \brief printable name of an operation */
+inline const char* operation_name(operation op) noexcept {
+    switch(op) {
+        case operation::insert: return "insert";
+        case operation::find: return "find";
+        case operation::erase: return "erase";
+        case operation::balance: return "balance";
+    }
+    return "unknown";
+}
+
+
+/** \class no_instrumentation
+ *
+ * Default instrumentation policy of the bst.
+ * Every hook is an empty inline function, so that the compiler removes them completely:
+ * no clock is read and nothing is written when this policy is used.
+ */
+struct no_instrumentation {
+
+    /** \brief probe of a single operation
+     *
+     * Empty object, returned by start() and passed back to stop(). */
+    struct probe {
+        /** \brief a node has been visited */
+        void visit() noexcept {}
+    };
+
+    /** \brief an operation starts */
+    probe start(operation) noexcept {
+        return probe{};
+    }
+
+    /** \brief an operation is over */
+    void stop(const probe&) noexcept {}
+};
+
+
+/** \class stats_instrumentation
+ *
+ * Instrumentation policy that collects statistics about the bst operations.
+ * For each operation it keeps the number of calls, the nodes visited while walking the tree
+ * and an histogram of the latencies.
+ * The bucket i of the histogram counts the calls that took between 2^i and 2^(i+1) nanoseconds.
+ * Nothing is printed: the statistics are read through the public functions.
+ */
+class stats_instrumentation {
+    public:
+
+    /** using declaration for the clock used to measure latencies. */
+    using clock = std::chrono::steady_clock;
+
+    /** \brief number of buckets of the latency histogram */
+    static constexpr std::size_t histogram_buckets {40};
+
+    /** using declaration for the latency histogram. */
+    using histogram = std::array<std::size_t, histogram_buckets>;
+
+    /** \brief probe of a single operation
+     *
+     * Stores the observed operation, its starting time and the nodes visited so far. */
+    struct probe {
+        operation op;
+        clock::time_point start;
+        std::size_t visited;
+
+        /** \brief a node has been visited */
+        void visit() noexcept {
+            ++visited;
+        }
+    };
+
+    /** \brief an operation starts */
+    probe start(operation op) noexcept {
+        return probe{op, clock::now(), 0};
+    }
+
+    /** \brief an operation is over
+     *
+     * Updates the counters of the operation stored in \p p . */
+    void stop(const probe& p) noexcept;
+
+    /** \brief number of calls of \p op */
+    std::size_t calls(operation op) const noexcept {
+        return counters[index(op)].calls;
+    }
+
+    /** \brief total number of nodes visited by all the calls of \p op */
+    std::size_t nodes_visited(operation op) const noexcept {
+        return counters[index(op)].visited;
+    }
+
+    /** \brief maximum number of nodes visited by a single call of \p op */
+    std::size_t max_nodes_visited(operation op) const noexcept {
+        return counters[index(op)].max_visited;
+    }
+
+    /** \brief average number of nodes visited by a call of \p op */
+    double mean_nodes_visited(operation op) const noexcept {
+        const auto& c = counters[index(op)];
+        return c.calls ? static_cast<double>(c.visited) / c.calls : 0.0;
+    }
+
+    /** \brief latency histogram of \p op */
+    const histogram& latency_histogram(operation op) const noexcept {
+        return counters[index(op)].latency;
+    }
+
+    /** \brief latency percentile
+     *
+     * Returns the upper bound of the histogram bucket that contains the \p p percentile
+     * (with \p p in [0,100]) of the latencies of \p op . */
+    std::chrono::nanoseconds latency_percentile(operation op, double p) const noexcept;
+
+    /** \brief reset all the counters */
+    void reset() noexcept {
+        counters = {};
+    }
+
+    /** \brief put-to
+     *
+     * Put-to operator, prints a short report of the collected statistics. */
+    friend
+    std::ostream& operator<<(std::ostream& os, const stats_instrumentation& x) {
+        for(std::size_t i = 0; i < operation_count; ++i) {
+            auto op = static_cast<operation>(i);
+            if(!x.calls(op))
+                continue;
+            os << operation_name(op) << ": calls=" << x.calls(op)
+               << " mean visited=" << x.mean_nodes_visited(op)
+               << " max visited=" << x.max_nodes_visited(op)
+               << " p50=" << x.latency_percentile(op, 50).count() << "ns"
+               << " p99=" << x.latency_percentile(op, 99).count() << "ns\n";
+        }
+        return os;
+    }
+
+    private:
+
+    /** \brief counters of a single operation */
+    struct op_counters {
+        std::size_t calls;
+        std::size_t visited;
+        std::size_t max_visited;
+        histogram latency;
+    };
+
+    /** \brief counters of all the operations, as \private counters */
+    std::array<op_counters, operation_count> counters {};
+
+    static std::size_t index(operation op) noexcept {
+        return static_cast<std::size_t>(op);
+    }
+};
+
+
+inline void stats_instrumentation::stop(const probe& p) noexcept {
+    auto elapsed = std::chrono::duration_cast<std::chrono::nanoseconds>(clock::now() - p.start).count();
+    auto& c = counters[index(p.op)];
+    ++c.calls;
+    c.visited += p.visited;
+    if(p.visited > c.max_visited)
+        c.max_visited = p.visited;
+
+    // bucket = floor(log2(elapsed)), elapsed = 0 goes in the first bucket
+    std::size_t bucket {0};
+    while(elapsed > 1 && bucket < histogram_buckets - 1) {
+        elapsed >>= 1;
+        ++bucket;
+    }
+    ++c.latency[bucket];
+}
+
+
+inline std::chrono::nanoseconds stats_instrumentation::latency_percentile(operation op, double p) const noexcept {
+    const auto& c = counters[index(op)];
+    if(!c.calls)
+        return std::chrono::nanoseconds{0};
+
+    auto target = static_cast<std::size_t>(p / 100.0 * c.calls);
+    if(target >= c.calls)
+        target = c.calls - 1;
+    std::size_t seen {0};
+    for(std::size_t i = 0; i < histogram_buckets; ++i) {
+        seen += c.latency[i];
+        if(seen > target)
+            return std::chrono::nanoseconds{std::chrono::nanoseconds::rep{1} << (i + 1)};
+    }
+    return std::chrono::nanoseconds{std::chrono::nanoseconds::rep{1} << histogram_buckets};
+}
@@ -1,6 +1,8 @@
 #pragma once
 
 #include <iostream>
+#include <iterator>
+#include <type_traits>
 
 /** \class Iterator
  * 
@@ -39,6 +41,19 @@ class Iterator {
      * Creates an iterator by receiving a pointer to node type as \p other . */
     explicit Iterator(node_type *other) : current{other} {}
 
+    /** \brief Converting iterator Constructor
+     * 
+     * Creates a const iterator from a non-const one, \p other , pointing to the same node. */
+    template <typename other_pair, typename = std::enable_if_t<std::is_same<const other_pair, pair_type>::value>>
+    Iterator(const Iterator<other_pair, node_type>& other) : current{other.get_node()} {}
+
+    /** \brief current node
+     * 
+     * Returns the pointer to the node the iterator points to, used by the tree to work on positions. */
+    node_type* get_node() const noexcept {
+        return current;
+    }
+
     /** \brief star operator overload
      * 
      * Overloading of operator * to return contents of the current Iterator node instance. */
@@ -123,3 +138,41 @@ node_type* Iterator<pair_type, node_type>::next(node_type *cur) const noexcept
 
     return next_one;
 }
+
+
+/** \class iterator_range
+ * 
+ * Pair of iterators [first, last) that can be traversed with a range-based for loop.
+ * Returned by the bounded scans of the tree.
+ */
+template <typename iterator>
+class iterator_range {
+
+    /** \brief begin of the range, as \private first */
+    iterator first;
+
+    /** \brief end of the range, as \private last */
+    iterator last;
+
+    public:
+
+    /** \brief Custom iterator_range Constructor
+     * 
+     * Creates the range [ \p f , \p l ). */
+    iterator_range(iterator f, iterator l) : first{f}, last{l} {}
+
+    /** \brief begin of the range */
+    iterator begin() const noexcept {
+        return first;
+    }
+
+    /** \brief end of the range */
+    iterator end() const noexcept {
+        return last;
+    }
+
+    /** \brief check if the range is empty */
+    bool empty() const noexcept {
+        return first == last;
+    }
+};
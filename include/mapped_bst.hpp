@@ -0,0 +1,299 @@
+#pragma once
+
+#include "snapshot.hpp"
+
+#if defined(__unix__) || defined(__APPLE__)
+
+#include <algorithm> // std::lower_bound
+#include <cerrno>
+#include <cstddef>
+#include <cstring> // std::memcpy
+#include <functional> // std::less
+#include <iterator>
+#include <string>
+#include <system_error>
+#include <type_traits>
+#include <utility> // std::pair
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+
+/** \class mapped_iterator
+ *
+ * Forward iterator over the elements of a mapped_bst, in order of the keys:
+ * an index into the arrays of keys and values.
+ */
+template <typename key_type, typename mapped_type>
+class mapped_iterator {
+
+    /** \brief sorted keys, as \private keys */
+    const key_type* keys {nullptr};
+
+    /** \brief values in the order of the keys, as \private values */
+    const mapped_type* values {nullptr};
+
+    /** \brief current element, as \private i */
+    std::size_t i {0};
+
+    public:
+
+    using difference_type = std::ptrdiff_t;
+    using value_type = std::pair<const key_type, mapped_type>;
+    using reference = std::pair<const key_type&, const mapped_type&>;
+    using iterator_category = std::forward_iterator_tag;
+
+    /** \brief pointer to a reference, returned by operator->() */
+    struct pointer {
+        reference ref;
+        const reference* operator->() const noexcept {
+            return &ref;
+        }
+    };
+
+    /** \brief Default mapped_iterator Constructor */
+    mapped_iterator() = default;
+
+    /** \brief Custom mapped_iterator Constructor, the element \p index of \p ks and \p vs */
+    mapped_iterator(const key_type* ks, const mapped_type* vs, std::size_t index) noexcept:
+    keys{ks}, values{vs}, i{index} {}
+
+    /** \brief star operator overload, the key and the value of the current element */
+    reference operator*() const noexcept {
+        return reference{keys[i], values[i]};
+    }
+
+    /** \brief -> overload */
+    pointer operator->() const noexcept {
+        return pointer{**this};
+    }
+
+    /** \brief ++ overload
+     *
+     * Operator ++ as pre-increment. */
+    mapped_iterator& operator++() noexcept {
+        ++i;
+        return *this;
+    }
+
+    /** \brief ++ overload
+     *
+     * Operator ++ as post-increment with \p int . */
+    mapped_iterator operator++(int) noexcept {
+        auto update = *this;
+        ++(*this);
+        return update;
+    }
+
+    /** \brief == overload */
+    friend bool operator==(const mapped_iterator& lhs, const mapped_iterator& rhs) noexcept {
+        return lhs.i == rhs.i;
+    }
+
+    /** \brief \!= overload */
+    friend bool operator!=(const mapped_iterator& lhs, const mapped_iterator& rhs) noexcept {
+        return !(lhs == rhs);
+    }
+};
+
+
+/** \class mapped_bst
+ *
+ * Read-only sorted map served straight from a snapshot file written by bst::save(), with
+ * trivially copyable keys and values. The file is mapped in memory and nothing is deserialized:
+ * opening it costs the same whatever its size, and lookups and scans read the sorted arrays
+ * of keys and values in place, so only the pages they touch are loaded from the disk.
+ * The file must have been written on a machine with the same type sizes and byte order,
+ * from a tree with the same comparison, and must not change while it is mapped.
+ * Available on POSIX systems only.
+ */
+template <typename key_type, typename value_type, typename comparison = std::less<key_type>>
+class mapped_bst {
+    static_assert(std::is_trivially_copyable<key_type>::value && std::is_trivially_copyable<value_type>::value,
+                  "mapped_bst reads keys and values in place, they must be trivially copyable");
+
+    /** \brief start of the mapping, as \private base */
+    void* base {nullptr};
+
+    /** \brief length of the mapping, as \private length */
+    std::size_t length {0};
+
+    /** \brief sorted keys, as \private keys */
+    const key_type* keys {nullptr};
+
+    /** \brief values in the order of the keys, as \private values */
+    const value_type* values {nullptr};
+
+    /** \brief number of elements, as \private n */
+    std::size_t n {0};
+
+    /** \brief compare two keys, as \private comp */
+    comparison comp;
+
+    /** \brief unmap the file */
+    void _unmap() noexcept {
+        if(base)
+            ::munmap(base, length);
+        base = nullptr;
+    }
+
+    /** \brief index of the first key not less than \p x */
+    std::size_t _lower_bound(const key_type& x) const noexcept {
+        return static_cast<std::size_t>(std::lower_bound(keys, keys + n, x, comp) - keys);
+    }
+
+    public:
+
+    /** using declaration for const_iterator. Represents an iterator over the elements in order. */
+    using const_iterator = mapped_iterator<key_type, value_type>;
+    /** using declaration for iterator. Elements cannot be modified, it is a const_iterator. */
+    using iterator = const_iterator;
+
+    /** \brief Custom mapped_bst Constructor
+     *
+     * Maps the snapshot file \p path , to be searched with the comparison \p c .
+     * \throws std::system_error if the file cannot be opened or mapped,
+     * std::runtime_error if it is not a snapshot of these types or is truncated */
+    explicit mapped_bst(const std::string& path, comparison c = comparison{});
+
+    /** \brief a mapping is moved, not copied */
+    mapped_bst(const mapped_bst&) = delete;
+    mapped_bst& operator=(const mapped_bst&) = delete;
+
+    /** \brief Move constructor */
+    mapped_bst(mapped_bst&& other) noexcept:
+    base{other.base}, length{other.length}, keys{other.keys}, values{other.values}, n{other.n}, comp{std::move(other.comp)} {
+        other.base = nullptr;
+        other.n = 0;
+    }
+
+    /** \brief Move assignment */
+    mapped_bst& operator=(mapped_bst&& other) noexcept {
+        if(this == &other)
+            return *this;
+        _unmap();
+        base = other.base;
+        length = other.length;
+        keys = other.keys;
+        values = other.values;
+        n = other.n;
+        comp = std::move(other.comp);
+        other.base = nullptr;
+        other.n = 0;
+        return *this;
+    }
+
+    /** \brief mapped_bst Destructor, unmaps the file */
+    ~mapped_bst() noexcept {
+        _unmap();
+    }
+
+    /** \brief number of elements */
+    std::size_t size() const noexcept {
+        return n;
+    }
+
+    /** \brief check if there are no elements */
+    bool empty() const noexcept {
+        return !n;
+    }
+
+    /** \brief begin of for loop with iterator */
+    const_iterator begin() const noexcept {
+        return const_iterator{keys, values, 0};
+    }
+
+    /** \brief end of for loop with iterator */
+    const_iterator end() const noexcept {
+        return const_iterator{keys, values, n};
+    }
+
+    /** \brief const begin of for loop with iterator */
+    const_iterator cbegin() const noexcept {
+        return begin();
+    }
+
+    /** \brief const end of for loop with iterator */
+    const_iterator cend() const noexcept {
+        return end();
+    }
+
+    /** \brief find element by key
+     *
+     * Returns an iterator to the element with key \p x , end() if not present. Takes O(log n). */
+    const_iterator find(const key_type& x) const noexcept {
+        auto i = _lower_bound(x);
+        if(i != n && comp(x, keys[i]))
+            i = n;
+        return const_iterator{keys, values, i};
+    }
+
+    /** \brief check if the key \p x is present */
+    bool contains(const key_type& x) const noexcept {
+        return find(x) != end();
+    }
+
+    /** \brief first element not less than key
+     *
+     * Returns an iterator to the first element whose key is not less than \p x , end() if none. */
+    const_iterator lower_bound(const key_type& x) const noexcept {
+        return const_iterator{keys, values, _lower_bound(x)};
+    }
+
+    /** \brief first element greater than key
+     *
+     * Returns an iterator to the first element whose key is greater than \p x , end() if none. */
+    const_iterator upper_bound(const key_type& x) const noexcept {
+        auto i = static_cast<std::size_t>(std::upper_bound(keys, keys + n, x, comp) - keys);
+        return const_iterator{keys, values, i};
+    }
+};
+
+
+template <typename key_type, typename value_type, typename comparison>
+mapped_bst<key_type, value_type, comparison>::mapped_bst(const std::string& path, comparison c): comp{std::move(c)} {
+    const int fd {::open(path.c_str(), O_RDONLY)};
+    if(fd < 0)
+        throw std::system_error{errno, std::generic_category(), "In function mapped_bst(): cannot open " + path};
+    struct stat info;
+    if(::fstat(fd, &info) < 0) {
+        const int error {errno};
+        ::close(fd);
+        throw std::system_error{error, std::generic_category(), "In function mapped_bst(): cannot read the size of " + path};
+    }
+    length = static_cast<std::size_t>(info.st_size);
+    if(length < sizeof(snapshot_header)) {
+        ::close(fd);
+        throw std::runtime_error{"In function mapped_bst(): the snapshot is truncated"};
+    }
+    base = ::mmap(nullptr, length, PROT_READ, MAP_SHARED, fd, 0);
+    // the mapping keeps the file alive
+    const int error {errno};
+    ::close(fd);
+    if(base == MAP_FAILED) {
+        base = nullptr;
+        throw std::system_error{error, std::generic_category(), "In function mapped_bst(): cannot map " + path};
+    }
+    try {
+        snapshot_header header;
+        std::memcpy(&header, base, sizeof(header));
+        header.check(snapshot_traits<key_type>::fixed_size, snapshot_traits<value_type>::fixed_size);
+        const auto bytes = static_cast<const unsigned char*>(base);
+        // the arrays fit in the file, checked without overflowing on a corrupted size
+        if(header.keys_offset<key_type>() > length
+           || header.size > (length - header.keys_offset<key_type>()) / sizeof(key_type)
+           || header.values_offset<key_type, value_type>() > length
+           || header.size > (length - header.values_offset<key_type, value_type>()) / sizeof(value_type))
+            throw std::runtime_error{"In function mapped_bst(): the snapshot is truncated"};
+        keys = reinterpret_cast<const key_type*>(bytes + header.keys_offset<key_type>());
+        values = reinterpret_cast<const value_type*>(bytes + header.values_offset<key_type, value_type>());
+        n = static_cast<std::size_t>(header.size);
+    }
+    catch(...) {
+        _unmap();
+        throw;
+    }
+}
+
+#endif
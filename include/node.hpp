@@ -1,19 +1,33 @@
 #pragma once
 
 #include <iostream>
-#include <memory> // std::unique_ptr
 #include <utility> // std::move and std::pair
 
 
+/** \class no_augment
+ * 
+ * Default augmentation of a node: it adds no field and has nothing to update.
+ */
+struct no_augment {
+    /** \brief update the augmentation
+     * 
+     * Called whenever the children of a node change, receiving the new left and right children. */
+    template <typename node_type>
+    void update(const node_type*, const node_type*) noexcept {}
+};
+
+
 /** \class node
  * 
  * Template class for members of the binary search tree concept.
  * Every element of the binary search tree is a node. 
  * Each node stores a pair of a key and the associated value.
+ * The node inherits from \p augment the extra fields needed by the balancing policy 
+ * of the tree (e.g. the height of the subtree for an AVL tree): an empty augment costs nothing.
  */
 
-template <typename pair_type>
-class node{
+template <typename pair_type, typename augment = no_augment>
+class node : public augment {
     /** \brief node content
      * 
      * Pair type, containing a key and associated value, stored in var \private data. */
@@ -41,29 +55,27 @@ class node{
      * Pointer to the node that has the current node as one of its' childs.
      * Widely used in the insert function in order to find the correct place for a new node.
     */
-    node* parent_node; 
+    node* parent_node {nullptr}; 
 
     /** \brief left child
      * 
-     * Unique pointer to the node that is left from the current, 
+     * Pointer to the node that is left from the current, 
      * a node with a smaller key from the current node.
+     * Nodes are owned by the tree, which creates and destroys them through its allocator.
      */
-    std::unique_ptr<node> left_child;   
+    node* left_child {nullptr};   
 
     /** \brief right child 
      * 
-     * Unique pointer to the node that is right from the current, 
+     * Pointer to the node that is right from the current, 
      * a node with a bigger key from the current node.
+     * Nodes are owned by the tree, which creates and destroys them through its allocator.
      */
-    std::unique_ptr<node> right_child; 
-
-    /** \brief Default node Constructor
-     * 
-    */
-    node() = default;
+    node* right_child {nullptr}; 
 
     /** \brief Default node Destructor 
      * 
+     * Children are not destroyed: this is done by the tree.
     */
     ~node() noexcept = default;
 
@@ -73,89 +85,52 @@ class node{
      * and parent node as \p parent with default value as nullptr.
      */
     node(const pair_type& d, node* parent = nullptr):                   
-    data{d}, parent_node{parent} {
-        left_child.reset();
-        right_child.reset();
-    }
+    data{d}, parent_node{parent} {}
 
     /** \brief Custom Node Constructor
      *  
      * Creates a node receiving an r-value reference to the content we want to store in it,as \p d , 
      * and parent node as \p parent with default value as nullptr.
      */
-    node(const pair_type&& d, node* parent = nullptr):
-    data{std::move(d)}, parent_node{parent} {
-        left_child.reset();
-        right_child.reset();
-    }
+    node(pair_type&& d, node* parent = nullptr):
+    data{std::move(d)}, parent_node{parent} {}
 
     /** \brief Custom Node Constructor
      * 
-     * Creates a node receiving a parent node as \p parent with default value as nullptr.
+     * Creates a node whose content is constructed in place from \p args , 
+     * forwarded to the constructor of pair_type. The node is not linked to any parent.
      */
-    explicit node(node* parent = nullptr):
-    data{}, parent_node{parent}{ 
-        left_child.reset();
-        right_child.reset();
-    }
+    template <typename... Types>
+    explicit node(std::in_place_t, Types&&... args):
+    data(std::forward<Types>(args)...) {}
 
-    /** \brief move constuctor
-     * 
-     * Implementing move constructor
-     * using default compiler generated ones.
-     */
-    explicit node(node&& other) noexcept = default;
-    /** \brief move assignment
+    /** \brief Custom Node Constructor
      * 
-     * Implementing move assignment
-     * using default compiler generated ones.
+     * Creates a node receiving a parent node as \p parent with default value as nullptr.
      */
-    node& operator=(node&& other) noexcept = default;
+    explicit node(node* parent = nullptr):
+    data{}, parent_node{parent} {}
 
-    
-    /** \brief deep copy constructor
-     * 
-     * Managing the resources from the lowest level, to achieve a deep copy of the bst itself.
-     */
-    explicit node(const node& other):
-    data{other.data}, parent_node{nullptr} { 
-        if(other.parent_node) {
-            parent_node = new node{other.parent_node};
-        }
-        if(other.right_child) {
-            right_child.reset(new node{*(other.right_child.get())});
-            right_child->parent_node = this;
-        }
-        if(other.left_child) {
-            left_child.reset(new node{*(other.left_child.get())});
-            left_child->parent_node = this;
-        }
-    }
-    
-    /** \brief deep copy assignment
+    /** \brief copy and move are deleted
      * 
+     * A node is linked to its neighbours inside a tree, copies of the tree are made by the tree itself.
      */
-    node& operator=(const node& x) {
-        left_child.reset();
-        right_child.reset();
-        auto tmp {x}; // copy ctor
-        *this = std::move(tmp); //move assignment
-        return *this;    
-    }
+    node(const node&) = delete;
+    node& operator=(const node&) = delete;
 
 
     /** \brief get left child of a node
      * 
      * \returns pointer to left child*/
     node* get_left() noexcept{
-        return left_child.get();
+        return left_child;
     }
 
     /** \brief get right child of a node
      * 
      * \returns pointer to right child*/
     node* get_right() noexcept{
-        return right_child.get();
+        return right_child;
     }
 
     /** \brief get parent of a node
@@ -165,6 +140,49 @@ class node{
         return parent_node;
     }
 
+    /** \brief get left child of a node
+     * 
+     * \returns const pointer to left child*/
+    const node* get_left() const noexcept{
+        return left_child;
+    }
+
+    /** \brief get right child of a node
+     * 
+     * \returns const pointer to right child*/
+    const node* get_right() const noexcept{
+        return right_child;
+    }
+
+    /** \brief get parent of a node
+     * 
+     *  \returns const pointer to parent*/
+    const node* get_parent() const noexcept{
+        return parent_node;
+    }
+
+    /** \brief set left child of a node to \p x */
+    void set_left(node* x) noexcept{
+        left_child = x;
+    }
+
+    /** \brief set right child of a node to \p x */
+    void set_right(node* x) noexcept{
+        right_child = x;
+    }
+
+    /** \brief set parent of a node to \p x */
+    void set_parent(node* x) noexcept{
+        parent_node = x;
+    }
+
+    /** \brief update the augmentation
+     * 
+     * Recomputes the fields of the augment from the current children. */
+    void update() noexcept {
+        augment::update(get_left(), get_right());
+    }
+
     /** \brief get data contained in a node
      * 
      *  \returns by reference, contents of node, as data */
@@ -0,0 +1,143 @@
+#pragma once
+
+#include <memory> // std::allocator_traits
+#include <optional>
+#include <type_traits>
+#include <utility> // std::move and std::swap
+
+
+/** \class node_handle
+ *
+ * Move-only owner of a node extracted from a bst with bst::extract(), that can be inserted into
+ * another bst with the same node type by bst::insert(node_handle&&) without allocating or
+ * copying the element, as std::map::node_type does. The handle keeps a copy of the node
+ * allocator, so that a node never inserted back is destroyed and deallocated by the handle.
+ * Both the key and the value can be changed while the node is out of any tree.
+ */
+template <typename node_type, typename node_allocator>
+class node_handle {
+
+    template <typename, typename, typename, typename, typename, typename, typename>
+    friend class bst;
+
+    /** using declaration for alloc_traits. Represents the traits of the node allocator. */
+    using alloc_traits = std::allocator_traits<node_allocator>;
+    /** using declaration for pair_type. Represents the element stored in the node. */
+    using pair_type = std::remove_reference_t<decltype(std::declval<node_type&>().get_data())>;
+
+    /** \brief node owned, nullptr if empty, as \private x */
+    node_type* x {nullptr};
+
+    /** \brief allocator of the node, present if not empty, as \private alloc */
+    std::optional<node_allocator> alloc;
+
+    /** \brief Custom node_handle Constructor, takes over the detached node \p n created through \p a */
+    node_handle(node_type* n, const node_allocator& a): x{n}, alloc{a} {}
+
+    /** \brief give up the node without destroying it, the handle is left empty */
+    node_type* _release() noexcept {
+        auto n = x;
+        x = nullptr;
+        alloc.reset();
+        return n;
+    }
+
+    /** \brief destroy and deallocate the node, if any */
+    void _destroy() noexcept {
+        if(!x)
+            return;
+        alloc_traits::destroy(*alloc, x);
+        alloc_traits::deallocate(*alloc, x, 1);
+        x = nullptr;
+        alloc.reset();
+    }
+
+    public:
+
+    /** using declaration for key_type. Represents the key of the element, modifiable through the handle. */
+    using key_type = std::remove_const_t<typename pair_type::first_type>;
+    /** using declaration for mapped_type. Represents the value of the element. */
+    using mapped_type = typename pair_type::second_type;
+    /** using declaration for allocator_type. Represents the allocator of the node. */
+    using allocator_type = node_allocator;
+
+    /** \brief Default node_handle Constructor, an empty handle */
+    constexpr node_handle() noexcept = default;
+
+    /** \brief a node has a single owner, it is moved and not copied */
+    node_handle(const node_handle&) = delete;
+    node_handle& operator=(const node_handle&) = delete;
+
+    /** \brief Move constructor, \p other is left empty */
+    node_handle(node_handle&& other) noexcept: x{other.x}, alloc{std::move(other.alloc)} {
+        other.x = nullptr;
+        other.alloc.reset();
+    }
+
+    /** \brief Move assignment, destroys the node held, if any, and takes the one of \p other */
+    node_handle& operator=(node_handle&& other) noexcept {
+        if(this == &other)
+            return *this;
+        _destroy();
+        x = other.x;
+        alloc = std::move(other.alloc);
+        other.x = nullptr;
+        other.alloc.reset();
+        return *this;
+    }
+
+    /** \brief node_handle Destructor, destroys the node if it was not inserted */
+    ~node_handle() noexcept {
+        _destroy();
+    }
+
+    /** \brief check if the handle holds no node */
+    [[nodiscard]] bool empty() const noexcept {
+        return !x;
+    }
+
+    /** \brief check if the handle holds a node */
+    explicit operator bool() const noexcept {
+        return x;
+    }
+
+    /** \brief key of the element, the handle must not be empty
+     *
+     * Writable, as in std::map::node_type: the node is in no tree, so its order cannot be broken. */
+    key_type& key() const noexcept {
+        return const_cast<key_type&>(x->get_data().first);
+    }
+
+    /** \brief value of the element, the handle must not be empty */
+    mapped_type& mapped() const noexcept {
+        return x->get_data().second;
+    }
+
+    /** \brief get allocator, the handle must not be empty */
+    allocator_type get_allocator() const {
+        return *alloc;
+    }
+
+    /** \brief swap the nodes and the allocators of two handles */
+    void swap(node_handle& other) noexcept {
+        std::swap(x, other.x);
+        alloc.swap(other.alloc);
+    }
+
+    /** \brief swap overload, found by argument-dependent lookup */
+    friend void swap(node_handle& lhs, node_handle& rhs) noexcept {
+        lhs.swap(rhs);
+    }
+};
+
+
+/** \brief result of bst::insert(node_handle&&)
+ *
+ * \p position is the element with the key of the node, \p inserted is true if the node has been
+ * linked into the tree; otherwise the key was already present and \p node still holds the node. */
+template <typename iterator, typename handle>
+struct node_insert_return {
+    iterator position;
+    bool inserted;
+    handle node;
+};
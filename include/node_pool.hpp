@@ -0,0 +1,237 @@
+#pragma once
+
+#include <cstddef>
+#include <memory> // std::shared_ptr
+#include <new>
+#include <type_traits>
+#include <utility> // std::declval
+#include <vector>
+
+
+/** \class node_arena
+ *
+ * Slab allocator of fixed-size blocks, shared by the copies of a node_pool.
+ * Memory is requested in chunks of geometrically growing size and handed out with a bump pointer;
+ * released blocks are kept in an intrusive free list and reused before touching a new chunk.
+ * The whole arena can be released at once, one chunk at a time instead of one block at a time.
+ */
+class node_arena {
+
+    /** \brief free block, used to link the free list inside the released memory */
+    struct free_block {
+        free_block* next;
+    };
+
+    /** \brief size of a block, as \private block_size */
+    std::size_t block_size;
+
+    /** \brief alignment of a block, as \private block_align */
+    std::size_t block_align;
+
+    /** \brief chunks requested so far, as \private chunks */
+    std::vector<void*> chunks;
+
+    /** \brief head of the free list, as \private free_list */
+    free_block* free_list {nullptr};
+
+    /** \brief next never used block of the last chunk, as \private bump */
+    char* bump {nullptr};
+
+    /** \brief end of the last chunk, as \private bump_end */
+    char* bump_end {nullptr};
+
+    /** \brief number of blocks of the next chunk, as \private next_chunk */
+    std::size_t next_chunk {first_chunk};
+
+    static constexpr std::size_t first_chunk {64};
+    static constexpr std::size_t max_chunk {1 << 16};
+
+    /** \brief round \p size up to a multiple of \p align (a power of two) */
+    static constexpr std::size_t round_up(std::size_t size, std::size_t align) noexcept {
+        return (size + align - 1) & ~(align - 1);
+    }
+
+    /** \brief request a new chunk and point the bump pointer to it */
+    void grow() {
+        auto bytes = block_size * next_chunk;
+        void* chunk {::operator new(bytes, std::align_val_t{block_align})};
+        try {
+            chunks.push_back(chunk);
+        }
+        catch(...) {
+            ::operator delete(chunk, std::align_val_t{block_align});
+            throw;
+        }
+        bump = static_cast<char*>(chunk);
+        bump_end = bump + bytes;
+        if(next_chunk < max_chunk)
+            next_chunk *= 2;
+    }
+
+    public:
+
+    /** \brief Custom node_arena Constructor
+     *
+     * Creates an empty arena of blocks of \p size bytes aligned to \p align . */
+    node_arena(std::size_t size, std::size_t align) noexcept:
+    block_size{round_up(size < sizeof(free_block) ? sizeof(free_block) : size, 
+                        align < alignof(free_block) ? alignof(free_block) : align)},
+    block_align{align < alignof(free_block) ? alignof(free_block) : align} {}
+
+    node_arena(const node_arena&) = delete;
+    node_arena& operator=(const node_arena&) = delete;
+
+    /** \brief node_arena Destructor, releases all the chunks */
+    ~node_arena() noexcept {
+        release();
+    }
+
+    /** \brief get a block
+     *
+     * Pops the free list or, if empty, bumps into the last chunk. */
+    void* allocate() {
+        if(free_list) {
+            auto block = free_list;
+            free_list = block->next;
+            return block;
+        }
+        if(bump == bump_end)
+            grow();
+        auto block = bump;
+        bump += block_size;
+        return block;
+    }
+
+    /** \brief give back a block
+     *
+     * Pushes \p p on the free list, it will be reused by the next allocate(). */
+    void deallocate(void* p) noexcept {
+        auto block = static_cast<free_block*>(p);
+        block->next = free_list;
+        free_list = block;
+    }
+
+    /** \brief release the whole arena
+     *
+     * Frees all the chunks: every block handed out so far becomes invalid. */
+    void release() noexcept {
+        for(auto chunk : chunks)
+            ::operator delete(chunk, std::align_val_t{block_align});
+        chunks.clear();
+        free_list = nullptr;
+        bump = bump_end = nullptr;
+        next_chunk = first_chunk;
+    }
+
+    /** \brief size of a block */
+    std::size_t get_block_size() const noexcept {
+        return block_size;
+    }
+
+    /** \brief alignment of a block */
+    std::size_t get_block_align() const noexcept {
+        return block_align;
+    }
+};
+
+
+/** \class node_pool
+ *
+ * Allocator of single nodes backed by a node_arena.
+ * Copies of a node_pool share the same arena; rebinding it to a type of different size
+ * (e.g. from the pair_type of a bst to its node_type) creates a new arena.
+ * Requests of more than one object are forwarded to the global operator new.
+ * Copying a bst gives the copy a fresh pool, while moving it moves the pool along.
+ */
+template <typename T>
+class node_pool {
+
+    template <typename U>
+    friend class node_pool;
+
+    /** \brief shared arena, as \private arena */
+    std::shared_ptr<node_arena> arena;
+
+    public:
+
+    using value_type = T;
+    using propagate_on_container_copy_assignment = std::false_type;
+    using propagate_on_container_move_assignment = std::true_type;
+    using propagate_on_container_swap = std::true_type;
+    using is_always_equal = std::false_type;
+
+    /** \brief Default node_pool Constructor, creates a new empty arena */
+    node_pool():
+    arena{std::make_shared<node_arena>(sizeof(T), alignof(T))} {}
+
+    /** \brief Copy Constructor, shares the arena.
+     * 
+     * There is no move constructor: a moved-from pool must stay equal to the original one. */
+    node_pool(const node_pool& other) noexcept = default;
+
+    /** \brief Copy assignment, shares the arena */
+    node_pool& operator=(const node_pool& other) noexcept = default;
+
+    /** \brief Rebinding Constructor
+     *
+     * Shares the arena of \p other if its blocks fit a T, creates a new one otherwise. */
+    template <typename U>
+    node_pool(const node_pool<U>& other):
+    arena{other.arena->get_block_size() >= sizeof(T) && other.arena->get_block_align() >= alignof(T) ?
+          other.arena : std::make_shared<node_arena>(sizeof(T), alignof(T))} {}
+
+    /** \brief allocate \p n objects of type T */
+    T* allocate(std::size_t n) {
+        if(n == 1)
+            return static_cast<T*>(arena->allocate());
+        return static_cast<T*>(::operator new(n * sizeof(T), std::align_val_t{alignof(T)}));
+    }
+
+    /** \brief deallocate \p n objects of type T pointed by \p p */
+    void deallocate(T* p, std::size_t n) noexcept {
+        if(n == 1)
+            arena->deallocate(p);
+        else
+            ::operator delete(p, std::align_val_t{alignof(T)});
+    }
+
+    /** \brief allocator for a copy of the container: a new, empty pool */
+    node_pool select_on_container_copy_construction() const {
+        return node_pool{};
+    }
+
+    /** \brief check if the arena is used only by this pool */
+    bool unique() const noexcept {
+        return arena.use_count() == 1;
+    }
+
+    /** \brief release the whole arena
+     *
+     * Frees all the chunks at once. Valid only if no object allocated by the pool is still alive. */
+    void release() noexcept {
+        arena->release();
+    }
+
+    /** \brief == overload, true if the two pools share the same arena */
+    template <typename U>
+    friend bool operator==(const node_pool& lhs, const node_pool<U>& rhs) noexcept {
+        return lhs.arena == rhs.arena;
+    }
+
+    /** \brief \!= overload */
+    template <typename U>
+    friend bool operator!=(const node_pool& lhs, const node_pool<U>& rhs) noexcept {
+        return !(lhs == rhs);
+    }
+};
+
+
+/** \brief check if an allocator can release its whole arena at once
+ *
+ * True for allocators, like node_pool, that provide unique() and release(). */
+template <typename A, typename = void>
+struct is_releasable : std::false_type {};
+
+template <typename A>
+struct is_releasable<A, std::void_t<decltype(std::declval<const A&>().unique()), decltype(std::declval<A&>().release())>>
+    : std::true_type {};
@@ -0,0 +1,85 @@
+#pragma once
+
+#include <algorithm> // std::stable_sort and std::inplace_merge
+#include <cstddef>
+#include <exception>
+#include <iterator>
+#include <thread>
+
+
+/** \brief tag requesting the parallel version of an operation
+ *
+ * The work is split in halves, and the halves handed to new threads, until every one of the
+ * threads has its part or the parts are smaller than grain elements. */
+struct parallel_t {
+    /** \brief threads to use, 0 for one per core */
+    unsigned threads {0};
+    /** \brief number of elements below which the work stays on one thread */
+    std::size_t grain {std::size_t{1} << 16};
+
+    /** \brief number of threads to use, at least 1 */
+    unsigned workers() const noexcept {
+        const unsigned n {threads ? threads : std::thread::hardware_concurrency()};
+        return n ? n : 1;
+    }
+};
+
+/** \brief parallel_t with one thread per core and the default grain */
+inline constexpr parallel_t parallel {};
+
+
+/** \brief run \p f and \p g , \p f on a new thread if \p fork is true
+ *
+ * If the thread cannot be started, both run on the calling thread. An exception thrown by \p f 
+ * on the new thread is rethrown here once both have finished; if \p g throws too, its exception 
+ * is the one rethrown. */
+template <typename F, typename G>
+void fork_join(bool fork, F&& f, G&& g) {
+    std::thread t;
+    std::exception_ptr failed;
+    if(fork) {
+        try {
+            t = std::thread{[&f, &failed] {
+                try {
+                    f();
+                }
+                catch(...) {
+                    failed = std::current_exception();
+                }
+            }};
+        }
+        catch(...) {} // f has not started
+    }
+    if(!t.joinable())
+        f();
+    try {
+        g();
+    }
+    catch(...) {
+        if(t.joinable())
+            t.join();
+        throw;
+    }
+    if(t.joinable())
+        t.join();
+    if(failed)
+        std::rethrow_exception(failed);
+}
+
+
+/** \brief stable sort on \p threads threads
+ *
+ * Sorts [ \p first , \p last ) according to \p comp : the two halves are sorted in parallel,
+ * each on half of the threads, and merged. Ranges shorter than \p grain are sorted serially. */
+template <typename It, typename Compare>
+void parallel_stable_sort(It first, It last, Compare comp, unsigned threads, std::size_t grain) {
+    const auto n = static_cast<std::size_t>(std::distance(first, last));
+    if(threads <= 1 || n < 2 * grain) {
+        std::stable_sort(first, last, comp);
+        return;
+    }
+    auto middle = std::next(first, static_cast<typename std::iterator_traits<It>::difference_type>(n / 2));
+    fork_join(true, [&] { parallel_stable_sort(first, middle, comp, threads / 2, grain); },
+              [&] { parallel_stable_sort(middle, last, comp, threads - threads / 2, grain); });
+    std::inplace_merge(first, middle, last, comp);
+}
@@ -0,0 +1,104 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <iterator>
+
+
+/** \class path_iterator
+ *
+ * Forward iterator over a tree whose nodes have no parent link, such as the immutable trees
+ * of concurrent_bst and persistent_bst: the iterator keeps the ancestors still to be visited.
+ * An AVL tree of up to 2^64 elements is less than 96 levels deep.
+ * node_type must have the members data, left and right.
+ */
+template <typename node_type, typename pair_type>
+class path_iterator {
+
+    /** \brief maximum depth of the tree */
+    static constexpr std::size_t max_depth {96};
+
+    /** \brief current node and the ancestors to visit after it, the current on top, as \private path */
+    std::array<const node_type*, max_depth> path;
+
+    /** \brief number of nodes in path, 0 at the end, as \private depth */
+    std::size_t depth {0};
+
+    /** \brief push \p x and all its left descendants */
+    void _push_leftiest(const node_type* x) noexcept {
+        for(; x; x = x->left)
+            path[depth++] = x;
+    }
+
+    public:
+
+    using difference_type = std::ptrdiff_t;
+    using value_type = pair_type;
+    using reference = const pair_type&;
+    using pointer = const pair_type*;
+    using iterator_category = std::forward_iterator_tag;
+
+    /** \brief Default path_iterator Constructor, the end of any tree */
+    path_iterator() = default;
+
+    /** \brief Custom path_iterator Constructor, the first element of the tree rooted in \p root */
+    explicit path_iterator(const node_type* root) noexcept {
+        _push_leftiest(root);
+    }
+
+    /** \brief Custom path_iterator Constructor
+     *
+     * The first element of the tree rooted in \p root whose key is not less than \p x according to \p comp . */
+    template <typename key_type, typename comparison>
+    path_iterator(const node_type* root, const key_type& x, const comparison& comp) {
+        // the nodes where the search turns left are the ones still to visit, the bound on top
+        for(auto n = root; n;) {
+            if(comp(n->data.first, x))
+                n = n->right;
+            else {
+                path[depth++] = n;
+                n = n->left;
+            }
+        }
+    }
+
+    /** \brief star operator overload */
+    reference operator*() const noexcept {
+        return path[depth - 1]->data;
+    }
+
+    /** \brief -> overload */
+    pointer operator->() const noexcept {
+        return &**this;
+    }
+
+    /** \brief ++ overload
+     *
+     * Operator ++ as pre-increment: the leftmost node of the right subtree, if any,
+     * otherwise the nearest ancestor left behind with a left turn. */
+    path_iterator& operator++() noexcept {
+        _push_leftiest(path[--depth]->right);
+        return *this;
+    }
+
+    /** \brief ++ overload
+     *
+     * Operator ++ as post-increment with \p int . */
+    path_iterator operator++(int) noexcept {
+        auto update = *this;
+        ++(*this);
+        return update;
+    }
+
+    /** \brief == overload */
+    friend bool operator==(const path_iterator& lhs, const path_iterator& rhs) noexcept {
+        if(lhs.depth != rhs.depth)
+            return false;
+        return !lhs.depth || lhs.path[lhs.depth - 1] == rhs.path[rhs.depth - 1];
+    }
+
+    /** \brief \!= overload */
+    friend bool operator!=(const path_iterator& lhs, const path_iterator& rhs) noexcept {
+        return !(lhs == rhs);
+    }
+};
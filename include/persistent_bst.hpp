@@ -0,0 +1,445 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <functional> // std::less
+#include <ostream>
+#include <utility> // std::pair
+#include "path_iterator.hpp"
+
+
+/** \class persistent_node
+ *
+ * Node of a persistent_bst, shared by all the versions that reach it.
+ * It counts the parents and versions pointing to it; the count is atomic, so versions sharing
+ * nodes can be copied and released by different threads.
+ */
+template <typename pair_type>
+struct persistent_node {
+    /** \brief node content */
+    pair_type data;
+    /** \brief left child */
+    persistent_node* left {nullptr};
+    /** \brief right child */
+    persistent_node* right {nullptr};
+    /** \brief number of references to the node */
+    std::atomic<std::size_t> refs {1};
+    /** \brief height of the subtree rooted in the node, 1 for a leaf */
+    unsigned char height {1};
+
+    template <typename... Types>
+    explicit persistent_node(std::in_place_t, Types&&... args): data(std::forward<Types>(args)...) {}
+};
+
+
+/** \class persistent_bst
+ *
+ * Sorted map with value semantics whose copies share their nodes.
+ * It is an AVL tree of reference-counted nodes without parent links: copying a tree only
+ * takes a reference to its root, so it is O(1), and the copy is an independent version.
+ * An update copies the shared nodes on the path from the root to the changed element, O(log n),
+ * and leaves the other versions unchanged; nodes that only one version reaches are updated in
+ * place, so a tree that was never copied does not copy anything.
+ * A version stays readable until it is destroyed, and a node is freed with the last version
+ * reaching it. Different versions can be used by different threads, a single version cannot.
+ */
+template <typename key_type, typename value_type, typename comparison = std::less<key_type>>
+class persistent_bst {
+
+    using pair_type = std::pair<const key_type, value_type>;
+    using node_type = persistent_node<pair_type>;
+
+    /** \brief root of this version, as \private root */
+    node_type* root {nullptr};
+
+    /** \brief number of elements, as \private _size */
+    std::size_t _size {0};
+
+    /** \brief compare two keys, as \private comp */
+    comparison comp;
+
+    static unsigned char _height(const node_type* x) noexcept {
+        return x ? x->height : 0;
+    }
+
+    static void _update(node_type* x) noexcept {
+        auto l = _height(x->left), r = _height(x->right);
+        x->height = static_cast<unsigned char>((l > r ? l : r) + 1);
+    }
+
+    /** \brief take a reference to \p x */
+    static node_type* _share(node_type* x) noexcept {
+        if(x)
+            x->refs.fetch_add(1, std::memory_order_relaxed);
+        return x;
+    }
+
+    /** \brief drop a reference to \p x , freeing the nodes no version reaches any more */
+    static void _release(node_type* x) noexcept;
+
+    /** \brief make writable the node pointed by \p link , a link of a node of this version only
+     *
+     * The node is kept if no other version reaches it, otherwise \p link is replaced by a copy
+     * that shares its children. The tree is valid at every step, also if the copy throws. */
+    static node_type* _own(node_type*& link);
+
+    /** \brief search the node with key \p x , nullptr if not present */
+    const node_type* _find(const key_type& x) const;
+
+    static node_type* _rotate_left(node_type* x);
+    static node_type* _rotate_right(node_type* x);
+
+    /** \brief restore the AVL invariant at the writable node \p x , returns the new subtree root */
+    static node_type* _rebalance(node_type* x);
+
+    /** \brief internal insert of a key not present in the subtree pointed by \p link */
+    template <typename... Types>
+    void _insert(node_type*& link, const key_type& k, Types&&... args);
+
+    /** \brief internal erase of a key present in the subtree pointed by \p link */
+    void _erase(node_type*& link, const key_type& k);
+
+    /** \brief unlink the leftmost node of the subtree pointed by \p link , returned writable and detached */
+    static node_type* _erase_min(node_type*& link);
+
+    public:
+
+    /** using declaration for const_iterator. Elements cannot be modified, they may be shared. */
+    using const_iterator = path_iterator<node_type, pair_type>;
+    /** using declaration for iterator */
+    using iterator = const_iterator;
+
+    /** \brief Default persistent_bst Constructor */
+    persistent_bst() = default;
+
+    /** \brief Custom persistent_bst Constructor, with the comparison \p c */
+    explicit persistent_bst(const comparison& c): comp{c} {}
+
+    /** \brief Copy constructor, O(1): the copy shares all the nodes of \p other */
+    persistent_bst(const persistent_bst& other):
+    root{_share(other.root)}, _size{other._size}, comp{other.comp} {}
+
+    /** \brief Move constructor, \p other is left empty */
+    persistent_bst(persistent_bst&& other) noexcept:
+    root{other.root}, _size{other._size}, comp{std::move(other.comp)} {
+        other.root = nullptr;
+        other._size = 0;
+    }
+
+    /** \brief Copy assignment, O(1) */
+    persistent_bst& operator=(const persistent_bst& other) {
+        auto r = _share(other.root);
+        _release(root);
+        root = r;
+        _size = other._size;
+        comp = other.comp;
+        return *this;
+    }
+
+    /** \brief Move assignment */
+    persistent_bst& operator=(persistent_bst&& other) noexcept {
+        if(this != &other) {
+            _release(root);
+            root = other.root;
+            _size = other._size;
+            comp = std::move(other.comp);
+            other.root = nullptr;
+            other._size = 0;
+        }
+        return *this;
+    }
+
+    /** \brief persistent_bst Destructor, releases this version */
+    ~persistent_bst() noexcept {
+        _release(root);
+    }
+
+    /** \brief number of elements */
+    std::size_t size() const noexcept {
+        return _size;
+    }
+
+    /** \brief check if the tree is empty */
+    bool empty() const noexcept {
+        return !root;
+    }
+
+    /** \brief begin of for loop with iterator */
+    const_iterator begin() const noexcept {
+        return const_iterator{root};
+    }
+
+    /** \brief end of for loop with iterator */
+    const_iterator end() const noexcept {
+        return const_iterator{};
+    }
+
+    /** \brief const begin of for loop with iterator */
+    const_iterator cbegin() const noexcept {
+        return begin();
+    }
+
+    /** \brief const end of for loop with iterator */
+    const_iterator cend() const noexcept {
+        return end();
+    }
+
+    /** \brief find element by key
+     *
+     * Returns an iterator to the element with key \p x , end() if not present. */
+    const_iterator find(const key_type& x) const {
+        auto it = lower_bound(x);
+        if(it != end() && comp(x, it->first))
+            return end();
+        return it;
+    }
+
+    /** \brief first element not less than key
+     *
+     * Returns an iterator to the first element whose key is not less than \p x , end() if none. */
+    const_iterator lower_bound(const key_type& x) const {
+        return const_iterator{root, x, comp};
+    }
+
+    /** \brief check if the key \p x is present */
+    bool contains(const key_type& x) const {
+        return _find(x) != nullptr;
+    }
+
+    /** \brief insert a new element
+     *
+     * Inserts \p x if its key is not present, returns true if inserted. */
+    bool insert(const pair_type& x) {
+        if(_find(x.first))
+            return false;
+        _insert(root, x.first, x);
+        ++_size;
+        return true;
+    }
+
+    /** \brief insert or assign an element
+     *
+     * Inserts an element with key \p k and value \p v , or replaces the value of the existing one.
+     * Returns true if inserted, false if assigned. */
+    template <typename V>
+    bool insert_or_assign(const key_type& k, V&& v);
+
+    /** \brief erase element by key, returns true if \p x was present */
+    bool erase(const key_type& x);
+
+    /** \brief erase all the elements of this version */
+    void clear() noexcept {
+        _release(root);
+        root = nullptr;
+        _size = 0;
+    }
+
+    /** \brief check if \p other is the same version, i.e. they share the root */
+    bool shares_root(const persistent_bst& other) const noexcept {
+        return root == other.root;
+    }
+
+    /** \brief << overload */
+    friend std::ostream& operator<<(std::ostream& os, const persistent_bst& x) {
+        for(const auto& el : x)
+            os << el.first << ": " << el.second << std::endl;
+        return os;
+    }
+};
+
+
+template <typename key_type, typename value_type, typename comparison>
+void persistent_bst<key_type, value_type, comparison>::_release(node_type* x) noexcept {
+    // iterative, a version may be the last to reach any number of nodes: a node whose count
+    // drops to zero is kept as a cell of a list, linked through left, until the reference to
+    // its right child is dropped too
+    node_type* cells {nullptr};
+    for(;;) {
+        if(x && x->refs.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+            auto l = x->left;
+            x->left = cells;
+            cells = x;
+            x = l;
+            continue;
+        }
+        if(!cells)
+            return;
+        auto c = cells;
+        cells = c->left;
+        x = c->right;
+        delete c;
+    }
+}
+
+
+template <typename key_type, typename value_type, typename comparison>
+typename persistent_bst<key_type, value_type, comparison>::node_type*
+persistent_bst<key_type, value_type, comparison>::_own(node_type*& link) {
+    auto x = link;
+    if(x->refs.load(std::memory_order_acquire) == 1)
+        return x;
+    auto copy = new node_type{std::in_place, x->data};
+    copy->left = _share(x->left);
+    copy->right = _share(x->right);
+    copy->height = x->height;
+    // the copy replaces x in this version only
+    link = copy;
+    _release(x);
+    return copy;
+}
+
+
+template <typename key_type, typename value_type, typename comparison>
+const typename persistent_bst<key_type, value_type, comparison>::node_type*
+persistent_bst<key_type, value_type, comparison>::_find(const key_type& x) const {
+    const node_type* n {root};
+    while(n) {
+        if(comp(x, n->data.first))
+            n = n->left;
+        else if(comp(n->data.first, x))
+            n = n->right;
+        else
+            return n;
+    }
+    return nullptr;
+}
+
+
+template <typename key_type, typename value_type, typename comparison>
+typename persistent_bst<key_type, value_type, comparison>::node_type*
+persistent_bst<key_type, value_type, comparison>::_rotate_left(node_type* x) {
+    auto y = _own(x->right);
+    x->right = y->left;
+    y->left = x;
+    _update(x);
+    _update(y);
+    return y;
+}
+
+
+template <typename key_type, typename value_type, typename comparison>
+typename persistent_bst<key_type, value_type, comparison>::node_type*
+persistent_bst<key_type, value_type, comparison>::_rotate_right(node_type* x) {
+    auto y = _own(x->left);
+    x->left = y->right;
+    y->right = x;
+    _update(x);
+    _update(y);
+    return y;
+}
+
+
+template <typename key_type, typename value_type, typename comparison>
+typename persistent_bst<key_type, value_type, comparison>::node_type*
+persistent_bst<key_type, value_type, comparison>::_rebalance(node_type* x) {
+    _update(x);
+    const int factor {_height(x->left) - _height(x->right)};
+    if(factor > 1) {
+        if(_height(x->left->left) < _height(x->left->right))
+            x->left = _rotate_left(_own(x->left));
+        return _rotate_right(x);
+    }
+    if(factor < -1) {
+        if(_height(x->right->right) < _height(x->right->left))
+            x->right = _rotate_right(_own(x->right));
+        return _rotate_left(x);
+    }
+    return x;
+}
+
+
+template <typename key_type, typename value_type, typename comparison>
+template <typename... Types>
+void persistent_bst<key_type, value_type, comparison>::_insert(node_type*& link, const key_type& k, Types&&... args) {
+    if(!link) {
+        link = new node_type{std::in_place, std::forward<Types>(args)...};
+        return;
+    }
+    // owned before going down, so that a copy shares the children before they are looked at
+    auto x = _own(link);
+    if(comp(k, x->data.first))
+        _insert(x->left, k, std::forward<Types>(args)...);
+    else
+        _insert(x->right, k, std::forward<Types>(args)...);
+    link = _rebalance(x);
+}
+
+
+template <typename key_type, typename value_type, typename comparison>
+typename persistent_bst<key_type, value_type, comparison>::node_type*
+persistent_bst<key_type, value_type, comparison>::_erase_min(node_type*& link) {
+    auto x = _own(link);
+    if(!x->left) {
+        link = x->right;
+        x->right = nullptr;
+        return x;
+    }
+    auto min = _erase_min(x->left);
+    link = _rebalance(x);
+    return min;
+}
+
+
+template <typename key_type, typename value_type, typename comparison>
+void persistent_bst<key_type, value_type, comparison>::_erase(node_type*& link, const key_type& k) {
+    auto x = _own(link);
+    if(comp(k, x->data.first)) {
+        _erase(x->left, k);
+        link = _rebalance(x);
+        return;
+    }
+    if(comp(x->data.first, k)) {
+        _erase(x->right, k);
+        link = _rebalance(x);
+        return;
+    }
+    node_type* min {nullptr};
+    if(!x->left || !x->right)
+        link = x->left ? x->left : x->right;
+    else {
+        // the successor takes the place of x
+        min = _erase_min(x->right);
+        min->left = x->left;
+        min->right = x->right;
+        link = min;
+    }
+    // x is owned by this version: detached from its children it is freed alone
+    x->left = x->right = nullptr;
+    _release(x);
+    if(min)
+        link = _rebalance(min);
+}
+
+
+template <typename key_type, typename value_type, typename comparison>
+template <typename V>
+bool persistent_bst<key_type, value_type, comparison>::insert_or_assign(const key_type& k, V&& v) {
+    if(!_find(k)) {
+        _insert(root, k, k, std::forward<V>(v));
+        ++_size;
+        return true;
+    }
+    // the path to the element is owned, then the element itself can be assigned
+    node_type** link {&root};
+    for(;;) {
+        auto x = _own(*link);
+        if(comp(k, x->data.first))
+            link = &x->left;
+        else if(comp(x->data.first, k))
+            link = &x->right;
+        else {
+            x->data.second = std::forward<V>(v);
+            return false;
+        }
+    }
+}
+
+
+template <typename key_type, typename value_type, typename comparison>
+bool persistent_bst<key_type, value_type, comparison>::erase(const key_type& x) {
+    if(!_find(x))
+        return false;
+    _erase(root, x);
+    --_size;
+    return true;
+}
@@ -0,0 +1,229 @@
+#pragma once
+
+#include <algorithm> // std::min
+#include <cstddef>
+#include <cstdint>
+#include <cstring> // std::memcmp
+#include <istream>
+#include <optional>
+#include <ostream>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+#include <utility> // std::pair
+#include <vector>
+
+
+/** \brief header of a snapshot
+ *
+ * A snapshot written by bst::save() starts with this header, stored as it is in memory, followed
+ * by the elements in order of the keys. If both the key and the value have a fixed size the
+ * layout is snapshot_header::arrays: all the keys, then all the values, each array aligned for
+ * its type from the start of the snapshot, so that mapped_bst can use the file in place.
+ * Otherwise the layout is snapshot_header::records: key and value of each element one after
+ * the other, as written by snapshot_traits.
+ */
+struct snapshot_header {
+    /** \brief "bstsnap" and a terminator, identifies the format */
+    char magic[8];
+    /** \brief version of the format, bumped at every incompatible change */
+    std::uint32_t version;
+    /** \brief records or arrays */
+    std::uint32_t layout;
+    /** \brief number of elements */
+    std::uint64_t size;
+    /** \brief size of a key, 0 if variable */
+    std::uint32_t key_size;
+    /** \brief size of a value, 0 if variable */
+    std::uint32_t value_size;
+
+    static constexpr std::uint32_t current_version {1};
+    static constexpr std::uint32_t records {0};
+    static constexpr std::uint32_t arrays {1};
+
+    /** \brief header of a snapshot of \p n elements with the given sizes */
+    static snapshot_header make(std::uint64_t n, std::uint32_t key_bytes, std::uint32_t value_bytes) noexcept {
+        snapshot_header h {{'b', 's', 't', 's', 'n', 'a', 'p', '\0'}, current_version, records, n, key_bytes, value_bytes};
+        if(key_bytes && value_bytes)
+            h.layout = arrays;
+        return h;
+    }
+
+    /** \brief check that the snapshot can be read with the given sizes
+     *
+     * \throws std::runtime_error if the magic, the version (also when written with the other byte
+     * order), the layout or the sizes of the key and of the value do not match. */
+    void check(std::uint32_t key_bytes, std::uint32_t value_bytes) const {
+        if(std::memcmp(magic, "bstsnap", 8))
+            throw std::runtime_error{"In function check(): not a bst snapshot"};
+        if(version != current_version)
+            throw std::runtime_error{"In function check(): unsupported snapshot version or byte order"};
+        if(key_size != key_bytes || value_size != value_bytes || layout != make(size, key_bytes, value_bytes).layout)
+            throw std::runtime_error{"In function check(): the snapshot holds other key or value types"};
+    }
+
+    /** \brief offset of the keys from the start of the snapshot, arrays layout */
+    template <typename key_type>
+    static constexpr std::uint64_t keys_offset() noexcept {
+        return align(sizeof(snapshot_header), alignof(key_type));
+    }
+
+    /** \brief offset of the values from the start of the snapshot, arrays layout */
+    template <typename key_type, typename value_type>
+    std::uint64_t values_offset() const noexcept {
+        return align(keys_offset<key_type>() + size * sizeof(key_type), alignof(value_type));
+    }
+
+    /** \brief round \p offset up to a multiple of \p alignment */
+    static constexpr std::uint64_t align(std::uint64_t offset, std::uint64_t alignment) noexcept {
+        return (offset + alignment - 1) / alignment * alignment;
+    }
+};
+
+
+/** \brief how keys and values are written to a snapshot
+ *
+ * The default writes the bytes of trivially copyable types, which have the fixed size sizeof(T).
+ * Specialize it for other types: fixed_size 0, write() and read() of a single object. */
+template <typename T, typename = void>
+struct snapshot_traits {
+    static_assert(std::is_trivially_copyable<T>::value,
+                  "snapshot_traits must be specialized for types that are not trivially copyable");
+
+    /** \brief size of every object in the snapshot, 0 if variable */
+    static constexpr std::uint32_t fixed_size {sizeof(T)};
+
+    static void write(std::ostream& os, const T& x) {
+        os.write(reinterpret_cast<const char*>(&x), sizeof(T));
+    }
+
+    static T read(std::istream& is) {
+        T x;
+        is.read(reinterpret_cast<char*>(&x), sizeof(T));
+        return x;
+    }
+};
+
+/** \brief strings are written as their length followed by the characters */
+template <typename C, typename traits, typename allocator>
+struct snapshot_traits<std::basic_string<C, traits, allocator>> {
+    static_assert(std::is_trivially_copyable<C>::value, "the characters are written as bytes");
+
+    static constexpr std::uint32_t fixed_size {0};
+
+    static void write(std::ostream& os, const std::basic_string<C, traits, allocator>& x) {
+        snapshot_traits<std::uint64_t>::write(os, x.size());
+        os.write(reinterpret_cast<const char*>(x.data()), static_cast<std::streamsize>(x.size() * sizeof(C)));
+    }
+
+    static std::basic_string<C, traits, allocator> read(std::istream& is) {
+        const auto n = snapshot_traits<std::uint64_t>::read(is);
+        std::basic_string<C, traits, allocator> x;
+        // a corrupted length must not allocate more than what the stream really holds
+        constexpr std::uint64_t chunk {std::uint64_t{1} << 16};
+        while(is && x.size() < n) {
+            const auto m = static_cast<std::size_t>(std::min(chunk, n - x.size()));
+            const auto old = x.size();
+            x.resize(old + m);
+            is.read(reinterpret_cast<char*>(&x[old]), static_cast<std::streamsize>(m * sizeof(C)));
+        }
+        return x;
+    }
+};
+
+
+/** \class snapshot_reader
+ *
+ * Reads the elements of a snapshot from a stream, in order. It is an input cursor for bst::_build():
+ * dereferencing gives the current element, to be moved from, and the increment reads the next one.
+ * With the arrays layout the keys are read at once into a buffer, then the values one by one.
+ */
+template <typename key_type, typename value_type>
+class snapshot_reader {
+    using key_traits = snapshot_traits<key_type>;
+    using value_traits = snapshot_traits<value_type>;
+
+    /** \brief stream read, as \private is */
+    std::istream& is;
+
+    /** \brief header of the snapshot, as \private header */
+    snapshot_header header;
+
+    /** \brief keys of the arrays layout, as \private keys */
+    std::vector<key_type> keys;
+
+    /** \brief index of the current element, as \private next */
+    std::uint64_t next {0};
+
+    /** \brief current element, as \private current */
+    std::optional<std::pair<key_type, value_type>> current;
+
+    /** \brief skip the padding that brings the snapshot from \p from to \p to bytes */
+    void _skip(std::uint64_t from, std::uint64_t to) {
+        is.ignore(static_cast<std::streamsize>(to - from));
+    }
+
+    /** \brief read the element of index next
+     *
+     * \throws std::runtime_error if the stream ends before */
+    void _read() {
+        if(header.layout == snapshot_header::arrays)
+            current.emplace(std::move(keys[next]), value_traits::read(is));
+        else {
+            auto k = key_traits::read(is);
+            current.emplace(std::move(k), value_traits::read(is));
+        }
+        if(!is)
+            throw std::runtime_error{"In function load(): the snapshot is truncated"};
+    }
+
+    public:
+
+    /** \brief Custom snapshot_reader Constructor
+     *
+     * Reads the header from \p s and checks it, then the first element.
+     * \throws std::runtime_error if the snapshot does not match the types or is truncated */
+    explicit snapshot_reader(std::istream& s): is{s} {
+        is.read(reinterpret_cast<char*>(&header), sizeof(header));
+        if(!is)
+            throw std::runtime_error{"In function load(): the snapshot is truncated"};
+        header.check(key_traits::fixed_size, value_traits::fixed_size);
+        if(!header.size)
+            return;
+        if(header.layout == snapshot_header::arrays) {
+            if(header.size > keys.max_size())
+                throw std::runtime_error{"In function load(): the snapshot is too large"};
+            _skip(sizeof(header), snapshot_header::keys_offset<key_type>());
+            // grown chunk by chunk, so that a corrupted size fails on the stream and not on the allocation
+            constexpr std::uint64_t chunk {std::uint64_t{1} << 20};
+            while(is && keys.size() < header.size) {
+                const auto m = static_cast<std::size_t>(std::min(chunk, header.size - keys.size()));
+                const auto old = keys.size();
+                keys.resize(old + m);
+                is.read(reinterpret_cast<char*>(keys.data() + old), static_cast<std::streamsize>(m * sizeof(key_type)));
+            }
+            if(!is)
+                throw std::runtime_error{"In function load(): the snapshot is truncated"};
+            _skip(snapshot_header::keys_offset<key_type>() + header.size * sizeof(key_type),
+                  header.values_offset<key_type, value_type>());
+        }
+        _read();
+    }
+
+    /** \brief number of elements of the snapshot */
+    std::uint64_t size() const noexcept {
+        return header.size;
+    }
+
+    /** \brief star operator overload, the current element */
+    std::pair<key_type, value_type>&& operator*() noexcept {
+        return std::move(*current);
+    }
+
+    /** \brief ++ overload, reads the next element if any */
+    snapshot_reader& operator++() {
+        if(++next < header.size)
+            _read();
+        return *this;
+    }
+};
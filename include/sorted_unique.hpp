@@ -0,0 +1,14 @@
+#pragma once
+
+
+/** \brief tag for sorted input
+ * 
+ * Tag type used to tell a container that a range is already sorted by key, without duplicates. */
+struct sorted_unique_t {
+    explicit sorted_unique_t() = default;
+};
+
+/** \brief tag for sorted input
+ * 
+ * Instance of sorted_unique_t to be passed to the range constructors and to assign(). */
+inline constexpr sorted_unique_t sorted_unique {};
@@ -0,0 +1,475 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <memory> // std::allocator_traits
+#include <new>
+#include <stdexcept>
+#include <type_traits>
+#include <utility> // std::move
+#include <vector>
+#include "node.hpp"
+#include "flat_node.hpp"
+#include "node_pool.hpp"
+
+
+/** \brief in-order visit
+ *
+ * Calls \p f on every node of the tree rooted in \p x , in order, through the parent pointers.
+ * The successor is found before calling \p f , so that \p f can destroy the node.
+ */
+template <typename node_type, typename F>
+void visit_in_order(node_type* x, F f) {
+    x = x ? x->leftiest() : nullptr;
+    while(x) {
+        auto next = x->get_right() ? x->get_right()->leftiest() : nullptr;
+        if(!next) {
+            auto child {x};
+            next = x->get_parent();
+            while(next && next->get_right() == child) {
+                child = next;
+                next = next->get_parent();
+            }
+        }
+        f(x);
+        x = next;
+    }
+}
+
+/** \brief pre-order visit
+ *
+ * Calls \p f on every node of the tree rooted in \p x , in pre-order, through the parent pointers.
+ * \p f must not change the links of the tree.
+ */
+template <typename node_type, typename F>
+void visit_pre_order(node_type* x, F f) {
+    auto top {x ? x->get_parent() : nullptr};
+    while(x) {
+        f(x);
+        if(x->get_left()) {
+            x = x->get_left();
+        }
+        else if(x->get_right()) {
+            x = x->get_right();
+        }
+        else {
+            // go up until we come from a left child that has a right sibling
+            auto parent {x->get_parent()};
+            while(parent != top && (parent->get_right() == x || !parent->get_right())) {
+                x = parent;
+                parent = parent->get_parent();
+            }
+            x = parent != top ? parent->get_right() : nullptr;
+        }
+    }
+}
+
+
+/** \class linked_storage
+ *
+ * Default storage policy of the bst: every node is allocated on its own through the allocator,
+ * rebound to the node type, and linked to its neighbours with pointers.
+ * Nodes never move, so iterators stay valid until their element is erased.
+ */
+struct linked_storage {
+
+    /** \class backend
+     *
+     * Storage of the nodes of a bst of \p pair_type with augmentation \p augment . */
+    template <typename pair_type, typename augment, typename allocator>
+    class backend {
+        public:
+
+        /** using declaration for node_type. Represents the node stored by the backend. */
+        using node_type = node<pair_type, augment>;
+        /** using declaration for node_allocator. Represents the allocator rebound to the node type. */
+        using node_allocator = typename std::allocator_traits<allocator>::template rebind_alloc<node_type>;
+
+        private:
+
+        /** using declaration for alloc_traits. Represents the traits of the node allocator. */
+        using alloc_traits = std::allocator_traits<node_allocator>;
+
+        /** \brief node allocator, as \private alloc */
+        node_allocator alloc;
+
+        public:
+
+        /** \brief a node can leave the tree in a node_handle, since it is allocated on its own */
+        static constexpr bool detachable {true};
+
+        /** \brief Default backend Constructor */
+        backend() = default;
+
+        /** \brief Custom backend Constructor, allocates through \p a */
+        explicit backend(const allocator& a): alloc{a} {}
+
+        /** \brief Custom backend Constructor, allocates through \p a */
+        explicit backend(const node_allocator& a): alloc{a} {}
+
+        /** \brief Move Constructor, the allocator is moved along with the nodes */
+        backend(backend&& other) noexcept: alloc{std::move(other.alloc)} {}
+
+        backend(const backend&) = delete;
+        backend& operator=(const backend&) = delete;
+
+        /** \brief empty backend for a copy of the tree, with the allocator chosen by the allocator traits */
+        backend select_on_container_copy_construction() const {
+            return backend{alloc_traits::select_on_container_copy_construction(alloc)};
+        }
+
+        /** \brief get allocator */
+        const node_allocator& get_allocator() const noexcept {
+            return alloc;
+        }
+
+        /** \brief take over the nodes of \p other
+         *
+         * Possible if the allocator propagates on move assignment or is equal to the one of \p other .
+         * This backend must hold no node. \returns false if the nodes have to be moved one by one. */
+        bool adopt(backend& other) noexcept {
+            if constexpr (alloc_traits::propagate_on_container_move_assignment::value)
+                alloc = std::move(other.alloc);
+            else if(alloc != other.alloc)
+                return false;
+            return true;
+        }
+
+        /** \brief check if the nodes of \p other can be moved here
+         *
+         * True if the allocators are equal, so that this backend can destroy the nodes created by \p other . */
+        bool shares_nodes(const backend& other) const noexcept {
+            return alloc == other.alloc;
+        }
+
+        /** \brief check if \p n more nodes can be created without reserve(), always */
+        bool has_room(std::size_t) const noexcept {
+            return true;
+        }
+
+        /** \brief make room for \p n more nodes
+         *
+         * Nothing to do: nodes are allocated one by one and never move. */
+        void reserve(std::size_t, node_type*&) noexcept {}
+
+        /** \brief lay out the nodes in the order of the tree
+         *
+         * Nothing to do: the position of the nodes is decided by the allocator. */
+        void renumber(node_type*&) noexcept {}
+
+        /** \brief create a node
+         *
+         * Allocates a node through the allocator and constructs it with \p args . */
+        template <typename... Types>
+        node_type* create(Types&&... args) {
+            auto x = alloc_traits::allocate(alloc, 1);
+            try {
+                alloc_traits::construct(alloc, x, std::forward<Types>(args)...);
+            }
+            catch(...) {
+                alloc_traits::deallocate(alloc, x, 1);
+                throw;
+            }
+            return x;
+        }
+
+        /** \brief destroy a node
+         *
+         * Destroys \p x and gives its memory back to the allocator. */
+        void destroy(node_type* x) noexcept {
+            alloc_traits::destroy(alloc, x);
+            alloc_traits::deallocate(alloc, x, 1);
+        }
+
+        /** \brief destroy all the nodes at once
+         *
+         * When the allocator owns a whole arena, like node_pool, the pairs of the tree rooted in \p head
+         * are destroyed and the memory is released in chunks.
+         * \returns false if the nodes have to be destroyed one by one */
+        bool release(node_type* head) noexcept {
+            if constexpr (is_releasable<node_allocator>::value) {
+                if(alloc.unique()) {
+                    if constexpr (!std::is_trivially_destructible<node_type>::value)
+                        visit_in_order(head, [this](node_type* x) { alloc_traits::destroy(alloc, x); });
+                    alloc.release();
+                    return true;
+                }
+            }
+            (void)head;
+            return false;
+        }
+    };
+};
+
+
+/** \class flat_storage
+ *
+ * Storage policy of the bst that keeps all the nodes in a single contiguous array,
+ * allocated through the allocator rebound to flat_node, whose links are 32-bit offsets.
+ * Erased slots are kept in a free list and reused. When the array is full it doubles and
+ * the nodes are moved in pre-order, which is also done by bst::balance(): a parent and its
+ * left child are then adjacent, and every subtree takes a contiguous range of slots.
+ * Growing and balancing invalidate all the iterators.
+ * A tree holds at most 2^31 - 1 elements.
+ */
+struct flat_storage {
+
+    /** \class backend
+     *
+     * Storage of the nodes of a bst of \p pair_type with augmentation \p augment . */
+    template <typename pair_type, typename augment, typename allocator>
+    class backend {
+        public:
+
+        /** using declaration for node_type. Represents the node stored by the backend. */
+        using node_type = flat_node<pair_type, augment>;
+        /** using declaration for node_allocator. Represents the allocator rebound to the node type. */
+        using node_allocator = typename std::allocator_traits<allocator>::template rebind_alloc<node_type>;
+
+        private:
+
+        /** using declaration for alloc_traits. Represents the traits of the node allocator. */
+        using alloc_traits = std::allocator_traits<node_allocator>;
+        /** using declaration for index_type. Represents the position of a slot in the array. */
+        using index_type = std::uint32_t;
+
+        static_assert(sizeof(node_type) >= sizeof(index_type), "a free slot stores the index of the next one");
+
+        /** \brief no slot */
+        static constexpr index_type none {std::numeric_limits<index_type>::max()};
+        /** \brief capacity of the first array */
+        static constexpr std::size_t min_capacity {16};
+        /** \brief maximum number of nodes, the offsets are signed 32-bit integers */
+        static constexpr std::size_t max_capacity {static_cast<std::size_t>(std::numeric_limits<std::int32_t>::max())};
+
+        /** \brief node allocator, as \private alloc */
+        node_allocator alloc;
+
+        /** \brief array of the nodes, as \private slots */
+        node_type* slots {nullptr};
+
+        /** \brief size of the array, as \private capacity */
+        std::size_t capacity {0};
+
+        /** \brief slots handed out at least once, as \private used */
+        std::size_t used {0};
+
+        /** \brief live nodes, as \private live */
+        std::size_t live {0};
+
+        /** \brief first slot of the free list, as \private free_list */
+        index_type free_list {none};
+
+        /** \brief next slot of the free list, stored in place of the destroyed node \p x */
+        static index_type& _next_free(node_type* x) noexcept {
+            return *std::launder(reinterpret_cast<index_type*>(x));
+        }
+
+        /** \brief give back the array */
+        void _deallocate() noexcept {
+            if(slots)
+                alloc_traits::deallocate(alloc, slots, capacity);
+            slots = nullptr;
+            capacity = used = live = 0;
+            free_list = none;
+        }
+
+        /** \brief move the nodes to a new array
+         *
+         * Moves the tree rooted in \p head to a new array of \p new_capacity slots, in pre-order,
+         * and releases the old one. If an exception is thrown, the tree is left where it was.
+         * \returns the new root, at the beginning of the array */
+        node_type* _relocate(node_type* head, std::size_t new_capacity) {
+            auto fresh = alloc_traits::allocate(alloc, new_capacity);
+            std::size_t moved {0};
+            try {
+                // position of every live node in the new array
+                std::vector<index_type> position(used, none);
+                index_type next {0};
+                visit_pre_order(head, [&](node_type* x) { position[x - slots] = next++; });
+                auto target = [&](node_type* x) { return x ? fresh + position[x - slots] : nullptr; };
+
+                visit_pre_order(head, [&](node_type* x) {
+                    auto y = fresh + moved;
+                    alloc_traits::construct(alloc, y, std::in_place, std::move_if_noexcept(x->get_data()));
+                    ++moved;
+                    static_cast<augment&>(*y) = *x;
+                    y->set_parent(target(x->get_parent()));
+                    y->set_left(target(x->get_left()));
+                    y->set_right(target(x->get_right()));
+                });
+                for(std::size_t i = 0; i < used; ++i)
+                    if(position[i] != none)
+                        alloc_traits::destroy(alloc, slots + i);
+            }
+            catch(...) {
+                for(std::size_t i = 0; i < moved; ++i)
+                    alloc_traits::destroy(alloc, fresh + i);
+                alloc_traits::deallocate(alloc, fresh, new_capacity);
+                throw;
+            }
+            const auto count {live};
+            _deallocate();
+            slots = fresh;
+            capacity = new_capacity;
+            used = live = count;
+            return head ? fresh : nullptr;
+        }
+
+        public:
+
+        /** \brief nodes cannot leave the tree in a node_handle, they are slots of its array */
+        static constexpr bool detachable {false};
+
+        /** \brief Default backend Constructor, no array is allocated */
+        backend() = default;
+
+        /** \brief Custom backend Constructor, allocates through \p a */
+        explicit backend(const allocator& a): alloc{a} {}
+
+        /** \brief Custom backend Constructor, allocates through \p a */
+        explicit backend(const node_allocator& a): alloc{a} {}
+
+        /** \brief Move Constructor, steals the array */
+        backend(backend&& other) noexcept:
+        alloc{std::move(other.alloc)}, slots{other.slots}, capacity{other.capacity},
+        used{other.used}, live{other.live}, free_list{other.free_list} {
+            other.slots = nullptr;
+            other.capacity = other.used = other.live = 0;
+            other.free_list = none;
+        }
+
+        backend(const backend&) = delete;
+        backend& operator=(const backend&) = delete;
+
+        /** \brief backend Destructor, gives back the array. The nodes must be already destroyed. */
+        ~backend() noexcept {
+            _deallocate();
+        }
+
+        /** \brief empty backend for a copy of the tree, with the allocator chosen by the allocator traits */
+        backend select_on_container_copy_construction() const {
+            return backend{alloc_traits::select_on_container_copy_construction(alloc)};
+        }
+
+        /** \brief get allocator */
+        const node_allocator& get_allocator() const noexcept {
+            return alloc;
+        }
+
+        /** \brief check if the nodes of \p other can be moved here
+         *
+         * Never for another backend: every backend keeps its nodes in its own array. */
+        bool shares_nodes(const backend& other) const noexcept {
+            return this == &other;
+        }
+
+        /** \brief take over the nodes of \p other
+         *
+         * Possible if the allocator propagates on move assignment or is equal to the one of \p other .
+         * This backend must hold no node. \returns false if the nodes have to be moved one by one. */
+        bool adopt(backend& other) noexcept {
+            if constexpr (!alloc_traits::propagate_on_container_move_assignment::value) {
+                if(alloc != other.alloc)
+                    return false;
+            }
+            _deallocate();
+            if constexpr (alloc_traits::propagate_on_container_move_assignment::value)
+                alloc = std::move(other.alloc);
+            slots = other.slots;
+            capacity = other.capacity;
+            used = other.used;
+            live = other.live;
+            free_list = other.free_list;
+            other.slots = nullptr;
+            other.capacity = other.used = other.live = 0;
+            other.free_list = none;
+            return true;
+        }
+
+        /** \brief check if \p n more nodes can be created without reserve(), which would move the nodes */
+        bool has_room(std::size_t n) const noexcept {
+            return n <= capacity - live;
+        }
+
+        /** \brief make room for \p n more nodes
+         *
+         * If there are less than \p n free slots, the array grows (at least doubling) and
+         * the tree rooted in \p head is moved, so \p head is updated. Must be called before create(),
+         * when no pointer to a node other than \p head is held. */
+        void reserve(std::size_t n, node_type*& head) {
+            if(n <= capacity - live)
+                return;
+            if(n > max_capacity - live)
+                throw std::length_error{"In function reserve(): too many nodes for flat_storage"};
+            auto wanted = std::max(std::max(live + n, 2 * capacity), min_capacity);
+            head = _relocate(head, std::min(wanted, max_capacity));
+        }
+
+        /** \brief lay out the nodes in the order of the tree
+         *
+         * Moves the tree rooted in \p head to a new array in pre-order, dropping the free slots,
+         * so \p head is updated. If memory is not available the layout is left as it is. */
+        void renumber(node_type*& head) noexcept {
+            if(!head)
+                return;
+            try {
+                head = _relocate(head, capacity);
+            }
+            catch(...) {}
+        }
+
+        /** \brief create a node
+         *
+         * Constructs a node with \p args in a free slot, reserve() must have been called. */
+        template <typename... Types>
+        node_type* create(Types&&... args) {
+            node_type* x;
+            if(free_list != none) {
+                x = slots + free_list;
+                free_list = _next_free(x);
+            }
+            else if(used < capacity) {
+                x = slots + used++;
+            }
+            else {
+                throw std::logic_error{"In function create(): no slot reserved"};
+            }
+            try {
+                alloc_traits::construct(alloc, x, std::forward<Types>(args)...);
+            }
+            catch(...) {
+                ::new (static_cast<void*>(x)) index_type{free_list};
+                free_list = static_cast<index_type>(x - slots);
+                throw;
+            }
+            ++live;
+            return x;
+        }
+
+        /** \brief destroy a node
+         *
+         * Destroys \p x and pushes its slot on the free list. */
+        void destroy(node_type* x) noexcept {
+            alloc_traits::destroy(alloc, x);
+            ::new (static_cast<void*>(x)) index_type{free_list};
+            free_list = static_cast<index_type>(x - slots);
+            --live;
+        }
+
+        /** \brief destroy all the nodes at once
+         *
+         * Destroys the pairs of the tree rooted in \p head and makes all the slots free,
+         * keeping the array for the next insertions. \returns true */
+        bool release(node_type* head) noexcept {
+            if constexpr (!std::is_trivially_destructible<node_type>::value)
+                visit_in_order(head, [this](node_type* x) { alloc_traits::destroy(alloc, x); });
+            (void)head;
+            used = live = 0;
+            free_list = none;
+            return true;
+        }
+    };
+};
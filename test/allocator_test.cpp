@@ -0,0 +1,150 @@
+#include <map>
+#include <memory>
+#include <random>
+#include <type_traits>
+#include "bst.hpp"
+#include "node_pool.hpp"
+#include "test.hpp"
+
+// The allocator of bst: one node allocated per element and all of them given back, with an
+// allocator that counts them, the move assignment between allocators that differ, and node_pool
+// against std::map through copies and moves.
+
+using P = std::pair<const int, int>;
+
+/** \brief allocator that counts the objects alive, shared by its copies and rebinds;
+ * copies compare equal, and it does not propagate on move assignment */
+template <typename T>
+struct counting {
+    using value_type = T;
+    using propagate_on_container_move_assignment = std::false_type;
+    std::shared_ptr<long> live {std::make_shared<long>(0)};
+
+    counting() = default;
+    template <typename U>
+    counting(const counting<U>& other) noexcept: live{other.live} {}
+
+    T* allocate(std::size_t n) {
+        *live += static_cast<long>(n);
+        return std::allocator<T>{}.allocate(n);
+    }
+    void deallocate(T* p, std::size_t n) noexcept {
+        *live -= static_cast<long>(n);
+        std::allocator<T>{}.deallocate(p, n);
+    }
+    template <typename U>
+    friend bool operator==(const counting& a, const counting<U>& b) noexcept {
+        return a.live == b.live;
+    }
+    template <typename U>
+    friend bool operator!=(const counting& a, const counting<U>& b) noexcept {
+        return !(a == b);
+    }
+};
+
+/** \brief one allocation per element, none left behind */
+template <typename balancing>
+void counted() {
+    using tree = bst<int, int, std::less<int>, no_instrumentation, balancing, counting<P>>;
+    std::mt19937 gen {3};
+    counting<P> a;
+    {
+        tree t {a};
+        std::map<int, int> m;
+        for(int i = 0; i < 20000; ++i) {
+            const int k {static_cast<int>(gen() % 2000)};
+            if(gen() % 3 || m.empty())
+                CHECK(t.insert({k, i}).second == m.insert({k, i}).second);
+            else
+                CHECK(t.erase(k) == m.erase(k));
+        }
+        CHECK(same(t, m));
+        CHECK(*a.live == static_cast<long>(t.size()));
+        // a copy takes the same allocator, a move takes the nodes along
+        tree copy {t};
+        CHECK(copy.get_allocator() == a && *a.live == 2 * static_cast<long>(t.size()));
+        tree moved {std::move(copy)};
+        CHECK(*a.live == 2 * static_cast<long>(t.size()) && same(moved, m));
+        // move assignment between unequal allocators that do not propagate moves the elements
+        counting<P> b;
+        tree other {b};
+        other.insert({-1, -1});
+        other = std::move(moved);
+        CHECK(same(other, m) && moved.size() == 0);
+        CHECK(*b.live == static_cast<long>(m.size()) && *a.live == static_cast<long>(m.size()));
+        t.erase(t.begin(), t.end());
+        CHECK(*a.live == 0);
+        other.clear();
+        CHECK(*b.live == 0);
+        for(int i = 0; i < 100; ++i)
+            t.insert({i, i});
+        t.balance();
+        CHECK(*a.live == 100);
+    }
+    CHECK(*a.live == 0);
+}
+
+/** \brief a move assignment between allocators that differ and do not propagate moves the values,
+ * which can only be moved, into nodes of the target laid out as the source, a path here */
+void unequal_move() {
+    using V = std::unique_ptr<int>;
+    using tree = bst<int, V, std::less<int>, no_instrumentation, no_balancing, counting<std::pair<const int, V>>>;
+    counting<std::pair<const int, V>> a, b;
+    tree source {a}, target {b};
+    for(int i = 0; i < 3000; ++i)
+        source.insert({i, std::make_unique<int>(-i)});
+    target.insert({-1, nullptr});
+    target = std::move(source);
+    CHECK(source.size() == 0 && *a.live == 0 && *b.live == 3000);
+    CHECK(target.size() == 3000 && checked_height(target) == 3000);
+    int k {0};
+    for(const auto& x : target)
+        CHECK(x.first == k && x.second && *x.second == -k++);
+    // and a balanced one keeps its height
+    for(int i = 0; i < 3000; ++i)
+        source.insert({i, std::make_unique<int>(i)});
+    source.balance();
+    const auto height = checked_height(source);
+    target = std::move(source);
+    CHECK(checked_height(target) == height && *a.live == 0 && *b.live == 3000);
+}
+
+/** \brief node_pool against std::map, and the reuse of the freed nodes */
+void pooled() {
+    using tree = bst<int, int, std::less<int>, no_instrumentation, avl_balancing, node_pool<P>>;
+    std::mt19937 gen {4};
+    tree t;
+    std::map<int, int> m;
+    for(int i = 0; i < 50000; ++i) {
+        const int k {static_cast<int>(gen() % 5000)};
+        if(gen() % 3 || m.empty())
+            CHECK(t.insert({k, i}).second == m.insert({k, i}).second);
+        else
+            CHECK(t.erase(k) == m.erase(k));
+    }
+    CHECK(same(t, m));
+    checked_height(t);
+    // the last node freed is the next one handed out
+    const auto k = t.begin()->first;
+    const auto address = &t.begin()->second;
+    t.erase(k);
+    m.erase(k);
+    CHECK(&t.insert({-5, 0}).first->second == address);
+    t.erase(-5);
+    // a copy gets a pool of its own, a move keeps it
+    tree copy {t};
+    CHECK(copy.get_allocator() != t.get_allocator() && same(copy, m));
+    const auto pool = copy.get_allocator();
+    tree moved {std::move(copy)};
+    CHECK(moved.get_allocator() == pool && same(moved, m));
+    t = std::move(moved);
+    CHECK(t.get_allocator() == pool && same(t, m));
+}
+
+int main() {
+    counted<no_balancing>();
+    counted<avl_balancing>();
+    unequal_move();
+    pooled();
+    return finish("allocator_test");
+}
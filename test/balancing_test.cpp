@@ -0,0 +1,347 @@
+#include <algorithm>
+#include <cmath>
+#include <iterator>
+#include <map>
+#include <random>
+#include <sstream>
+#include <vector>
+#include "bst.hpp"
+#include "test.hpp"
+
+// The balancing policies against std::map, and the invariants they keep in the nodes.
+
+using avl = bst<int, int, std::less<int>, no_instrumentation, avl_balancing>;
+
+/** \brief check the subtree sizes stored in the subtree of \p x , \returns its size */
+template <typename node_type>
+std::size_t sizes_checked(const node_type* x) {
+    if(!x)
+        return 0;
+    const std::size_t n {1 + sizes_checked(x->get_left()) + sizes_checked(x->get_right())};
+    CHECK(x->subtree_size == n);
+    return n;
+}
+
+/** \brief root of the non-empty tree \p t */
+template <typename tree>
+auto root_of(const tree& t) {
+    auto x = t.begin().get_node();
+    while(x->get_parent())
+        x = x->get_parent();
+    return x;
+}
+
+/** \brief check the heights stored in the subtree of \p x and its AVL balance, \returns its height */
+template <typename node_type>
+int avl_checked(const node_type* x) {
+    if(!x)
+        return 0;
+    const int l {avl_checked(x->get_left())}, r {avl_checked(x->get_right())};
+    CHECK(l - r <= 1 && r - l <= 1);
+    CHECK(x->height == 1 + std::max(l, r));
+    return 1 + std::max(l, r);
+}
+
+/** \brief the height bound of AVL trees, 1.44 log2(n + 2) */
+bool avl_bounded(std::size_t height, std::size_t n) {
+    return static_cast<double>(height) < 1.4405 * std::log2(static_cast<double>(n) + 2);
+}
+
+/** \brief random insertions and erases, checked against std::map and the AVL invariant */
+void avl_random() {
+    std::mt19937 gen {2};
+    avl t;
+    std::map<int, int> m;
+    for(int i = 0; i < 200000; ++i) {
+        const int k {static_cast<int>(gen() % 5000)};
+        if(gen() % 3 || m.empty())
+            CHECK(t.insert({k, i}).second == m.insert({k, i}).second);
+        else
+            CHECK(t.erase(k) == m.erase(k));
+        if(i % 5000 == 0 && !m.empty()) {
+            CHECK(same(t, m));
+            CHECK(checked_height(t) == static_cast<std::size_t>(avl_checked(root_of(t))));
+            CHECK(avl_bounded(checked_height(t), t.size()));
+        }
+    }
+    // erases by position and balance() keep the invariant too
+    for(int i = 0; i < 1000 && t.size(); ++i) {
+        const int k {t.begin()->first};
+        t.erase(t.begin());
+        m.erase(k);
+    }
+    CHECK(same(t, m));
+    avl_checked(root_of(t));
+    t.balance();
+    CHECK(same(t, m));
+    avl_checked(root_of(t));
+}
+
+/** \brief sorted insertions, the worst case of an unbalanced tree */
+void avl_sorted() {
+    avl t;
+    for(int i = 0; i < 100000; ++i)
+        t.insert({i, i});
+    CHECK(avl_bounded(checked_height(t), t.size()));
+    avl_checked(root_of(t));
+    for(int i = 0; i < 100000; i += 2)
+        t.erase(i);
+    CHECK(t.size() == 50000);
+    CHECK(avl_bounded(checked_height(t), t.size()));
+    avl_checked(root_of(t));
+}
+
+/** \brief select(), rank() and count_range() against std::map, and the sizes stored in the nodes,
+ * through insertions, erases by key and by position, rotations and balance() */
+template <typename tree>
+void order_statistics_random() {
+    std::mt19937 gen {9};
+    tree t;
+    std::map<int, int> m;
+    const auto check = [&] {
+        CHECK(same(t, m));
+        sizes_checked(root_of(t));
+        std::size_t k {0};
+        for(const auto& x : m) {
+            CHECK(t.rank(x.first) == k);
+            CHECK(t.select(k)->first == x.first);
+            ++k;
+        }
+        CHECK(t.select(m.size()) == t.end());
+        for(int i = 0; i < 100; ++i) {
+            const int a {static_cast<int>(gen() % 2100) - 50}, b {static_cast<int>(gen() % 2100) - 50};
+            const auto lo = m.lower_bound(a);
+            const auto expected = a < b ? static_cast<std::size_t>(std::distance(lo, m.lower_bound(b))) : 0;
+            CHECK(t.count_range(a, b) == expected);
+            CHECK(t.rank(a) == static_cast<std::size_t>(std::distance(m.begin(), lo)));
+        }
+    };
+    for(int i = 0; i < 30000; ++i) {
+        const int k {static_cast<int>(gen() % 2000)};
+        switch(gen() % 4) {
+            case 0:
+            case 1:
+                CHECK(t.insert({k, i}).second == m.insert({k, i}).second);
+                break;
+            case 2:
+                if(!m.empty())
+                    CHECK(t.erase(k) == m.erase(k));
+                break;
+            default:
+                // a lookup, that restructures a splay tree
+                CHECK((t.find(k) == t.end()) == (m.find(k) == m.end()));
+        }
+        if(i % 3000 == 2999) {
+            check();
+            auto it = t.lower_bound(k);
+            if(it != t.end()) {
+                m.erase(it->first);
+                t.erase(it);
+            }
+            check();
+            t.balance();
+            check();
+        }
+    }
+}
+
+/** \brief splay_balancing against std::map, and the nodes it moves to the root */
+void splay() {
+    using splay_tree = bst<int, int, std::less<int>, no_instrumentation, splay_balancing<>>;
+    std::mt19937 gen {24};
+    splay_tree t;
+    std::map<int, int> m;
+    for(int i = 0; i < 50000; ++i) {
+        const int k {static_cast<int>(gen() % 2000)};
+        switch(gen() % 4) {
+            case 0:
+                CHECK(t.insert({k, i}).second == m.insert({k, i}).second);
+                CHECK(root_of(t)->get_data().first == k);
+                break;
+            case 1:
+                if(!m.empty())
+                    CHECK(t.erase(k) == m.erase(k));
+                break;
+            case 2: {
+                // a const lookup leaves the tree as it is
+                const auto before = m.empty() ? nullptr : root_of(t);
+                const auto& c = t;
+                CHECK((c.find(k) == c.end()) == (m.find(k) == m.end()));
+                CHECK(m.empty() || root_of(t) == before);
+                break;
+            }
+            default:
+                CHECK((t.find(k) == t.end()) == (m.find(k) == m.end()));
+                CHECK(m.find(k) == m.end() || root_of(t)->get_data().first == k);
+        }
+        if(i % 5000 == 0) {
+            CHECK(same(t, m));
+            checked_height(t);
+        }
+    }
+    // after an erase the deepest node whose subtree changed is splayed: on the perfect tree of
+    // 1 .. 15, the parent of a leaf, the successor when it is the right child, or its old parent
+    for(auto [erased, root] : {std::pair<int, int>{1, 2}, {14, 15}, {4, 6}, {8, 10}}) {
+        t.clear();
+        for(int i = 1; i <= 15; ++i)
+            t.insert({i, i});
+        t.balance();
+        CHECK(root_of(t)->get_data().first == 8);
+        // found through a const reference, which does not splay
+        t.erase(static_cast<const splay_tree&>(t).find(erased));
+        CHECK(root_of(t)->get_data().first == root);
+        CHECK(t.size() == 14 && checked_height(t) > 0);
+    }
+}
+
+using scapegoat = bst<int, int, std::less<int>, no_instrumentation, scapegoat_balancing<>>;
+
+/** \brief the height bound of scapegoat trees with alpha = 3/2: erases can halve the size before
+ * the whole tree is rebuilt, and a rebuilt subtree can be one level deeper than the bound */
+bool scapegoat_bounded(std::size_t height, std::size_t n) {
+    return static_cast<double>(height) <= 1.5 * std::log2(2.0 * static_cast<double>(n)) + 2;
+}
+
+/** \brief random and sorted insertions and erases, checked against std::map and the height bound */
+void scapegoat_random() {
+    std::mt19937 gen {25};
+    scapegoat t;
+    std::map<int, int> m;
+    for(int i = 0; i < 200000; ++i) {
+        const int k {static_cast<int>(gen() % 5000)};
+        if(gen() % 3 || m.empty())
+            CHECK(t.insert({k, i}).second == m.insert({k, i}).second);
+        else
+            CHECK(t.erase(k) == m.erase(k));
+        if(i % 5000 == 0) {
+            CHECK(same(t, m));
+            CHECK(scapegoat_bounded(checked_height(t), t.size()));
+        }
+    }
+    scapegoat sorted;
+    for(int i = 0; i < 100000; ++i) {
+        sorted.insert({i, i});
+        if(i % 9999 == 0)
+            CHECK(scapegoat_bounded(checked_height(sorted), sorted.size()));
+    }
+    for(int i = 0; i < 99000; ++i) {
+        sorted.erase(sorted.begin());
+        if(i % 9999 == 0)
+            CHECK(scapegoat_bounded(checked_height(sorted), sorted.size()));
+    }
+}
+
+/** \brief erase from \p t all the keys but those on its left spine, in random order
+ *
+ * Erasing the other nodes never moves the spine, so a tree that is not rebuilt when it shrinks
+ * ends as a path: the height bound is checked on the way. */
+void shrink(scapegoat& t, std::mt19937& gen) {
+    if(!t.size())
+        return;
+    std::vector<int> spine, others;
+    for(auto x = root_of(t); x; x = x->get_left())
+        spine.push_back(x->get_data().first);
+    for(const auto& x : t)
+        if(std::find(spine.begin(), spine.end(), x.first) == spine.end())
+            others.push_back(x.first);
+    std::shuffle(others.begin(), others.end(), gen);
+    for(std::size_t i = 0; i < others.size(); ++i) {
+        t.erase(others[i]);
+        if(i % 97 == 0)
+            CHECK(scapegoat_bounded(checked_height(t), t.size()));
+    }
+    CHECK(t.size() == spine.size());
+    CHECK(scapegoat_bounded(checked_height(t), t.size()));
+}
+
+/** \brief the operations on many elements at once, each followed by erases that shrink the tree:
+ * the largest size the policy remembers must be the one of the tree they leave */
+void scapegoat_bulk() {
+    std::mt19937 gen {26};
+    const int n {1 << 14};
+    std::vector<std::pair<int, int>> sorted;
+    for(int i = 0; i < n; ++i)
+        sorted.push_back({i * 6, i});
+    scapegoat big {sorted.begin(), sorted.end()};
+
+    // a tree that was large, cleared and refilled
+    {
+        scapegoat t {big};
+        t.clear();
+        t.assign(sorted.begin(), sorted.end());
+        shrink(t, gen);
+        t.clear();
+        for(int i = 0; i < 200; ++i)
+            t.insert({i, i});
+        shrink(t, gen);
+    }
+    // grown by load() and by merge() from an empty tree
+    {
+        std::stringstream ss;
+        big.save(ss);
+        scapegoat t;
+        t.load(ss);
+        CHECK(t.size() == big.size());
+        shrink(t, gen);
+        scapegoat u, v {big};
+        u.merge(v);
+        CHECK(u.size() == big.size() && v.size() == 0);
+        shrink(u, gen);
+    }
+    // shrunk by intersect() and subtract(), then grown by insertions
+    {
+        scapegoat t {big}, few;
+        for(int i = 0; i < 100; ++i)
+            few.insert({i * 6, i});
+        t.intersect(few);
+        CHECK(t.size() == 100);
+        for(int i = 0; i < 2000; ++i)
+            t.insert({static_cast<int>(gen() % 100000), i});
+        shrink(t, gen);
+        scapegoat u {big};
+        u.subtract(scapegoat{sorted.begin() + 50, sorted.end()});
+        CHECK(u.size() == 50 && scapegoat_bounded(checked_height(u), u.size()));
+    }
+    // split off a small part, and join a small tree to a large one
+    {
+        scapegoat t {big};
+        auto right = t.split(6 * 100);
+        CHECK(t.size() == 100 && right.size() == big.size() - 100);
+        CHECK(scapegoat_bounded(checked_height(t), t.size()));
+        CHECK(scapegoat_bounded(checked_height(right), right.size()));
+        shrink(right, gen);
+        t.join(right);
+        CHECK(scapegoat_bounded(checked_height(t), t.size()));
+        scapegoat tail;
+        for(int i = 0; i < 1000; ++i)
+            tail.insert({200000 + i, i});
+        t.join(tail);
+        CHECK(scapegoat_bounded(checked_height(t), t.size()));
+    }
+    // moved from a large tree: the moved-from one is empty and starts again
+    {
+        scapegoat t {big};
+        scapegoat u {std::move(t)};
+        shrink(u, gen);
+        for(int i = 0; i < 300; ++i)
+            t.insert({i, i});
+        shrink(t, gen);
+        scapegoat w;
+        w = std::move(u);
+        CHECK(w.size() > 0 && u.size() == 0);
+        shrink(w, gen);
+    }
+}
+
+int main() {
+    avl_random();
+    avl_sorted();
+    splay();
+    scapegoat_random();
+    scapegoat_bulk();
+    order_statistics_random<bst<int, int, std::less<int>, no_instrumentation, order_statistics<>>>();
+    order_statistics_random<bst<int, int, std::less<int>, no_instrumentation, order_statistics<avl_balancing>>>();
+    order_statistics_random<bst<int, int, std::less<int>, no_instrumentation, order_statistics<splay_balancing<>>>>();
+    order_statistics_random<bst<int, int, std::less<int>, no_instrumentation, order_statistics<scapegoat_balancing<>>>>();
+    return finish("balancing_test");
+}
@@ -0,0 +1,455 @@
+#include <iterator>
+#include <map>
+#include <memory>
+#include <numeric>
+#include <random>
+#include <sstream>
+#include <string>
+#include <string_view>
+#include <vector>
+#include "bst.hpp"
+#include "node_pool.hpp"
+#include "test.hpp"
+
+// The interface of bst against std::map: the statistics of the instrumentation policy,
+// the insertions that build the element in place, the copies of degenerate trees, erase by key, by position and by range, the bounds and the bounded scans, the batched lookups, the
+// lookups by comparable keys of a transparent comparison, and the moves of nodes between trees.
+
+using avl = bst<int, int, std::less<int>, no_instrumentation, avl_balancing>;
+
+/** \brief stats_instrumentation counts the calls and the nodes visited, on a degenerate tree
+ * where they are known exactly */
+void instrumented() {
+    bst<int, int, std::less<int>, stats_instrumentation> t;
+    const auto& stats = t.get_instrumentation();
+    // sorted keys make a path: the insertion of i visits the i nodes before it
+    for(int i = 0; i < 100; ++i)
+        t.insert({i, i});
+    CHECK(stats.calls(operation::insert) == 100);
+    CHECK(stats.nodes_visited(operation::insert) == 99 * 100 / 2);
+    CHECK(stats.max_nodes_visited(operation::insert) == 99);
+    CHECK(t.find(99) != t.end() && t.find(-1) == t.end());
+    CHECK(stats.calls(operation::find) == 2);
+    CHECK(stats.nodes_visited(operation::find) == 101 && stats.max_nodes_visited(operation::find) == 100);
+    CHECK(stats.mean_nodes_visited(operation::find) == 50.5);
+    CHECK(t.erase(50) == 1 && t.erase(50) == 0);
+    CHECK(stats.calls(operation::erase) == 2 && stats.max_nodes_visited(operation::erase) == 51);
+    t.balance();
+    CHECK(stats.calls(operation::balance) == 1);
+    for(auto op : {operation::insert, operation::find, operation::erase, operation::balance}) {
+        const auto& h = stats.latency_histogram(op);
+        CHECK(std::accumulate(h.begin(), h.end(), std::size_t{0}) == stats.calls(op));
+        CHECK(stats.latency_percentile(op, 50) <= stats.latency_percentile(op, 100));
+    }
+    // lookups in the balanced tree visit at most its height
+    t.get_instrumentation().reset();
+    CHECK(stats.calls(operation::insert) == 0 && stats.calls(operation::find) == 0);
+    for(int i = 0; i < 100; ++i)
+        CHECK((t.find(i) == t.end()) == (i == 50));
+    CHECK(stats.calls(operation::find) == 100 && stats.max_nodes_visited(operation::find) == checked_height(t));
+}
+
+/** \brief \p it advanced \p k times, the iterators of bst are forward ones without traits */
+template <typename It>
+It nth(It it, long k) {
+    while(k--)
+        ++it;
+    return it;
+}
+
+/** \brief insert(), emplace(), try_emplace(), insert_or_assign() and operator[] against std::map,
+ * with values that can only be moved, which the calls that find the key leave untouched */
+template <typename tree>
+void emplacing() {
+    std::mt19937 gen {4};
+    tree t;
+    std::map<int, std::unique_ptr<int>> m;
+    // the value of the element with key k, -1 for a null pointer, 0 if absent
+    auto value = [](const auto& c, int k) {
+        const auto it = c.find(k);
+        return it == c.end() ? 0 : it->second ? *it->second : -1;
+    };
+    for(int i = 1; i < 20000; ++i) {
+        const int k {static_cast<int>(gen() % 2000)};
+        auto v = std::make_unique<int>(i);
+        auto w = std::make_unique<int>(i);
+        const bool present {m.count(k) == 1};
+        switch(m.empty() ? 0 : gen() % 5) {
+            case 0: {
+                auto r = t.try_emplace(k, std::move(v));
+                auto mr = m.try_emplace(k, std::move(w));
+                CHECK(r.second == mr.second && r.first->first == k);
+                // a present key leaves the argument where it was
+                CHECK((v == nullptr) == !present && (w == nullptr) == !present);
+                break;
+            }
+            case 1: {
+                auto r = t.insert_or_assign(k, std::move(v));
+                CHECK(r.second == m.insert_or_assign(k, std::move(w)).second);
+                CHECK(r.first->first == k && *r.first->second == i);
+                break;
+            }
+            case 2:
+                CHECK(t.emplace(k, std::move(v)).second == m.emplace(k, std::move(w)).second);
+                break;
+            case 3: {
+                // builds a null value for a new key
+                const bool null {t[k] == nullptr};
+                m[k];
+                CHECK(present || null);
+                break;
+            }
+            default:
+                CHECK(t.erase(k) == m.erase(k));
+        }
+        CHECK(value(t, k) == value(m, k));
+    }
+    CHECK(t.size() == m.size());
+    for(const auto& x : m)
+        CHECK(value(t, x.first) == value(m, x.first));
+    checked_height(t);
+}
+
+/** \brief make \p t the path of the keys 0, ..., \p n - 1 , each the right child of the one before
+ *
+ * Sorted insertions would take O(n^2): without balancing join() hangs the right tree from the
+ * rightmost node of the left one, so the keys are put in front one at a time in O(1). */
+template <typename tree>
+void path(tree& t, int n, std::map<int, int>& m) {
+    for(int k = n - 1; k >= 0; --k) {
+        tree front;
+        front.insert({k, -k});
+        front.join(t);
+        t = std::move(front);
+        m.insert({k, -k});
+    }
+}
+
+/** \brief copy, copy assignment, clear() and destruction of a degenerate tree deeper than
+ * any recursion would survive, and print2D() of a shorter one, whose output grows with the
+ * square of the depth */
+void degenerate() {
+    using tree = bst<int, int>;
+    std::map<int, int> m;
+    {
+        tree t;
+        path(t, 300000, m);
+        // every node but the last has only a right child
+        std::size_t linked {0};
+        for(auto it = t.begin(); it != t.end(); ++it)
+            linked += !it.get_node()->get_left() && (it.get_node()->get_right() != nullptr) == (it->first != 299999);
+        CHECK(same(t, m) && linked == m.size());
+        tree copy {t};
+        CHECK(same(copy, m));
+        tree assigned;
+        for(int i = 0; i < 100; ++i)
+            assigned.insert({-i, i});
+        assigned = copy;
+        CHECK(same(assigned, m));
+        copy.clear();
+        CHECK(copy.size() == 0 && copy.begin() == copy.end() && same(assigned, m) && same(t, m));
+    }
+    m.clear();
+    tree t;
+    path(t, 2000, m);
+    std::ostringstream os, expected;
+    t.print2D(os);
+    // the greatest key first, each one level deeper than the next
+    for(int k = 1999; k >= 0; --k)
+        expected << '\n' << std::string(static_cast<std::size_t>(10 * k), ' ') << k << '\n';
+    CHECK(os.str() == expected.str());
+    const tree copy {t};
+    std::ostringstream copied;
+    copy.print2D(copied);
+    CHECK(copied.str() == expected.str());
+}
+
+/** \brief erase by key, by iterator and by range, checking the returned count and positions */
+template <typename tree>
+void erase() {
+    std::mt19937 gen {6};
+    tree t;
+    std::map<int, int> m;
+    for(int round = 0; round < 200; ++round) {
+        for(int i = 0; i < 100; ++i) {
+            const int k {static_cast<int>(gen() % 1000)};
+            t.insert({k, i});
+            m.insert({k, i});
+        }
+        // by key, present or not
+        for(int i = 0; i < 20; ++i) {
+            const int k {static_cast<int>(gen() % 1000)};
+            CHECK(t.erase(k) == m.erase(k));
+        }
+        CHECK(same(t, m));
+        if(m.empty())
+            continue;
+        // by iterator: the returned one points to the following element
+        const auto at = static_cast<long>(gen() % m.size());
+        auto it = t.erase(nth(t.begin(), at));
+        auto mit = m.erase(std::next(m.begin(), at));
+        CHECK((it == t.end()) == (mit == m.end()));
+        CHECK(it == t.end() || it->first == mit->first);
+        CHECK(same(t, m));
+        // by range, possibly empty, and the returned iterator is the end of the range
+        if(m.size() < 2)
+            continue;
+        const auto first = static_cast<long>(gen() % m.size());
+        const auto count = static_cast<long>(gen() % (m.size() - static_cast<std::size_t>(first)));
+        const auto last = nth(t.cbegin(), first + count);
+        it = t.erase(nth(t.cbegin(), first), last);
+        mit = m.erase(std::next(m.begin(), first), std::next(m.begin(), first + count));
+        CHECK(decltype(last){it} == last);
+        CHECK(same(t, m));
+        checked_height(t);
+    }
+    // everything, by range, then by iterator from the greatest key
+    t.erase(t.cbegin(), t.cend());
+    CHECK(t.size() == 0 && t.begin() == t.end());
+    for(int i = 0; i < 100; ++i)
+        t.insert({i, i});
+    for(int i = 99; i >= 0; --i)
+        CHECK(t.erase(t.find(i)) == t.end());
+    CHECK(t.begin() == t.end());
+}
+
+/** \brief lower_bound(), upper_bound(), equal_range() and range() for every key and gap of a random tree */
+template <typename tree>
+void bounds() {
+    std::mt19937 gen {8};
+    tree t;
+    std::map<int, int> m;
+    for(int i = 0; i < 300; ++i) {
+        const int k {3 * static_cast<int>(gen() % 400)};
+        t.insert({k, i});
+        m.insert({k, i});
+    }
+    const auto& c = t;
+    for(int k = -2; k < 1203; ++k) {
+        const auto lo = t.lower_bound(k);
+        const auto mlo = m.lower_bound(k);
+        CHECK((lo == t.end()) == (mlo == m.end()) && (lo == t.end() || lo->first == mlo->first));
+        const auto up = c.upper_bound(k);
+        const auto mup = m.upper_bound(k);
+        CHECK((up == c.end()) == (mup == m.end()) && (up == c.end() || up->first == mup->first));
+        const auto [first, last] = t.equal_range(k);
+        const auto [mfirst, mlast] = m.equal_range(k);
+        CHECK((first == t.end()) == (mfirst == m.end()) && (first == t.end() || first->first == mfirst->first));
+        CHECK((last == t.end()) == (mlast == m.end()) && (last == t.end() || last->first == mlast->first));
+        // the scans from k to a few keys later, and the empty ones with the bounds swapped
+        for(int b : {k - 1, k, k + 1, k + 7, k + 100}) {
+            std::map<int, int> scanned, expected;
+            for(const auto& x : c.range(k, b))
+                scanned.insert(x);
+            if(k < b)
+                expected.insert(m.lower_bound(k), m.lower_bound(b));
+            CHECK(scanned == expected);
+        }
+    }
+    // the elements of a scan can be changed in place
+    for(auto& x : t.range(300, 600))
+        x.second = -1;
+    for(auto it = m.lower_bound(300); it != m.lower_bound(600); ++it)
+        it->second = -1;
+    CHECK(same(t, m));
+}
+
+/** \brief find_batch() and contains_batch() against std::map, for batches shorter and longer than
+ * the lookups walked together, with repeated and missing keys, and on an empty tree */
+template <typename tree>
+void batches() {
+    std::mt19937 gen {19};
+    tree t;
+    std::map<int, int> m;
+    for(std::size_t n : {0, 1, 15, 16, 17, 33, 1000}) {
+        std::vector<int> keys;
+        for(std::size_t i = 0; i < n; ++i)
+            keys.push_back(static_cast<int>(gen() % 3000));
+        const auto& c = t;
+        std::vector<decltype(c.end())> found;
+        std::vector<bool> contained;
+        c.find_batch(keys.begin(), keys.end(), std::back_inserter(found));
+        c.contains_batch(keys.begin(), keys.end(), std::back_inserter(contained));
+        CHECK(found.size() == n && contained.size() == n);
+        for(std::size_t i = 0; i < found.size(); ++i) {
+            const auto it = m.find(keys[i]);
+            CHECK((found[i] == c.end()) == (it == m.end()) && contained[i] == (it != m.end()));
+            CHECK(found[i] == c.end() || (found[i]->first == it->first && found[i]->second == it->second));
+        }
+        // the iterators of the non-const version write to the elements
+        std::vector<decltype(t.end())> writable(n, t.end());
+        CHECK(t.find_batch(keys.begin(), keys.end(), writable.begin()) == writable.end());
+        for(std::size_t i = 0; i < n; ++i)
+            if(writable[i] != t.end()) {
+                writable[i]->second = keys[i];
+                m[keys[i]] = keys[i];
+            }
+        CHECK(same(t, m));
+        for(int i = 0; i < 1000; ++i) {
+            const int k {static_cast<int>(gen() % 2000)};
+            t.insert({k, i});
+            m.insert({k, i});
+        }
+    }
+}
+
+/** \brief a key that counts how many times it has been built from a string */
+struct name {
+    static inline int built {0};
+    std::string s;
+    explicit name(std::string_view x): s{x} {
+        ++built;
+    }
+};
+
+/** \brief transparent comparison of names with names and with string views */
+struct by_name {
+    using is_transparent = void;
+    bool operator()(const name& a, const name& b) const noexcept {
+        return a.s < b.s;
+    }
+    bool operator()(const name& a, std::string_view b) const noexcept {
+        return a.s < b;
+    }
+    bool operator()(std::string_view a, const name& b) const noexcept {
+        return a < b.s;
+    }
+};
+
+/** \brief lookups by std::string_view against std::map<std::string, int, std::less<>>,
+ * without building any key */
+void transparent() {
+    bst<name, int, by_name> t;
+    std::map<std::string, int, std::less<>> m;
+    for(int i = 0; i < 500; i += 2) {
+        t.insert({name{std::to_string(i)}, i});
+        m.insert({std::to_string(i), i});
+    }
+    const auto& c = t;
+    name::built = 0;
+    for(int i = -1; i < 502; ++i) {
+        const auto s = std::to_string(i);
+        const std::string_view k {s};
+        const bool present {m.count(k) == 1};
+        CHECK(t.contains(k) == present && c.count(k) == m.count(k));
+        CHECK((t.find(k) == t.end()) == !present && (c.find(k) == c.end()) == !present);
+        CHECK(!present || (t.find(k)->second == i && c.find(k)->second == i));
+        const auto lo = t.lower_bound(k);
+        const auto mlo = m.lower_bound(k);
+        CHECK((lo == t.end()) == (mlo == m.end()) && (lo == t.end() || lo->first.s == mlo->first));
+        const auto up = c.upper_bound(k);
+        const auto mup = m.upper_bound(k);
+        CHECK((up == c.end()) == (mup == m.end()) && (up == c.end() || up->first.s == mup->first));
+        const auto range = t.equal_range(k);
+        CHECK(range.first == lo && (range.second == t.end()) == (mup == m.end()));
+    }
+    CHECK(name::built == 0);
+    // operator[] builds the key only to insert it, erase() and extract() never do
+    t[std::string_view{"10"}] += 1;
+    CHECK(name::built == 0 && t.find(std::string_view{"10"})->second == 11);
+    t[std::string_view{"11"}] = 7;
+    CHECK(name::built == 1 && t.size() == 251);
+    CHECK(t.erase(std::string_view{"11"}) == 1 && t.erase(std::string_view{"11"}) == 0);
+    auto h = t.extract(std::string_view{"12"});
+    CHECK(!h.empty() && h.mapped() == 12 && t.size() == 249);
+    CHECK(t.extract(std::string_view{"13"}).empty());
+    CHECK(name::built == 1);
+}
+
+/** \brief nodes moved at random between two trees, as between two std::map with extract() and insert()
+ *
+ * With allocators that compare equal the node itself is moved, so the element keeps its address;
+ * otherwise its content is moved into a node of the destination. */
+template <typename tree>
+void node_handles(bool same_allocator) {
+    std::mt19937 gen {23};
+    tree a, b;
+    std::map<int, int> ma, mb;
+    for(int i = 0; i < 2000; ++i) {
+        const int k {static_cast<int>(gen() % 3000)};
+        a.insert({k, i});
+        ma.insert({k, i});
+    }
+    for(int i = 0; i < 5000; ++i) {
+        const bool forth {gen() % 2 == 0};
+        auto& from = forth ? a : b;
+        auto& to = forth ? b : a;
+        auto& mfrom = forth ? ma : mb;
+        auto& mto = forth ? mb : ma;
+        const int k {static_cast<int>(gen() % 3000)};
+        // by key, or by position of the first key not less than k
+        auto h = gen() % 2 ? from.extract(k) : (from.lower_bound(k) == from.end() ? typename tree::node_handle{} : from.extract(from.lower_bound(k)));
+        auto mh = h ? mfrom.extract(h.key()) : decltype(mfrom.extract(k)){};
+        CHECK(h.empty() == mh.empty());
+        if(h.empty())
+            continue;
+        CHECK(h.key() == mh.key() && h.mapped() == mh.mapped());
+        const auto address = &h.mapped();
+        // sometimes under another key, maybe a present one
+        if(gen() % 4 == 0) {
+            h.key() = mh.key() = static_cast<int>(gen() % 3000);
+        }
+        auto r = to.insert(std::move(h));
+        auto mr = mto.insert(std::move(mh));
+        CHECK(r.inserted == mr.inserted);
+        CHECK(r.position != to.end() && r.position->first == mr.position->first && r.position->second == mr.position->second);
+        if(r.inserted) {
+            CHECK(r.node.empty());
+            CHECK((&r.position->second == address) == same_allocator);
+        }
+        // a handle left with a node, whose key is present, destroys it when dropped
+        else
+            CHECK(!r.node.empty() && r.node.key() == mr.node.key());
+        if(i % 500 == 0) {
+            CHECK(same(a, ma) && same(b, mb));
+            checked_height(a);
+            checked_height(b);
+        }
+    }
+    CHECK(same(a, ma) && same(b, mb));
+    // an empty handle inserts nothing
+    auto r = a.insert(typename tree::node_handle{});
+    CHECK(!r.inserted && r.position == a.end() && r.node.empty());
+}
+
+/** \brief a node moved between trees of different arenas lives on after the source tree */
+void other_arena() {
+    using pooled = bst<int, std::string, std::less<int>, no_instrumentation, avl_balancing, node_pool<std::pair<const int, std::string>>>;
+    pooled b;
+    {
+        pooled a;
+        for(int i = 0; i < 100; ++i)
+            a.insert({i, std::string(50, static_cast<char>('a' + i % 26))});
+        CHECK(!(a.get_allocator() == b.get_allocator()));
+        for(int i = 0; i < 100; i += 3)
+            CHECK(b.insert(a.extract(i)).inserted);
+        // a handle keeps its node after the tree is cleared
+        auto kept = a.extract(1);
+        a.clear();
+        CHECK(kept.mapped() == std::string(50, 'b'));
+    }
+    CHECK(b.size() == 34 && b.find(99)->second == std::string(50, static_cast<char>('a' + 99 % 26)));
+}
+
+int main() {
+    instrumented();
+    emplacing<bst<int, std::unique_ptr<int>>>();
+    emplacing<bst<int, std::unique_ptr<int>, std::less<int>, no_instrumentation, avl_balancing>>();
+    emplacing<bst<int, std::unique_ptr<int>, std::less<int>, no_instrumentation, splay_balancing<>>>();
+    degenerate();
+    erase<bst<int, int>>();
+    erase<avl>();
+    bounds<bst<int, int>>();
+    bounds<avl>();
+    bounds<bst<int, int, std::less<int>, no_instrumentation, no_balancing, std::allocator<std::pair<const int, int>>, flat_storage>>();
+    batches<bst<int, int>>();
+    batches<avl>();
+    batches<bst<int, int, std::less<int>, no_instrumentation, no_balancing, std::allocator<std::pair<const int, int>>, flat_storage>>();
+    transparent();
+    node_handles<bst<int, int>>(true);
+    node_handles<avl>(true);
+    node_handles<bst<int, int, std::less<int>, no_instrumentation, order_statistics<splay_balancing<>>>>(true);
+    node_handles<bst<int, int, std::less<int>, no_instrumentation, avl_balancing, node_pool<std::pair<const int, int>>>>(false);
+    other_arena();
+    return finish("bst_test");
+}
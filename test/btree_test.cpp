@@ -0,0 +1,125 @@
+#include <algorithm>
+#include <map>
+#include <random>
+#include <string>
+#include "btree.hpp"
+#include "test.hpp"
+
+// btree against std::map: random insertions and erases of every kind, on keys of two sizes so that
+// the nodes hold 64 and 16 keys, with the bounds probed between them, and the copies and moves.
+
+/** \brief \p it advanced \p k times */
+template <typename It>
+It nth(It it, std::size_t k) {
+    while(k--)
+        ++it;
+    return it;
+}
+
+/** \brief check lower_bound(), upper_bound() and find() of \p t for the key \p k */
+template <typename tree, typename model, typename key>
+void probed(const tree& t, const model& m, const key& k) {
+    const auto lo = t.lower_bound(k);
+    const auto mlo = m.lower_bound(k);
+    CHECK((lo == t.end()) == (mlo == m.end()) && (lo == t.end() || lo->first == mlo->first));
+    const auto up = t.upper_bound(k);
+    const auto mup = m.upper_bound(k);
+    CHECK((up == t.end()) == (mup == m.end()) && (up == t.end() || up->first == mup->first));
+    const auto found = t.find(k);
+    CHECK((found == t.end()) == (m.find(k) == m.end()));
+}
+
+/** \brief the tree grows to thousands of elements, then shrinks to none, so that the nodes
+ * are split, borrow from their siblings and are merged */
+template <typename key_type, typename key_of>
+void random_operations(key_of key) {
+    using tree = btree<key_type, int>;
+    using model = std::map<key_type, int>;
+    std::mt19937 gen {13};
+    tree t;
+    model m;
+    for(int phase = 0; phase < 2; ++phase) {
+        for(int i = 0; i < 30000; ++i) {
+            const auto k = key(static_cast<int>(gen() % 5000));
+            // more insertions than erases while growing, the other way round while shrinking
+            const bool grow {gen() % 10 < (phase ? 3u : 7u)};
+            if(grow) {
+                switch(gen() % 4) {
+                    case 0:
+                        CHECK(t.insert({k, i}).second == m.insert({k, i}).second);
+                        break;
+                    case 1:
+                        CHECK(t.try_emplace(k, i).second == m.try_emplace(k, i).second);
+                        break;
+                    case 2:
+                        CHECK(t.insert_or_assign(k, -i).second == m.insert_or_assign(k, -i).second);
+                        break;
+                    default:
+                        t[k] += 1;
+                        m[k] += 1;
+                }
+            }
+            else if(m.empty())
+                continue;
+            else if(gen() % 2)
+                CHECK(t.erase(k) == m.erase(k));
+            else {
+                // by position, then now and then a short range after it
+                const auto at = gen() % m.size();
+                auto it = t.erase(nth(t.cbegin(), at));
+                auto mit = m.erase(nth(m.begin(), at));
+                CHECK((it == t.end()) == (mit == m.end()) && (it == t.end() || it->first == mit->first));
+                const auto count = std::min<std::size_t>(gen() % 40, m.size() - at);
+                if(gen() % 8 == 0 && count) {
+                    it = t.erase(nth(t.cbegin(), at), nth(t.cbegin(), at + count));
+                    mit = m.erase(nth(m.begin(), at), nth(m.begin(), at + count));
+                    CHECK((it == t.end()) == (mit == m.end()) && (it == t.end() || it->first == mit->first));
+                }
+            }
+            if(i % 5000 == 0)
+                CHECK(same(t, m));
+        }
+        CHECK(same(t, m));
+        for(int i = -1; i <= 5000; ++i)
+            probed(t, m, key(i));
+    }
+    while(!m.empty()) {
+        const auto k = m.begin()->first;
+        CHECK(t.erase(k) == m.erase(k));
+    }
+    CHECK(t.size() == 0 && t.begin() == t.end());
+}
+
+/** \brief copies do not share the elements, moves take them along */
+void copies() {
+    btree<int, std::string> t;
+    std::map<int, std::string> m;
+    for(int i = 0; i < 5000; ++i) {
+        t.insert({i * 7 % 5000, std::to_string(i)});
+        m.insert({i * 7 % 5000, std::to_string(i)});
+    }
+    btree<int, std::string> copy {t};
+    CHECK(same(copy, m));
+    for(int i = 0; i < 5000; i += 2)
+        copy.erase(i);
+    CHECK(same(t, m) && copy.size() == 2500);
+    copy = t;
+    CHECK(same(copy, m));
+    btree<int, std::string> moved {std::move(copy)};
+    CHECK(same(moved, m) && copy.size() == 0 && copy.begin() == copy.end());
+    copy = std::move(moved);
+    CHECK(same(copy, m) && moved.size() == 0);
+    t.clear();
+    CHECK(t.size() == 0 && t.begin() == t.end() && same(copy, m));
+}
+
+int main() {
+    random_operations<int>([](int i) { return i; });
+    random_operations<std::string>([](int i) {
+        // the zero padding keeps the order of the strings the order of the numbers
+        auto s = std::to_string(i + 10);
+        return std::string(6 - s.size(), '0') + s;
+    });
+    copies();
+    return finish("btree_test");
+}
@@ -0,0 +1,212 @@
+#include <atomic>
+#include <map>
+#include <random>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+#include "bst.hpp"
+#include "test.hpp"
+
+// The range constructors and assign() against std::map built from the same ranges: sorted or not,
+// with repeated keys, of every small size, and the height of the perfectly balanced result.
+// balance() of random and degenerate trees, which relinks the nodes it has, and the parallel
+// constructors and balance() with grains small enough to split the work, and the exceptions
+// thrown on the threads they start.
+
+using P = std::pair<int, int>;
+
+/** \brief the height of a perfectly balanced tree of \p n nodes */
+std::size_t minimal_height(std::size_t n) {
+    std::size_t h {0};
+    while(n) {
+        n /= 2;
+        ++h;
+    }
+    return h;
+}
+
+/** \brief check \p t against \p m , and that it is perfectly balanced */
+template <typename tree>
+void balanced(const tree& t, const std::map<int, int>& m) {
+    CHECK(same(t, m));
+    CHECK(checked_height(t) == minimal_height(m.size()));
+}
+
+/** \brief unsorted ranges with repeated keys, of which the first element is kept */
+template <typename tree>
+void unsorted() {
+    std::mt19937 gen {7};
+    for(std::size_t n : {0, 1, 2, 3, 7, 8, 100, 5000}) {
+        std::vector<P> v;
+        std::map<int, int> m;
+        for(std::size_t i = 0; i < n; ++i) {
+            v.emplace_back(static_cast<int>(gen() % (n + 1)), static_cast<int>(i));
+            m.insert(v.back());
+        }
+        const tree t(v.begin(), v.end());
+        balanced(t, m);
+        // assign drops what the tree held before
+        tree u;
+        u.insert({-1, -1});
+        u.assign(v.begin(), v.end());
+        balanced(u, m);
+        CHECK(u.insert({-1, -1}).second);
+    }
+}
+
+/** \brief sorted ranges without duplicates, of every size up to a few levels */
+template <typename tree>
+void sorted() {
+    std::vector<P> v;
+    std::map<int, int> m;
+    for(int n = 0; n < 300; ++n) {
+        const tree t(sorted_unique, v.begin(), v.end());
+        balanced(t, m);
+        tree u;
+        u.insert({-1, -1});
+        u.assign(sorted_unique, v.begin(), v.end());
+        balanced(u, m);
+        v.emplace_back(2 * n, -n);
+        m.insert(v.back());
+    }
+    // the built tree is a working tree
+    tree t(sorted_unique, v.begin(), v.end());
+    for(int i = -1; i < 700; i += 3)
+        CHECK(t.insert({i, i}).second == m.insert({i, i}).second);
+    for(int i = 0; i < 700; i += 5)
+        CHECK(t.erase(i) == m.erase(i));
+    CHECK(same(t, m));
+}
+
+/** \brief balance() gives a perfectly balanced tree, for random and sorted insertions, and with
+ * \p linked storage it is made of the same nodes (flat_storage moves them into pre-order) */
+template <typename tree, bool linked>
+void rebalanced() {
+    std::mt19937 gen {5};
+    for(std::size_t n : {0, 1, 2, 3, 100, 1023, 1024, 3000}) {
+        for(bool in_order : {false, true}) {
+            tree t;
+            std::map<int, int> m;
+            for(std::size_t i = 0; m.size() < n; ++i) {
+                const int k {in_order ? static_cast<int>(i) : static_cast<int>(gen() % (4 * n))};
+                t.insert({k, k});
+                m.insert({k, k});
+            }
+            std::vector<const int*> addresses;
+            for(const auto& x : t)
+                addresses.push_back(&x.second);
+            t.balance();
+            balanced(t, m);
+            if constexpr (linked) {
+                std::size_t i {0};
+                for(const auto& x : t)
+                    CHECK(&x.second == addresses[i++]);
+            }
+            // balancing a balanced tree changes nothing, and the tree works on
+            t.balance();
+            balanced(t, m);
+            CHECK(t.insert({-1, -1}).second == m.insert({-1, -1}).second && same(t, m));
+        }
+    }
+}
+
+/** \brief the parallel versions give the trees of the serial ones */
+template <typename tree>
+void parallel_built() {
+    std::mt19937 gen {17};
+    for(unsigned threads : {1u, 2u, 3u, 8u}) {
+        const parallel_t p {threads, 16};
+        for(std::size_t n : {0, 1, 15, 16, 17, 1000, 4000}) {
+            std::vector<P> v;
+            std::map<int, int> m;
+            for(std::size_t i = 0; i < n; ++i) {
+                v.emplace_back(static_cast<int>(gen() % (2 * n + 1)), static_cast<int>(i));
+                m.insert(v.back());
+            }
+            // the stable sort keeps the first of the repeated keys, as the serial one does
+            const tree t(p, v.begin(), v.end());
+            balanced(t, m);
+            const std::vector<P> s(m.begin(), m.end());
+            const tree u(p, sorted_unique, s.begin(), s.end());
+            balanced(u, m);
+            // a degenerate tree balanced in parallel
+            tree d;
+            for(const auto& x : s)
+                d.insert(x);
+            d.balance(p);
+            balanced(d, m);
+            CHECK(d.insert({-1, -1}).second && d.erase(-1) == 1);
+        }
+    }
+}
+
+/** \brief a comparison that throws at its \p left -th call from now, on whichever thread */
+struct fragile_less {
+    static inline std::atomic<long> left {-1};
+    bool operator()(int a, int b) const {
+        if(--left == 0)
+            throw std::runtime_error{"comparison"};
+        return a < b;
+    }
+};
+
+/** \brief exceptions of either side of fork_join() reach the caller, after the join */
+void exceptions() {
+    for(bool fork : {false, true}) {
+        std::atomic<int> done {0};
+        auto works = [&] { ++done; };
+        auto fails = [&] { ++done; throw std::runtime_error{"fails"}; };
+        for(int which = 0; which < 3; ++which) {
+            done = 0;
+            bool thrown {false};
+            try {
+                if(which == 0)
+                    fork_join(fork, fails, works);
+                else if(which == 1)
+                    fork_join(fork, works, fails);
+                else
+                    fork_join(fork, fails, fails);
+            }
+            catch(const std::runtime_error&) {
+                thrown = true;
+            }
+            // without fork a failed f stops before g
+            CHECK(thrown && done == (!fork && which != 1 ? 1 : 2));
+        }
+    }
+    // the parallel sort of a range constructor, failing at different points of the sort
+    std::mt19937 gen {21};
+    std::vector<P> v;
+    for(int i = 0; i < 5000; ++i)
+        v.emplace_back(static_cast<int>(gen() % 10000), i);
+    for(long at : {5l, 500l, 5000l, 20000l}) {
+        fragile_less::left = at;
+        bool thrown {false};
+        try {
+            const bst<int, int, fragile_less> t(parallel_t{4, 16}, v.begin(), v.end());
+        }
+        catch(const std::runtime_error&) {
+            thrown = true;
+        }
+        CHECK(thrown);
+    }
+    fragile_less::left = -1;
+    const bst<int, int, fragile_less> t(parallel_t{4, 16}, v.begin(), v.end());
+    CHECK(t.size() > 0 && checked_height(t) == minimal_height(t.size()));
+}
+
+int main() {
+    unsorted<bst<int, int>>();
+    unsorted<bst<int, int, std::less<int>, no_instrumentation, avl_balancing>>();
+    unsorted<bst<int, int, std::less<int>, no_instrumentation, order_statistics<>>>();
+    sorted<bst<int, int>>();
+    sorted<bst<int, int, std::less<int>, no_instrumentation, avl_balancing>>();
+    sorted<bst<int, int, std::less<int>, no_instrumentation, no_balancing, std::allocator<std::pair<const int, int>>, flat_storage>>();
+    rebalanced<bst<int, int>, true>();
+    rebalanced<bst<int, int, std::less<int>, no_instrumentation, no_balancing, std::allocator<std::pair<const int, int>>, flat_storage>, false>();
+    parallel_built<bst<int, int>>();
+    parallel_built<bst<int, int, std::less<int>, no_instrumentation, avl_balancing>>();
+    parallel_built<bst<int, int, std::less<int>, no_instrumentation, order_statistics<>>>();
+    exceptions();
+    return finish("bulk_test");
+}
@@ -0,0 +1,127 @@
+#include <atomic>
+#include <map>
+#include <random>
+#include <thread>
+#include <vector>
+#include "concurrent_bst.hpp"
+#include "test.hpp"
+
+// concurrent_bst against std::map on one thread, the isolation of its snapshots from later writes,
+// and readers that check every snapshot they take while a writer changes the tree.
+
+/** \brief check if the snapshot \p s holds the same elements as \p m , in the same order */
+template <typename snapshot, typename model>
+bool same_snapshot(const snapshot& s, const model& m) {
+    auto it = m.begin();
+    for(const auto& x : s) {
+        if(it == m.end() || x.first != it->first || x.second != it->second)
+            return false;
+        ++it;
+    }
+    return it == m.end() && s.empty() == m.empty();
+}
+
+/** \brief random writes on one thread, with the lookups of the current version and of snapshots */
+void sequential() {
+    std::mt19937 gen {14};
+    concurrent_bst<int, int> t;
+    std::map<int, int> m;
+    for(int i = 0; i < 20000; ++i) {
+        const int k {static_cast<int>(gen() % 1000)};
+        switch(gen() % 3) {
+            case 0:
+                CHECK(t.insert({k, i}) == m.insert({k, i}).second);
+                break;
+            case 1:
+                CHECK(t.insert_or_assign(k, -i) == m.insert_or_assign(k, -i).second);
+                break;
+            default:
+                CHECK(t.erase(k) == (m.erase(k) == 1));
+        }
+        CHECK(t.size() == m.size());
+        const auto got = t.get(k);
+        const auto it = m.find(k);
+        CHECK(got.has_value() == (it != m.end()) && t.contains(k) == (it != m.end()));
+        CHECK(!got || got->second == it->second);
+        if(i % 1000 == 0) {
+            const auto s = t.read();
+            CHECK(same_snapshot(s, m));
+            for(int j = -1; j <= 1000; ++j) {
+                const auto lo = s.lower_bound(j);
+                const auto mlo = m.lower_bound(j);
+                CHECK((lo == s.end()) == (mlo == m.end()) && (lo == s.end() || lo->first == mlo->first));
+                CHECK((s.find(j) == s.end()) == (m.find(j) == m.end()));
+            }
+        }
+        if(i % 7000 == 6999) {
+            t.clear();
+            m.clear();
+            CHECK(t.size() == 0 && t.read().empty());
+        }
+    }
+    t.reclaim();
+    CHECK(same_snapshot(t.read(), m));
+}
+
+/** \brief a snapshot keeps the version it was taken from */
+void isolation() {
+    concurrent_bst<int, int> t;
+    std::map<int, int> m;
+    for(int i = 0; i < 1000; ++i) {
+        t.insert({i, i});
+        m.insert({i, i});
+    }
+    {
+        const auto s = t.read();
+        for(int i = 0; i < 1000; i += 2)
+            t.erase(i);
+        t.insert_or_assign(1, -1);
+        t.insert({5000, 0});
+        CHECK(same_snapshot(s, m));
+        t.clear();
+        CHECK(same_snapshot(s, m) && t.read().empty());
+    }
+    t.reclaim();
+}
+
+/** \brief readers against a writer that inserts the keys in order, then erases them in order:
+ * every snapshot is the set of keys [ a , b ) of some moment, with each value equal to its key */
+void readers() {
+    constexpr int n {3000};
+    concurrent_bst<int, int> t;
+    std::atomic<bool> done {false};
+    std::vector<std::thread> threads;
+    std::vector<int> failures(3, 0);
+    for(int r = 0; r < 3; ++r)
+        threads.emplace_back([&, r] {
+            int seen {0};
+            while(!done.load() || seen < 2) {
+                ++seen;
+                const auto s = t.read();
+                bool ok {true};
+                int last {-1};
+                for(const auto& x : s) {
+                    ok = ok && x.second == x.first && (last < 0 || x.first == last + 1);
+                    last = x.first;
+                }
+                failures[static_cast<std::size_t>(r)] += !ok;
+            }
+        });
+    for(int i = 0; i < n; ++i)
+        t.insert({i, i});
+    for(int i = 0; i < n; ++i)
+        t.erase(i);
+    done = true;
+    for(auto& x : threads)
+        x.join();
+    for(int f : failures)
+        CHECK(f == 0);
+    CHECK(t.size() == 0 && t.read().empty());
+}
+
+int main() {
+    sequential();
+    isolation();
+    readers();
+    return finish("concurrent_test");
+}
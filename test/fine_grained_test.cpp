@@ -0,0 +1,263 @@
+#include <algorithm>
+#include <atomic>
+#include <map>
+#include <random>
+#include <set>
+#include <thread>
+#include <vector>
+#include "fine_grained_bst.hpp"
+#include "test.hpp"
+
+// fine_grained_bst against std::map on one thread, then under contention: threads on keys of
+// their own checked against sequential models while they fight over a few shared keys, and
+// short windows of concurrent operations on one key checked for linearizability.
+
+/** \brief random updates on one thread, with the lookups after each of them */
+void sequential() {
+    std::mt19937 gen {15};
+    fine_grained_bst<int, int> t;
+    std::map<int, int> m;
+    for(int i = 0; i < 20000; ++i) {
+        const int k {static_cast<int>(gen() % 1000)};
+        switch(gen() % 3) {
+            case 0:
+                CHECK(t.insert({k, i}) == m.insert({k, i}).second);
+                break;
+            case 1:
+                CHECK(t.insert_or_assign(k, -i) == m.insert_or_assign(k, -i).second);
+                break;
+            default:
+                CHECK(t.erase(k) == (m.erase(k) == 1));
+        }
+        CHECK(t.size() == m.size());
+        const auto x = t.get(k);
+        const auto it = m.find(k);
+        CHECK(x.has_value() == (it != m.end()) && t.contains(k) == (it != m.end()));
+        CHECK(!x || x->second == it->second);
+    }
+    t.reclaim();
+    for(int k = 0; k < 1000; ++k)
+        CHECK(t.contains(k) == (m.count(k) == 1));
+}
+
+// Stress check: every thread works on its own keys, so the result of each of its operations is
+// known from a sequential model, and all the threads also fight over a few shared keys, of which
+// only the sums are checked: a shared key is present at the end iff it was inserted once more
+// than it was erased, and every value read belongs to a key that was written with it.
+// The order of the operations on the shared keys is checked by linearizable() below.
+void stress(unsigned threads, int ops) {
+    fine_grained_bst<int, int> t;
+    const int own {1024}, shared {16};
+    std::vector<std::set<int>> models(threads);
+    std::vector<std::atomic<long>> balance(shared);
+    std::vector<int> failures(threads, 0);
+    std::vector<std::thread> workers;
+    for(unsigned id = 0; id < threads; ++id)
+        workers.emplace_back([&, id] {
+            std::mt19937 gen {id};
+            auto& model = models[id];
+            auto& failed = failures[id];
+            for(int i = 0; i < ops; ++i) {
+                if(gen() % 4 == 0) {
+                    const int s {static_cast<int>(gen() % shared)};
+                    const int k {own * static_cast<int>(threads) + s};
+                    if(gen() % 2) {
+                        if(t.insert({k, -k}))
+                            ++balance[static_cast<std::size_t>(s)];
+                    }
+                    else if(t.erase(k))
+                        --balance[static_cast<std::size_t>(s)];
+                    if(auto x = t.get(k); x && x->second != -k)
+                        ++failed;
+                    continue;
+                }
+                const int k {static_cast<int>(gen() % own) * static_cast<int>(threads) + static_cast<int>(id)};
+                switch(gen() % 3) {
+                    case 0:
+                        failed += t.insert({k, k}) != model.insert(k).second;
+                        break;
+                    case 1:
+                        failed += t.erase(k) != (model.erase(k) == 1);
+                        break;
+                    default:
+                        failed += t.contains(k) != (model.count(k) == 1);
+                }
+            }
+        });
+    for(auto& w : workers)
+        w.join();
+    for(int f : failures)
+        CHECK(f == 0);
+
+    std::size_t expected {0};
+    for(const auto& model : models) {
+        expected += model.size();
+        for(auto k : model) {
+            const auto x = t.get(k);
+            CHECK(x && x->second == k);
+        }
+    }
+    for(int s = 0; s < shared; ++s) {
+        // each shared key inserted at most once more than erased
+        const long b {balance[static_cast<std::size_t>(s)].load()};
+        CHECK(b == 0 || b == 1);
+        CHECK(t.contains(own * static_cast<int>(threads) + s) == (b == 1));
+        expected += static_cast<std::size_t>(b);
+    }
+    CHECK(t.size() == expected);
+}
+
+/** \brief threads calling arrive() wait there until all of them have arrived */
+class spin_barrier {
+    const unsigned count;
+    std::atomic<unsigned> arrived {0};
+    std::atomic<unsigned> phase {0};
+
+    public:
+
+    explicit spin_barrier(unsigned n): count{n} {}
+
+    void arrive() {
+        const unsigned p {phase.load()};
+        if(arrived.fetch_add(1) + 1 == count) {
+            arrived = 0;
+            ++phase;
+        }
+        else
+            while(phase.load() == p)
+                std::this_thread::yield();
+    }
+};
+
+/** \brief an operation on a shared key, with what it returned and the ticks taken just before
+ * its call and just after its return */
+struct event {
+    enum kind { insert, erase, find } what;
+    bool result;
+    unsigned long call, ret;
+};
+
+/** \brief Wing and Gong search for a sequential order of the events of a window
+ *
+ * \p history holds the events of every thread in program order, \p next the first event of each
+ * thread not yet ordered, \p present whether the key is in the tree after the ordered ones.
+ * An event can come next only if it was called before every other pending event returned.
+ * The states already found to be dead ends are kept in \p dead , so each is searched once.
+ * \returns true if the pending events can be ordered, each with its result, ending with the key
+ * present iff \p end */
+bool linearizable(const std::vector<std::vector<event>>& history, std::vector<std::size_t>& next, bool present,
+                  bool end, std::set<std::pair<std::vector<std::size_t>, bool>>& dead) {
+    unsigned long bound {~0ul};
+    bool pending {false};
+    for(std::size_t i = 0; i < history.size(); ++i)
+        if(next[i] < history[i].size()) {
+            pending = true;
+            bound = std::min(bound, history[i][next[i]].ret);
+        }
+    if(!pending)
+        return present == end;
+    if(!dead.insert({next, present}).second)
+        return false;
+    for(std::size_t i = 0; i < history.size(); ++i) {
+        if(next[i] == history[i].size())
+            continue;
+        const auto& e = history[i][next[i]];
+        // insert succeeds iff the key is absent, erase and find iff it is present
+        if(e.call > bound || e.result != (e.what == event::insert ? !present : present))
+            continue;
+        ++next[i];
+        const bool found {linearizable(history, next, e.what == event::find ? present : e.what == event::insert, end, dead)};
+        --next[i];
+        if(found)
+            return true;
+    }
+    return false;
+}
+
+/** \brief the search itself, on histories known to be linearizable or not */
+void histories() {
+    // two overlapping inserts cannot both succeed, one after the other can, if an erase comes between
+    using E = event;
+    std::vector<std::size_t> next(2, 0);
+    std::set<std::pair<std::vector<std::size_t>, bool>> dead;
+    CHECK(!linearizable({{E{E::insert, true, 0, 3}}, {E{E::insert, true, 1, 2}}}, next, false, true, dead));
+    dead.clear();
+    CHECK(linearizable({{E{E::insert, true, 0, 3}}, {E{E::insert, false, 1, 2}}}, next, false, true, dead));
+    dead.clear();
+    CHECK(linearizable({{E{E::insert, true, 0, 1}, E{E::insert, true, 4, 5}}, {E{E::erase, true, 2, 3}}}, next, false, true, dead));
+    dead.clear();
+    // a find that returned before the insert was called cannot see the key
+    CHECK(!linearizable({{E{E::insert, true, 2, 3}}, {E{E::find, true, 0, 1}}}, next, false, true, dead));
+    dead.clear();
+    CHECK(!linearizable({{E{E::insert, true, 0, 1}}, {E{E::find, false, 2, 3}}}, next, false, true, dead));
+}
+
+// Linearizability check over short windows: in every round all the threads start together a few
+// operations on one shared key, stamped with a global counter taken before the call and after
+// the return, and then wait for each other; the key is read once the round is over. Each round
+// is checked apart by linearizable(), starting from the state the last round on the same key
+// left, which keeps the search small.
+void windows(unsigned threads, int rounds) {
+    fine_grained_bst<int, int> t;
+    const int shared {8}, per_round {2};
+    // other keys around the shared ones, so that the updates change inner nodes
+    for(int k = 0; k < 1024; ++k)
+        t.insert({2 * k + 1, k});
+    std::vector<std::vector<std::vector<event>>> history(static_cast<std::size_t>(rounds), std::vector<std::vector<event>>(threads));
+    std::vector<char> present_after(static_cast<std::size_t>(rounds));
+    std::vector<int> failures(threads, 0);
+    std::atomic<unsigned long> ticks {0};
+    spin_barrier barrier {threads};
+    std::vector<std::thread> workers;
+    for(unsigned id = 0; id < threads; ++id)
+        workers.emplace_back([&, id] {
+            std::mt19937 gen {id + 1000};
+            for(int r = 0; r < rounds; ++r) {
+                const int k {2 * (r % shared) * 128};
+                auto& mine = history[static_cast<std::size_t>(r)][id];
+                barrier.arrive();
+                for(int i = 0; i < per_round; ++i) {
+                    event e {static_cast<event::kind>(gen() % 3), false, 0, 0};
+                    e.call = ticks++;
+                    if(e.what == event::insert)
+                        e.result = t.insert({k, -k});
+                    else if(e.what == event::erase)
+                        e.result = t.erase(k);
+                    else if(auto x = t.get(k)) {
+                        e.result = true;
+                        failures[id] += x->second != -k;
+                    }
+                    e.ret = ticks++;
+                    mine.push_back(e);
+                }
+                barrier.arrive();
+                // the others wait at the start of the next round
+                if(id == 0)
+                    present_after[static_cast<std::size_t>(r)] = t.contains(k);
+            }
+        });
+    for(auto& w : workers)
+        w.join();
+    for(int f : failures)
+        CHECK(f == 0);
+
+    std::vector<char> present(shared, false);
+    for(int r = 0; r < rounds; ++r) {
+        std::vector<std::size_t> next(threads, 0);
+        std::set<std::pair<std::vector<std::size_t>, bool>> dead;
+        auto& state = present[static_cast<std::size_t>(r % shared)];
+        const bool end {present_after[static_cast<std::size_t>(r)] != 0};
+        CHECK(linearizable(history[static_cast<std::size_t>(r)], next, state, end, dead));
+        state = end;
+    }
+}
+
+int main() {
+    sequential();
+    histories();
+    for(unsigned n : {2u, 4u, 8u}) {
+        stress(n, 20000);
+        windows(n, 300);
+    }
+    return finish("fine_grained_test");
+}
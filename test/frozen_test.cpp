@@ -0,0 +1,67 @@
+#include <map>
+#include <string>
+#include "bst.hpp"
+#include "test.hpp"
+
+// freeze() against the tree it comes from: the same elements, and the same results of find()
+// and lower_bound(), for every size up to a few complete Eytzinger levels.
+
+/** \brief freeze the tree \p t and compare the snapshot with \p m , probing every key and the gaps */
+template <typename tree, typename model, typename key_of>
+void frozen_matches(const tree& t, const model& m, key_of key) {
+    const auto f = t.freeze();
+    CHECK(f.size() == m.size() && f.empty() == m.empty());
+    CHECK(same(f, m));
+    // the keys are 2 * i , the odd probes fall between them
+    for(int i = -1; i <= 2 * static_cast<int>(m.size()) + 1; ++i) {
+        const auto k = key(i);
+        const auto lo = m.lower_bound(k);
+        const auto flo = f.lower_bound(k);
+        CHECK((flo == f.end()) == (lo == m.end()));
+        CHECK(flo == f.end() || (flo->first == lo->first && flo->second == lo->second));
+        const auto tlo = t.lower_bound(k);
+        CHECK(flo == f.end() || tlo->first == flo->first);
+        const auto found = f.find(k);
+        CHECK((found == f.end()) == (m.find(k) == m.end()));
+        CHECK(found == f.end() || found->first == k);
+    }
+}
+
+/** \brief every size from 0 to \p n , built in order */
+template <typename tree, typename key_of>
+void sizes(int n, key_of key) {
+    tree t;
+    std::map<decltype(key(0)), int> m;
+    frozen_matches(t, m, key);
+    for(int i = 0; i < n; ++i) {
+        t.insert({key(2 * i), i});
+        m.insert({key(2 * i), i});
+        frozen_matches(t, m, key);
+    }
+}
+
+/** \brief the snapshot does not change with the tree */
+void isolation() {
+    bst<int, int> t;
+    for(int i = 0; i < 1000; ++i)
+        t.insert({i, i});
+    const auto f = t.freeze();
+    t.clear();
+    for(int i = 0; i < 10; ++i)
+        t.insert({i, -i});
+    CHECK(f.size() == 1000);
+    CHECK(f.find(500) != f.end() && f.find(500)->second == 500);
+    CHECK(f.find(5)->second == 5);
+}
+
+int main() {
+    sizes<bst<int, int>>(300, [](int i) { return i; });
+    sizes<bst<double, int>>(70, [](int i) { return i * 0.5; });
+    sizes<bst<std::string, int>>(70, [](int i) {
+        // the zero padding keeps the order of the strings the order of the numbers
+        auto s = std::to_string(i + 10);
+        return std::string(6 - s.size(), '0') + s;
+    });
+    isolation();
+    return finish("frozen_test");
+}
@@ -0,0 +1,83 @@
+#include <map>
+#include <random>
+#include <thread>
+#include <vector>
+#include "persistent_bst.hpp"
+#include "test.hpp"
+
+// Versions of a persistent_bst against copies of a std::map: changing a version, or destroying
+// it, must leave every other version as it was when copied.
+
+/** \brief random updates of one version, keeping a copy of the tree and of the map every 100 */
+void versions() {
+    std::mt19937 gen {16};
+    persistent_bst<int, int> t;
+    std::map<int, int> m;
+    std::vector<persistent_bst<int, int>> saved;
+    std::vector<std::map<int, int>> models;
+    for(int i = 0; i < 20000; ++i) {
+        const int k {static_cast<int>(gen() % 500)};
+        switch(gen() % 3) {
+            case 0:
+                CHECK(t.insert({k, i}) == m.insert({k, i}).second);
+                break;
+            case 1:
+                CHECK(t.insert_or_assign(k, -i) == m.insert_or_assign(k, -i).second);
+                break;
+            default:
+                CHECK(t.erase(k) == (m.erase(k) == 1));
+        }
+        if(i % 100 == 0) {
+            saved.push_back(t);
+            models.push_back(m);
+            CHECK(saved.back().shares_root(t));
+        }
+        // a version that is dropped frees only the nodes no other version reaches
+        if(i % 700 == 0 && saved.size() > 2) {
+            const auto v = static_cast<long>(gen() % saved.size());
+            saved.erase(saved.begin() + v);
+            models.erase(models.begin() + v);
+        }
+    }
+    CHECK(same(t, m));
+    for(std::size_t v = 0; v < saved.size(); ++v) {
+        CHECK(same(saved[v], models[v]));
+        for(const auto& x : models[v])
+            CHECK(saved[v].find(x.first)->second == x.second);
+    }
+}
+
+/** \brief versions of one tree updated and destroyed by different threads at once */
+void threads() {
+    persistent_bst<int, int> base;
+    std::map<int, int> m;
+    for(int i = 0; i < 5000; ++i) {
+        base.insert({i, i});
+        m.insert({i, i});
+    }
+    std::vector<std::thread> workers;
+    std::vector<int> failures(4, 0);
+    for(int w = 0; w < 4; ++w)
+        workers.emplace_back([&, w] {
+            auto mine = base;
+            auto model = m;
+            for(int i = w; i < 5000; i += 4) {
+                mine.erase(i);
+                model.erase(i);
+                mine.insert_or_assign(i + 5000 * (w + 1), w);
+                model.insert_or_assign(i + 5000 * (w + 1), w);
+            }
+            failures[static_cast<std::size_t>(w)] = !same(mine, model);
+        });
+    for(auto& w : workers)
+        w.join();
+    for(int f : failures)
+        CHECK(!f);
+    CHECK(same(base, m));
+}
+
+int main() {
+    versions();
+    threads();
+    return finish("persistent_test");
+}
@@ -0,0 +1,130 @@
+#include <map>
+#include <random>
+#include <stdexcept>
+#include "bst.hpp"
+#include "node_pool.hpp"
+#include "test.hpp"
+
+// split(), join() and the set operations against the same operations on std::map, for every
+// balancing policy, and for storages that share the nodes or copy them (flat_storage, and
+// node_pool allocators of different arenas, which do not compare equal).
+
+using P = std::pair<const int, int>;
+using model = std::map<int, int>;
+
+/** \brief a tree and a map with \p n random keys in [ \p from , \p from + \p span ) */
+template <typename tree>
+void fill(tree& t, model& m, std::size_t n, int from, int span, std::mt19937& gen) {
+    while(m.size() < n) {
+        const int k {from + static_cast<int>(gen() % static_cast<unsigned>(span))};
+        t.insert({k, k + from});
+        m.insert({k, k + from});
+    }
+}
+
+/** \brief check the elements of \p t , its links and, with order statistics, select() */
+template <typename tree, bool ranked>
+void matches(const tree& t, const model& m) {
+    CHECK(same(t, m));
+    checked_height(t);
+    if constexpr (ranked) {
+        std::size_t k {0};
+        for(const auto& x : m)
+            CHECK(t.select(k++)->first == x.first);
+    }
+}
+
+template <typename tree, bool ranked = false>
+void setops() {
+    std::mt19937 gen {18};
+    // equal sizes, one much smaller than the other, and empty ones
+    const std::pair<std::size_t, std::size_t> sizes[] {{2000, 2000}, {5000, 20}, {20, 5000}, {0, 100}, {100, 0}, {1, 1}};
+    for(auto [na, nb] : sizes) {
+        tree a, b;
+        model ma, mb;
+        // the ranges overlap in part, so that some keys are in both
+        fill(a, ma, na, 0, 3 * static_cast<int>(na) + 1, gen);
+        fill(b, mb, nb, static_cast<int>(na), 3 * static_cast<int>(nb) + 1, gen);
+
+        {
+            tree x {a}, y {b};
+            model mx {ma}, my {mb};
+            x.merge(y);
+            mx.merge(my);
+            matches<tree, ranked>(x, mx);
+            matches<tree, ranked>(y, my);
+        }
+        {
+            tree x {a};
+            model mx;
+            for(const auto& e : ma)
+                if(mb.count(e.first))
+                    mx.insert(e);
+            x.intersect(b);
+            matches<tree, ranked>(x, mx);
+            matches<tree, ranked>(b, mb);
+        }
+        {
+            tree x {a};
+            model mx {ma};
+            for(const auto& e : mb)
+                mx.erase(e.first);
+            x.subtract(b);
+            matches<tree, ranked>(x, mx);
+            matches<tree, ranked>(b, mb);
+        }
+        // split at a key present, at one absent, before all and after all, then join back
+        for(int k : {ma.empty() ? 0 : ma.begin()->first + 1, static_cast<int>(na), -1, 4 * static_cast<int>(na) + 2}) {
+            tree x {a};
+            auto right = x.split(k);
+            model left_model {ma.begin(), ma.lower_bound(k)}, right_model {ma.lower_bound(k), ma.end()};
+            matches<tree, ranked>(x, left_model);
+            matches<tree, ranked>(right, right_model);
+            x.join(right);
+            matches<tree, ranked>(x, ma);
+            CHECK(right.size() == 0 && right.begin() == right.end());
+        }
+    }
+    // join refuses overlapping keys and leaves both trees as they were
+    tree x, y;
+    model mx, my;
+    fill(x, mx, 100, 0, 200, gen);
+    fill(y, my, 100, 150, 200, gen);
+    bool thrown {false};
+    try {
+        x.join(y);
+    }
+    catch(const std::invalid_argument&) {
+        thrown = true;
+    }
+    CHECK(thrown);
+    matches<tree, ranked>(x, mx);
+    matches<tree, ranked>(y, my);
+    // with itself
+    x.merge(x);
+    x.intersect(x);
+    matches<tree, ranked>(x, mx);
+    x.subtract(x);
+    CHECK(x.size() == 0 && x.begin() == x.end());
+}
+
+template <typename balancing>
+using linked = bst<int, int, std::less<int>, no_instrumentation, balancing>;
+template <typename balancing>
+using flat = bst<int, int, std::less<int>, no_instrumentation, balancing, std::allocator<P>, flat_storage>;
+template <typename balancing>
+using pooled = bst<int, int, std::less<int>, no_instrumentation, balancing, node_pool<P>>;
+
+int main() {
+    setops<linked<no_balancing>>();
+    setops<linked<avl_balancing>>();
+    setops<linked<splay_balancing<>>>();
+    setops<linked<scapegoat_balancing<>>>();
+    setops<linked<order_statistics<>>, true>();
+    setops<linked<order_statistics<avl_balancing>>, true>();
+    setops<flat<no_balancing>>();
+    setops<flat<avl_balancing>>();
+    setops<pooled<no_balancing>>();
+    setops<pooled<avl_balancing>>();
+    return finish("setops_test");
+}
@@ -0,0 +1,188 @@
+#include <cstdio>
+#include <fstream>
+#include <map>
+#include <random>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <system_error>
+#include <unistd.h>
+#include "bst.hpp"
+#include "mapped_bst.hpp"
+#include "test.hpp"
+
+// save() and load() round trips against std::map, the rejection of snapshots that do not match,
+// and mapped_bst against the tree it was saved from.
+
+/** \brief the bytes of the snapshot of \p t */
+template <typename tree>
+std::string saved(const tree& t) {
+    std::ostringstream os {std::ios::binary};
+    t.save(os);
+    return os.str();
+}
+
+/** \brief check that loading \p bytes into \p t throws std::runtime_error and leaves it unchanged */
+template <typename tree, typename model>
+void rejected(tree& t, const model& m, const std::string& bytes) {
+    std::istringstream is {bytes, std::ios::binary};
+    bool thrown {false};
+    try {
+        t.load(is);
+    }
+    catch(const std::runtime_error&) {
+        thrown = true;
+    }
+    CHECK(thrown);
+    CHECK(same(t, m));
+}
+
+/** \brief save and load trees of several sizes, into empty and non-empty trees */
+template <typename tree, typename model, typename make>
+void round_trip(make element) {
+    std::mt19937 gen {20};
+    for(std::size_t n : {0, 1, 2, 1000}) {
+        tree t;
+        model m;
+        while(m.size() < n) {
+            auto e = element(gen);
+            t.insert(e);
+            m.insert(e);
+        }
+        const auto bytes = saved(t);
+        tree u;
+        u.insert(element(gen));
+        std::istringstream is {bytes, std::ios::binary};
+        u.load(is);
+        CHECK(same(u, m));
+        checked_height(u);
+        // the loaded tree is a working tree
+        auto e = element(gen);
+        CHECK(u.insert(e).second == m.insert(e).second);
+        CHECK(same(u, m));
+    }
+}
+
+/** \brief snapshots that are not of the tree type, or are damaged */
+void bad_snapshots() {
+    bst<int, double> t;
+    for(int i = 0; i < 100; ++i)
+        t.insert({i, i * 0.5});
+    const auto bytes = saved(t);
+
+    bst<int, double> u;
+    std::map<int, double> m {{-1, 1.0}};
+    u.insert({-1, 1.0});
+    auto magic = bytes;
+    magic[0] = 'x';
+    rejected(u, m, magic);
+    auto version = bytes;
+    version[8] = static_cast<char>(version[8] ^ 0x7f);
+    rejected(u, m, version);
+    rejected(u, m, bytes.substr(0, 10));
+    rejected(u, m, "");
+
+    // other key and value types: the sizes differ, or a fixed size is read as a variable one
+    bst<long, double> longs;
+    std::map<long, double> ml;
+    rejected(longs, ml, bytes);
+    bst<int, std::string> strings;
+    std::map<int, std::string> ms;
+    rejected(strings, ms, bytes);
+
+    // a truncated body leaves the tree empty, since the old elements are dropped before the build
+    std::istringstream is {bytes.substr(0, bytes.size() - 8), std::ios::binary};
+    bool thrown {false};
+    try {
+        u.load(is);
+    }
+    catch(const std::runtime_error&) {
+        thrown = true;
+    }
+    CHECK(thrown);
+    CHECK(u.size() == 0 && u.begin() == u.end());
+}
+
+/** \brief a mapped snapshot answers as the tree it was saved from */
+void mapped() {
+    const std::string path {"/tmp/snapshot_test_" + std::to_string(::getpid()) + ".bin"};
+    bst<int, long> t;
+    std::map<int, long> m;
+    std::mt19937 gen {12};
+    for(int i = 0; i < 5000; ++i) {
+        const int k {static_cast<int>(gen() % 20000)};
+        t.insert({k, -k});
+        m.insert({k, -k});
+    }
+    {
+        std::ofstream os {path, std::ios::binary};
+        t.save(os);
+    }
+    {
+        mapped_bst<int, long> f {path};
+        CHECK(f.size() == t.size());
+        CHECK(same(f, m));
+        for(int k = -1; k <= 20001; ++k) {
+            const auto lo = f.lower_bound(k);
+            const auto tlo = t.lower_bound(k);
+            CHECK((lo == f.end()) == (tlo == t.end()));
+            CHECK(lo == f.end() || (lo->first == tlo->first && lo->second == tlo->second));
+            const auto up = f.upper_bound(k);
+            const auto tup = t.upper_bound(k);
+            CHECK((up == f.end()) == (tup == t.end()));
+            CHECK(up == f.end() || up->first == tup->first);
+            CHECK(f.contains(k) == t.contains(k));
+        }
+    }
+    // the snapshot of other types, a truncated file and a missing one
+    bool thrown {false};
+    try {
+        mapped_bst<long, long> f {path};
+    }
+    catch(const std::runtime_error&) {
+        thrown = true;
+    }
+    CHECK(thrown);
+    {
+        std::ofstream os {path, std::ios::binary};
+        const auto bytes = saved(t);
+        os.write(bytes.data(), static_cast<std::streamsize>(bytes.size() / 2));
+    }
+    thrown = false;
+    try {
+        mapped_bst<int, long> f {path};
+    }
+    catch(const std::runtime_error&) {
+        thrown = true;
+    }
+    CHECK(thrown);
+    std::remove(path.c_str());
+    thrown = false;
+    try {
+        mapped_bst<int, long> f {path};
+    }
+    catch(const std::system_error&) {
+        thrown = true;
+    }
+    CHECK(thrown);
+}
+
+int main() {
+    round_trip<bst<int, double>, std::map<int, double>>([](std::mt19937& gen) {
+        const int k {static_cast<int>(gen() % 5000)};
+        return std::pair<const int, double>{k, k * 0.25};
+    });
+    round_trip<bst<std::string, std::string, std::less<std::string>, no_instrumentation, avl_balancing>,
+               std::map<std::string, std::string>>([](std::mt19937& gen) {
+        const auto k = std::to_string(gen() % 5000);
+        return std::pair<const std::string, std::string>{k, std::string(gen() % 40, 'v') + k};
+    });
+    round_trip<bst<int, int, std::less<int>, no_instrumentation, no_balancing, std::allocator<std::pair<const int, int>>, flat_storage>,
+               std::map<int, int>>([](std::mt19937& gen) {
+        const int k {static_cast<int>(gen() % 5000)};
+        return std::pair<const int, int>{k, -k};
+    });
+    bad_snapshots();
+    mapped();
+    return finish("snapshot_test");
+}
@@ -0,0 +1,117 @@
+#include <map>
+#include <random>
+#include <string>
+#include <utility>
+#include "bst.hpp"
+#include "test.hpp"
+
+// flat_storage against std::map, through the relocations of the array when it grows.
+
+using P = std::pair<const int, int>;
+using flat = bst<int, int, std::less<int>, no_instrumentation, no_balancing, std::allocator<P>, flat_storage>;
+using flat_avl = bst<int, int, std::less<int>, no_instrumentation, avl_balancing, std::allocator<P>, flat_storage>;
+
+/** \brief a tree whose array is full: 16, 32, ... elements */
+template <typename tree>
+tree full(int n) {
+    tree t;
+    for(int i = 0; i < n; ++i)
+        t.insert({2 * i, i});
+    return tree{std::move(t)};
+}
+
+/** \brief insertions whose arguments refer to an element of a full tree, that the growth of the array moves */
+template <typename tree>
+void aliasing() {
+    for(int n : {16, 32, 64}) {
+        {
+            auto t = full<tree>(n);
+            auto it = t.begin();
+            // a present key does not grow the array, so the iterator stays valid
+            CHECK(!t.insert(*it).second);
+            CHECK(it->first == 0);
+            CHECK(t[it->first] == 0);
+            CHECK(!t.try_emplace(it->first, 5).second);
+            CHECK(!t.emplace(*it).second);
+            CHECK(!t.insert_or_assign(it->first, it->second).second);
+            CHECK(it->first == 0 && it->second == 0);
+        }
+        {
+            // a new key with the value taken from the tree
+            auto t = full<tree>(n);
+            auto r = t.try_emplace(1, t.begin()->second);
+            CHECK(r.second && r.first->first == 1 && r.first->second == 0);
+        }
+        {
+            auto t = full<tree>(n);
+            auto r = t.emplace(std::piecewise_construct, std::forward_as_tuple(3), std::forward_as_tuple(t.begin()->second));
+            CHECK(r.second && r.first->first == 3 && r.first->second == 0);
+        }
+        {
+            auto t = full<tree>(n);
+            auto r = t.insert_or_assign(5, t.begin()->second);
+            CHECK(r.second && r.first->second == 0);
+            CHECK(t.size() == static_cast<std::size_t>(n) + 1);
+        }
+    }
+    // string keys, where a dangling key would be read through its pointer
+    bst<std::string, int, std::less<std::string>, no_instrumentation, no_balancing,
+        std::allocator<std::pair<const std::string, int>>, flat_storage> s;
+    for(int i = 0; i < 16; ++i)
+        s.insert({std::string(40, static_cast<char>('a' + i)), i});
+    s[s.begin()->first + "z"] = 1;
+    CHECK(s.size() == 17);
+    CHECK(s.find(std::string(40, 'a') + "z") != s.end());
+}
+
+/** \brief random insertions and erases against std::map, with balance(), copies and moves */
+template <typename tree>
+void random_operations() {
+    std::mt19937 gen {11};
+    tree t;
+    std::map<int, int> m;
+    for(int i = 0; i < 100000; ++i) {
+        const int k {static_cast<int>(gen() % 3000)};
+        switch(gen() % 5) {
+            case 0:
+            case 1:
+                CHECK(t.insert({k, i}).second == m.insert({k, i}).second);
+                break;
+            case 2:
+                if(!m.empty())
+                    CHECK(t.erase(k) == m.erase(k));
+                break;
+            case 3:
+                t[k] += 1;
+                m[k] += 1;
+                break;
+            default:
+                CHECK(t.try_emplace(k, i).second == m.try_emplace(k, i).second);
+        }
+        if(i % 10000 == 0) {
+            CHECK(same(t, m));
+            checked_height(t);
+            t.balance();
+            CHECK(same(t, m));
+            tree copy {t};
+            CHECK(same(copy, m));
+            tree moved {std::move(copy)};
+            CHECK(same(moved, m));
+        }
+    }
+    CHECK(same(t, m));
+    t.clear();
+    CHECK(t.size() == 0 && t.begin() == t.end());
+    for(int i = 0; i < 1000; ++i)
+        t.insert({i, i});
+    CHECK(t.size() == 1000 && t.find(999) != t.end());
+}
+
+int main() {
+    aliasing<flat>();
+    aliasing<flat_avl>();
+    aliasing<bst<int, int>>();
+    random_operations<flat>();
+    random_operations<flat_avl>();
+    return finish("storage_test");
+}
@@ -0,0 +1,61 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdio>
+
+// Checks shared by the test programs: a failed CHECK prints where it is and the program goes on,
+// main() returns finish(), which is not 0 if any check failed. The programs are built with the
+// address and undefined behaviour sanitizers, which abort on the first memory error.
+
+/** \brief number of failed checks */
+inline int failed_checks {0};
+
+#define CHECK(condition)                                                                        \
+    do {                                                                                        \
+        if(!(condition)) {                                                                      \
+            ++failed_checks;                                                                    \
+            std::fprintf(stderr, "%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #condition);  \
+        }                                                                                       \
+    } while(0)
+
+/** \brief report the result of the program \p name , \returns its exit status */
+inline int finish(const char* name) {
+    if(failed_checks)
+        std::printf("%s: %d checks failed\n", name, failed_checks);
+    else
+        std::printf("%s: ok\n", name);
+    return failed_checks ? 1 : 0;
+}
+
+/** \brief check if \p t holds the same elements as the std::map \p m , in the same order */
+template <typename tree, typename model>
+bool same(const tree& t, const model& m) {
+    if(t.size() != m.size())
+        return false;
+    auto it = m.begin();
+    for(const auto& x : t) {
+        if(it == m.end() || x.first != it->first || x.second != it->second)
+            return false;
+        ++it;
+    }
+    return it == m.end();
+}
+
+/** \brief check the links of every node of \p t , whose children must point back to it
+ *
+ * \returns the height of the tree, 0 if empty */
+template <typename tree>
+std::size_t checked_height(const tree& t) {
+    std::size_t height {0};
+    for(auto it = t.begin(); it != t.end(); ++it) {
+        const auto x = it.get_node();
+        CHECK(!x->get_left() || x->get_left()->get_parent() == x);
+        CHECK(!x->get_right() || x->get_right()->get_parent() == x);
+        std::size_t depth {1};
+        for(auto y = x; y->get_parent(); y = y->get_parent())
+            ++depth;
+        height = std::max(height, depth);
+    }
+    return height;
+}